@@ -0,0 +1,241 @@
+/**
+  @file BVServiceSimulator.hpp
+*/
+
+
+#ifndef __BVSERVICESIMULATOR_HPP__
+#define __BVSERVICESIMULATOR_HPP__
+
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <openfluid/ware/PluggableSimulator.hpp>
+#include <openfluid/tools/ColumnTextParser.hpp>
+
+#include "BVServiceGraph.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Base of the BVService simulators adapting the OpenFLUID spatial graph to the bvservice-core models,
+  sharing the building of the in-memory graph and the reading of the CN of land uses
+*/
+class BVServiceSimulator : public openfluid::ware::PluggableSimulator
+{
+  protected:
+
+    /**
+      Attributes read in the in-memory graph, in addition to the topology,
+      the area of SU and the length and subparts ratios of LI which are always read
+    */
+    enum GraphAttributes : unsigned int
+    {
+      GRAPH_BASE = 0,
+      GRAPH_INDICATORS = 1,  // slope and buffer flag of SU, outlet flag of LI
+      GRAPH_FLOWDISTS = 2    // flow distances of SU, LI and RS, required when read
+    };
+
+    const unsigned int m_DefaultCN = 93;
+
+    // Units in process order, indexed by their rank as in the in-memory graph and the models
+
+    std::vector<openfluid::core::SpatialUnit*> m_Units;
+
+
+    BVServiceSimulator(): PluggableSimulator()
+    { }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Builds the in-memory graph from the spatial graph in process order, with the given attributes
+      @param[in] Attributes the GraphAttributes flags of the attributes read in addition to the base ones
+    */
+    void buildGraph(BVServiceGraph& Graph, unsigned int Attributes)
+    {
+      openfluid::core::SpatialUnit* U;
+      openfluid::core::SpatialUnit* UpU;
+      std::map<openfluid::core::SpatialUnit*,unsigned int> RanksOfUnits;
+
+      m_Units.clear();
+      Graph.clear();
+
+      OPENFLUID_ALLUNITS_ORDERED_LOOP(U)
+      {
+        RanksOfUnits[U] = m_Units.size();
+        m_Units.push_back(U);
+      }
+
+      for (unsigned int i = 0; i < m_Units.size(); i++)
+      {
+        U = m_Units[i];
+        const UnitClass_t Class = getUnitClass(U->getClass());
+
+        Graph.addUnit(Class);
+
+        // incoming from LI then from SU, in the order of the connections to keep the same summation order
+        for (auto UpClass : {"LI","SU"})
+        {
+          openfluid::core::UnitsPtrList_t* UpList = U->fromSpatialUnits(UpClass);
+
+          if (UpList)
+          {
+            OPENFLUID_UNITSLIST_LOOP(UpList,UpU)
+            {
+              Graph.addUpstreamUnit(RanksOfUnits.at(UpU));
+            }
+          }
+        }
+
+        if (Class == SU_CLASS)
+        {
+          OPENFLUID_GetAttribute(U,"area",Graph.Areas[i]);
+
+          if (Attributes & GRAPH_INDICATORS)
+          {
+            Graph.Slopes[i] = OPENFLUID_GetAttribute(U,"slopemean")->asDoubleValue().get();
+
+            std::string LandUse;
+            OPENFLUID_GetAttribute(U,"landuse",LandUse);
+            if (LandUse == "buffer") // TODO uncorrect to fix
+              Graph.Buffers[i] = 1;
+          }
+        }
+        else if (Class == LI_CLASS)
+        {
+          for (unsigned int p = 0; p < BVServiceGraph::LISubpartsCount; p++)
+            OPENFLUID_GetAttribute(U,std::string(BVServiceGraph::LISubparts[p])+"ratio",
+                                   Graph.Ratios[i*BVServiceGraph::LISubpartsCount+p]);
+
+          OPENFLUID_GetAttribute(U,"length",Graph.Lengths[i]);
+
+          if (Attributes & GRAPH_INDICATORS)
+            Graph.Outlets[i] = OPENFLUID_GetAttribute(U,"isoutlet")->asBooleanValue().get();
+        }
+
+        if ((Attributes & GRAPH_FLOWDISTS) && Class != OTHER_CLASS)
+        {
+          if (!OPENFLUID_IsAttributeExist(U,"flowdist"))
+            OPENFLUID_RaiseError("No flowdist attribute for " + U->getClass() + "#" + std::to_string(U->getID()) +
+                                 ", required for travel-time routing");
+
+          OPENFLUID_GetAttribute(U,"flowdist",Graph.FlowDists[i]);
+        }
+      }
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Reads the CN of land uses codes from the landuse2CN.fr.txt file of the input directory
+    */
+    void loadLandUse2CN(std::map<std::string,int>& LandUse2CN)
+    {
+      std::string InputDir;
+      OPENFLUID_GetRunEnvironment("dir.input",InputDir);
+
+      openfluid::tools::ColumnTextParser LandUse2CNFile("#",";");
+      LandUse2CNFile.loadFromFile(InputDir+"/landuse2CN.fr.txt");
+
+      std::string Code;
+      long int CN = 0;
+
+      LandUse2CN.clear();
+
+      for (unsigned int i = 0;i<LandUse2CNFile.getLinesCount();i++ )
+      {
+        if (LandUse2CNFile.getStringValue(i,0,&Code) &&
+            LandUse2CNFile.getLongValue(i,1,&CN))
+        {
+          LandUse2CN[Code] = CN;
+        }
+        else
+        {
+          OPENFLUID_RaiseError("Format error or wrong value in file landuse2CN.fr.txt");
+        }
+      }
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Sets the land use index of each SU in the graph built by buildGraph() and the CN of each land use,
+      unknown land uses sharing the default CN.
+      Land uses are dictionary-encoded by the import (landuseidx attribute), so the land use code is only read
+      and mapped to a CN for the first SU of each encoded land use
+    */
+    void encodeLandUses(const std::map<std::string,int>& LandUse2CN, BVServiceGraph& Graph,
+                        std::vector<double>& LandUsesCN)
+    {
+      std::map<std::string,unsigned int> LandUsesIndices;
+
+      // index of each encoded land use, -1 if not met yet
+      std::vector<int> EncodedIndices;
+
+      LandUsesCN.clear();
+
+      for (unsigned int i = 0; i < m_Units.size(); i++)
+      {
+        openfluid::core::SpatialUnit* U = m_Units[i];
+
+        if (Graph.Classes[i] != SU_CLASS)
+          continue;
+
+        long EncodedIndex = -1;
+        if (OPENFLUID_IsAttributeExist(U,"landuseidx"))
+          OPENFLUID_GetAttribute(U,"landuseidx",EncodedIndex);
+
+        if (EncodedIndex >= 0 && EncodedIndex < long(EncodedIndices.size()) && EncodedIndices[EncodedIndex] >= 0)
+        {
+          Graph.LandUses[i] = EncodedIndices[EncodedIndex];
+          continue;
+        }
+
+        std::string LandUseCode = OPENFLUID_GetAttribute(U,"landuse")->toString();
+
+        auto itCN = LandUse2CN.find(LandUseCode);
+        if (itCN == LandUse2CN.end())
+          LandUseCode.clear();
+
+        auto itIndex = LandUsesIndices.find(LandUseCode);
+
+        if (itIndex == LandUsesIndices.end())
+        {
+          itIndex = LandUsesIndices.insert({LandUseCode,LandUsesCN.size()}).first;
+          LandUsesCN.push_back(itCN != LandUse2CN.end() ? itCN->second : m_DefaultCN);
+        }
+
+        if (itCN == LandUse2CN.end())
+          OPENFLUID_LogAndDisplayWarning("CN value for land use \"" <<
+                                         OPENFLUID_GetAttribute(U,"landuse")->toString() << "\" of SU#" <<
+                                         U->getID() << " set to default value (" << m_DefaultCN << ")");
+
+        Graph.LandUses[i] = itIndex->second;
+
+        if (EncodedIndex >= 0)
+        {
+          if (EncodedIndex >= long(EncodedIndices.size()))
+            EncodedIndices.resize(EncodedIndex+1,-1);
+
+          EncodedIndices[EncodedIndex] = itIndex->second;
+        }
+      }
+    }
+};
+
+
+#endif /* __BVSERVICESIMULATOR_HPP__ */
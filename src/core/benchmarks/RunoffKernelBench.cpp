@@ -0,0 +1,120 @@
+/**
+  @file RunoffKernelBench.cpp
+
+  Times the batch runoffs computation on an array of water heights against the former computation
+  of one water height at a time with a branch limiting the runoff, and displays the speedup.
+  The default count of water heights fits in the L2 cache, larger arrays being limited by the memory bandwidth.
+  Usage: bvservice-core-runoffkernel-bench [<count of water heights> [<repeats>]]
+*/
+
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "RunoffKernel.hpp"
+
+
+typedef void (*RunoffsComputation_t)(const double*, double, double*, unsigned int);
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Runoff of a single water height, as computed before the batch computation
+*/
+static double computeRunoff(const double& WaterHeight, const double& S)
+{
+  double Runoff = std::pow(WaterHeight-(0.2*S),2)/(WaterHeight+(0.8*S));
+
+  if (Runoff > WaterHeight)
+    Runoff = WaterHeight;
+
+  return Runoff;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+static void computeRunoffsPerUnit(const double* WaterHeights, double S, double* Runoffs, unsigned int Count)
+{
+  for (unsigned int i = 0; i < Count; i++)
+    Runoffs[i] = computeRunoff(WaterHeights[i],S);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  @return the best duration in seconds of the given repeats of the computation over the water heights
+*/
+static double timeComputation(RunoffsComputation_t Computation, const std::vector<double>& WaterHeights, double S,
+                              std::vector<double>& Runoffs, unsigned int Repeats)
+{
+  double Best = 0.0;
+
+  for (unsigned int r = 0; r < Repeats; r++)
+  {
+    auto Begin = std::chrono::steady_clock::now();
+    Computation(WaterHeights.data(),S,Runoffs.data(),WaterHeights.size());
+    auto End = std::chrono::steady_clock::now();
+
+    const double Duration = std::chrono::duration<double>(End-Begin).count();
+
+    if (r == 0 || Duration < Best)
+      Best = Duration;
+  }
+
+  return Best;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+int main(int argc, char** argv)
+{
+  const unsigned int Count = (argc > 1) ? std::strtoul(argv[1],nullptr,10) : 1 << 15;
+  const unsigned int Repeats = (argc > 2) ? std::strtoul(argv[2],nullptr,10) : 200;
+  const double S = 0.05;
+
+  if (!Count || !Repeats)
+  {
+    std::fprintf(stderr,"Usage: %s [<count of water heights> [<repeats>]]\n",argv[0]);
+    return 1;
+  }
+
+  // water heights up to 0.2 m, around the 0.2S threshold, so the branch of the former computation is unpredictable
+  std::vector<double> WaterHeights(Count);
+  std::srand(1);
+  for (auto& H : WaterHeights)
+    H = 0.2*std::rand()/RAND_MAX;
+
+  std::vector<double> PerUnitRunoffs(Count);
+  std::vector<double> Runoffs(Count);
+
+  // warm-up
+  computeRunoffsPerUnit(WaterHeights.data(),S,PerUnitRunoffs.data(),Count);
+  computeRunoffs(WaterHeights.data(),S,Runoffs.data(),Count);
+
+  const double PerUnitTime = timeComputation(computeRunoffsPerUnit,WaterHeights,S,PerUnitRunoffs,Repeats);
+  const double Time = timeComputation(computeRunoffs,WaterHeights,S,Runoffs,Repeats);
+  const bool Identical = (std::memcmp(Runoffs.data(),PerUnitRunoffs.data(),Count*sizeof(double)) == 0);
+
+  std::printf("%u water heights, best of %u repeats\n",Count,Repeats);
+  std::printf("%-9s %10.3f us\n","per unit",PerUnitTime*1e6);
+  std::printf("%-9s %10.3f us  %6.2fx%s\n","batch",Time*1e6,PerUnitTime/Time,
+              Identical ? "" : "  (results differ from per unit)");
+
+  return Identical ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+/**
+  @file BVServiceGraph.hpp
+*/
+
+
+#ifndef __BVSERVICEGRAPH_HPP__
+#define __BVSERVICEGRAPH_HPP__
+
+
+#include <string>
+#include <vector>
+
+#include "UnitClasses.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  In-memory BVService spatial graph, independent of OpenFLUID: units in process order with their class,
+  their upstream units and the attributes used by the models, all indexed by the rank of the units.
+  Attributes of a class are only read for the units of this class, other values are ignored
+*/
+class BVServiceGraph
+{
+  public:
+
+    static const unsigned int LISubpartsCount = 3;
+
+    /**
+      Names of the LI subparts, the ratio of a subpart being given by the <name>ratio attribute of LI
+    */
+    static const char* const LISubparts[LISubpartsCount];
+
+    std::vector<UnitClass_t> Classes;
+
+    // upstream LI then upstream SU of each unit, in compressed rows.
+    // The order of the upstream units is the summation order of their runoff volumes
+    std::vector<unsigned int> UpBegins = {0};
+    std::vector<unsigned int> UpUnits;
+
+    // flow distance of each unit to its downstream unit (m)
+    std::vector<double> FlowDists;
+
+    // SU area (m2), mean slope, index of the land use and flag of buffer land use
+    std::vector<double> Areas;
+    std::vector<double> Slopes;
+    std::vector<unsigned int> LandUses;
+    std::vector<unsigned char> Buffers;
+
+    // LI length (m), ratios of the subparts (LISubpartsCount values per unit) and outlet flag
+    std::vector<double> Lengths;
+    std::vector<double> Ratios;
+    std::vector<unsigned char> Outlets;
+
+
+    void clear();
+
+    /**
+      Adds a unit of the given class with null attributes.
+      Its upstream units are then given by addUpstreamUnit(), before the next unit is added
+      @return the rank of the unit
+    */
+    unsigned int addUnit(UnitClass_t Class);
+
+    void addUpstreamUnit(unsigned int UpRank)
+    {
+      UpUnits.push_back(UpRank);
+      UpBegins.back()++;
+    }
+
+    unsigned int getUnitsCount() const
+    {
+      return Classes.size();
+    }
+
+    /**
+      Checks the sizes of the arrays and that upstream units are before their downstream unit
+      @return false if the graph is not consistent, with the error in Error
+    */
+    bool check(std::string& Error) const;
+};
+
+
+#endif /* __BVSERVICEGRAPH_HPP__ */
@@ -0,0 +1,73 @@
+/**
+  @file Convolution.hpp
+*/
+
+
+#ifndef __CONVOLUTION_HPP__
+#define __CONVOLUTION_HPP__
+
+
+#include <complex>
+#include <vector>
+
+
+/**
+  Computes in place the discrete Fourier transform of the given values (iterative radix-2 FFT),
+  or the inverse transform scaled by 1/Size
+  @param[in] Size the count of values, which must be a power of 2
+*/
+void computeFFT(std::complex<double>* Values, unsigned int Size, bool Inverse);
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Convolution of signals of a fixed length with a fixed kernel.
+  The spectrum of the kernel is computed once, so a convolution costs one forward and one inverse FFT.
+  Convolutions of small sizes are computed directly
+*/
+class KernelConvolution
+{
+  private:
+
+    std::vector<double> m_Kernel;
+
+    unsigned int m_SignalLength = 0;
+
+    // FFT size, 0 if convolutions are computed directly
+    unsigned int m_FFTSize = 0;
+
+    std::vector<std::complex<double>> m_KernelSpectrum;
+
+    // convolutions are computed directly up to this count of products
+    static const unsigned int MaxDirectProducts = 4096;
+
+
+  public:
+
+    /**
+      Sets the kernel and the length of the convolved signals
+    */
+    void setKernel(const std::vector<double>& Kernel, unsigned int SignalLength);
+
+    /**
+      @return the length of the result of a convolution, which is the signal length + the kernel length - 1
+    */
+    unsigned int getResultLength() const
+    {
+      return m_SignalLength+m_Kernel.size()-1;
+    }
+
+    /**
+      Convolves the given signal with the kernel
+      @param[in] Signal the signal, of the length given to setKernel()
+      @param[out] Result the result, of getResultLength() values
+      @param[in,out] Buffer a work buffer, so a buffer per thread allows concurrent convolutions
+    */
+    void convolve(const double* Signal, double* Result, std::vector<std::complex<double>>& Buffer) const;
+};
+
+
+#endif /* __CONVOLUTION_HPP__ */
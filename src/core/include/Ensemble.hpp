@@ -0,0 +1,196 @@
+/**
+  @file Ensemble.hpp
+*/
+
+
+#ifndef __ENSEMBLE_HPP__
+#define __ENSEMBLE_HPP__
+
+
+#include <cstdint>
+#include <limits>
+#include <string>
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Pseudo-random generator (xoshiro256**) whose state is seeded by SplitMix64 from a seed and a stream number,
+  so each ensemble member has its own reproducible sequence, independent of the threads computing it
+*/
+class RandomGenerator
+{
+  private:
+
+    std::uint64_t m_State[4];
+
+
+    static std::uint64_t rotateLeft(std::uint64_t X, int K)
+    {
+      return (X << K) | (X >> (64-K));
+    }
+
+
+  public:
+
+    RandomGenerator(std::uint64_t Seed, std::uint64_t Stream);
+
+    std::uint64_t next()
+    {
+      const std::uint64_t Result = rotateLeft(m_State[1]*5,7)*9;
+      const std::uint64_t T = m_State[1] << 17;
+
+      m_State[2] ^= m_State[0];
+      m_State[3] ^= m_State[1];
+      m_State[1] ^= m_State[2];
+      m_State[0] ^= m_State[3];
+      m_State[2] ^= T;
+      m_State[3] = rotateLeft(m_State[3],45);
+
+      return Result;
+    }
+
+    /**
+      @return a uniform value in [0,1)
+    */
+    double uniform()
+    {
+      return (next() >> 11) * (1.0/9007199254740992.0);
+    }
+
+    /**
+      @return a standard normal value (Box-Muller transform)
+    */
+    double normal();
+};
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Distribution of a perturbation of mean 0, given as "<kind>:<parameter>" with kind being
+  normal (standard deviation), uniform (half width), triangular (half width)
+  or lognormal (sigma of the log of 1+perturbation)
+*/
+class PerturbationDistribution
+{
+  public:
+
+    enum Kind_t { NONE, NORMAL, UNIFORM, TRIANGULAR, LOGNORMAL };
+
+    Kind_t Kind = NONE;
+
+    double Param = 0.0;
+
+
+    /**
+      @return false if the given string is not a valid distribution
+    */
+    bool parse(const std::string& Str);
+
+    double sample(RandomGenerator& Generator) const;
+};
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Online estimation of a quantile by the P-square algorithm (Jain and Chlamtac, 1985),
+  using 5 markers whatever the count of values
+*/
+class P2Quantile
+{
+  private:
+
+    double m_Prob = 0.5;
+
+    unsigned int m_Count = 0;
+
+    // markers heights, positions and desired positions
+    double m_Heights[5];
+
+    double m_Positions[5];
+
+    double m_Desired[5];
+
+
+  public:
+
+    void reset(double Prob);
+
+    void add(double Value);
+
+    /**
+      @return the estimated quantile, NaN if no value has been added
+    */
+    double get() const;
+};
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Online mean, variance (Welford algorithm) and 5%, 50% and 95% quantiles of a unit result,
+  NaN values being ignored
+*/
+class EnsembleAccumulator
+{
+  public:
+
+    static const unsigned int QuantilesCount = 3;
+
+    static const double QuantilesProbs[QuantilesCount];
+
+  private:
+
+    unsigned long m_Count = 0;
+
+    double m_Mean = 0.0;
+
+    double m_M2 = 0.0;
+
+    P2Quantile m_Quantiles[QuantilesCount];
+
+
+  public:
+
+    EnsembleAccumulator()
+    {
+      reset();
+    }
+
+    void reset();
+
+    void add(double Value);
+
+    unsigned long getCount() const
+    {
+      return m_Count;
+    }
+
+    /**
+      @return the mean, NaN if no value has been added
+    */
+    double getMean() const
+    {
+      return m_Count ? m_Mean : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    /**
+      @return the sample standard deviation, 0 for less than 2 values
+    */
+    double getStdDev() const;
+
+    void getQuantiles(double* Quantiles) const;
+};
+
+
+#endif /* __ENSEMBLE_HPP__ */
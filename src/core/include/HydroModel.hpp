@@ -0,0 +1,271 @@
+/**
+  @file HydroModel.hpp
+*/
+
+
+#ifndef __HYDROMODEL_HPP__
+#define __HYDROMODEL_HPP__
+
+
+#include <string>
+#include <vector>
+
+#include "BVServiceGraph.hpp"
+#include "RunoffNetwork.hpp"
+#include "Ensemble.hpp"
+#include "IndicatorsModel.hpp"
+
+
+class WorkersPool;
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Runoff and infiltration model of a BVService graph: the runoff network with the sensitivities
+  and the Monte Carlo ensemble of the first scenario (runoff volumes and optionally indicators),
+  recomputed with the network results when enabled.
+  A model can be built and computed many times in a same process, with no OpenFLUID run,
+  changed units only being recomputed with their downstream units
+*/
+class HydroModel
+{
+  public:
+
+    /**
+      CN of the LI subparts, in the order of BVServiceGraph::LISubparts
+    */
+    static const double LISubpartsCN[BVServiceGraph::LISubpartsCount];
+
+  private:
+
+    double m_LIWidth = 1.0;
+
+    RunoffNetwork m_Network;
+
+    // units are all computed when more units changed than this ratio
+    static constexpr double MaxIncrementalRatio = 0.125;
+
+    static const unsigned int ParallelChunkSize = 64;
+
+    // LI length of each unit (by rank), to set the LI parameters from changed ratios
+    std::vector<double> m_LILengths;
+
+    bool m_SensitivitiesEnabled = false;
+
+    // adjoint of the outgoing runoff volume of each unit, for the first scenario
+    std::vector<double> m_AdjointRunoffVolumes;
+
+    // sensitivities of the runoff volume reaching RS, for the first scenario
+    std::vector<double> m_CNSensitivities;
+    std::vector<double> m_RatiosSensitivities;
+
+    // Monte Carlo ensemble on CN of land uses and rainfall, for the first scenario
+
+    unsigned int m_EnsembleMembers = 0;
+
+    unsigned long m_EnsembleSeed = 0;
+
+    PerturbationDistribution m_EnsembleCNDistri;
+
+    PerturbationDistribution m_EnsembleRainDistri;
+
+    // land use index of each SU (by rank), and CN of each land use.
+    // A SU whose CN is changed gets its own land use, after the land uses of the graph
+    std::vector<unsigned int> m_SULandUses;
+    std::vector<double> m_LandUsesCN;
+
+    unsigned int m_GraphLandUsesCount = 0;
+
+    // results of a batch of members, one row of units per member.
+    // Incoming runoff and infiltration volumes are only computed for the indicators
+    std::vector<double> m_MembersVolumes;
+    std::vector<double> m_MembersUpVolumes;
+    std::vector<double> m_MembersInfiltVolumes;
+
+    // S values of land uses of a batch of members, one row per member
+    std::vector<double> m_MembersS;
+
+    static const unsigned int EnsembleBatchSize = 256;
+
+    std::vector<EnsembleAccumulator> m_EnsembleAccumulators;
+
+    // ensemble statistics of outgoing runoff volumes (incoming for RS)
+    std::vector<double> m_EnsembleMeans;
+    std::vector<double> m_EnsembleStdDevs;
+    std::vector<double> m_EnsembleQuantiles;
+
+    // indicators model computing the indicators of each member, null for no indicators in the ensemble
+    const IndicatorsModel* mp_EnsembleIndicators = nullptr;
+
+    // copies of the indicators model, one per thread computing the members indicators
+    std::vector<IndicatorsModel> m_MembersIndicatorsModels;
+
+    // indicators values of a batch of members, one row per member
+    std::vector<double> m_MembersIndicators;
+
+    std::vector<EnsembleAccumulator> m_IndicatorsAccumulators;
+
+    // ensemble statistics of indicators, in the order of IndicatorsModel::getIndicatorsValues()
+    std::vector<double> m_EnsembleIndicatorsMeans;
+    std::vector<double> m_EnsembleIndicatorsStdDevs;
+    std::vector<double> m_EnsembleIndicatorsQuantiles;
+
+
+    void computeMember(unsigned int Member, unsigned int Slot);
+
+    void computeSensitivities();
+
+    void computeEnsemble(WorkersPool* Pool);
+
+
+  public:
+
+    /**
+      Sets the parameters of a LI from its length and the ratios of its subparts
+    */
+    void setLIParams(UnitHydroParams& Params, double Length, const double* Ratios) const;
+
+    /**
+      Builds the model of the given graph, with the CN of each land use index and the count of rainfall scenarios.
+      Rainfalls and results are set to 0
+      @return false if the graph is not consistent, with the error in Error
+    */
+    bool build(const BVServiceGraph& Graph, const std::vector<double>& LandUsesCN, unsigned int ScenariosCount,
+               std::string& Error);
+
+    /**
+      Sets the Monte Carlo ensemble computed with the results, no ensemble being computed for 0 members (default).
+      The model must be built
+      @param[in] Indicators the indicators model built from the same graph, computing the indicators
+      of each member for their ensemble statistics, null for runoff volumes only.
+      It is copied for each thread at the first computation and must be kept until then
+    */
+    void setEnsemble(unsigned int Members, unsigned long Seed,
+                     const PerturbationDistribution& CNDistri, const PerturbationDistribution& RainDistri,
+                     const IndicatorsModel* Indicators = nullptr);
+
+    unsigned int getEnsembleMembers() const
+    {
+      return m_EnsembleMembers;
+    }
+
+    /**
+      Enables the computation of the sensitivities with the results, disabled by default
+      as the backward pass covers all units even when few units are recomputed
+    */
+    void setSensitivities(bool Enabled)
+    {
+      m_SensitivitiesEnabled = Enabled;
+    }
+
+    bool isSensitivitiesEnabled() const
+    {
+      return m_SensitivitiesEnabled;
+    }
+
+    /**
+      Changes the CN of the SU of the given rank, for this SU only.
+      Results are updated by computeChanged() with this rank
+    */
+    void setSUCN(unsigned int Rank, double CN);
+
+    /**
+      Changes the ratios of the subparts of the LI of the given rank, in the order of BVServiceGraph::LISubparts.
+      Results are updated by computeChanged() with this rank
+    */
+    void setLIRatios(unsigned int Rank, const double* Ratios);
+
+    /**
+      @return the runoff network, whose rainfalls and parameters can be changed before a computation
+    */
+    RunoffNetwork& network()
+    {
+      return m_Network;
+    }
+
+    const RunoffNetwork& getNetwork() const
+    {
+      return m_Network;
+    }
+
+    /**
+      Computes all units, then the sensitivities and the ensemble if enabled
+    */
+    void computeAll(WorkersPool* Pool);
+
+    /**
+      Computes the given changed units and their downstream units, or all units when many units changed,
+      then the sensitivities and the ensemble if enabled and if results changed
+      @return false if no result changed
+    */
+    bool computeChanged(const std::vector<unsigned int>& ChangedRanks, WorkersPool* Pool);
+
+    /**
+      @return the derivatives of the runoff volume reaching RS with respect to the CN of each unit (by rank),
+      for the first scenario, null if sensitivities are not enabled
+    */
+    const std::vector<double>& getCNSensitivities() const
+    {
+      return m_CNSensitivities;
+    }
+
+    /**
+      @return the derivatives of the runoff volume reaching RS with respect to the ratios of the subparts
+      of each unit (BVServiceGraph::LISubpartsCount values per rank), for the first scenario,
+      null if sensitivities are not enabled
+    */
+    const std::vector<double>& getRatiosSensitivities() const
+    {
+      return m_RatiosSensitivities;
+    }
+
+    /**
+      @return the ensemble means (by rank), null without ensemble
+    */
+    const std::vector<double>& getEnsembleMeans() const
+    {
+      return m_EnsembleMeans;
+    }
+
+    const std::vector<double>& getEnsembleStdDevs() const
+    {
+      return m_EnsembleStdDevs;
+    }
+
+    /**
+      @return the ensemble quantiles (EnsembleAccumulator::QuantilesCount values per rank), null without ensemble
+    */
+    const std::vector<double>& getEnsembleQuantiles() const
+    {
+      return m_EnsembleQuantiles;
+    }
+
+    /**
+      @return the ensemble means of indicators, in the order of IndicatorsModel::getIndicatorsValues(),
+      null without ensemble indicators. Means of indicators undefined for a unit are NaN
+    */
+    const std::vector<double>& getEnsembleIndicatorsMeans() const
+    {
+      return m_EnsembleIndicatorsMeans;
+    }
+
+    const std::vector<double>& getEnsembleIndicatorsStdDevs() const
+    {
+      return m_EnsembleIndicatorsStdDevs;
+    }
+
+    /**
+      @return the ensemble quantiles of indicators (EnsembleAccumulator::QuantilesCount values per indicator value),
+      null without ensemble indicators
+    */
+    const std::vector<double>& getEnsembleIndicatorsQuantiles() const
+    {
+      return m_EnsembleIndicatorsQuantiles;
+    }
+};
+
+
+#endif /* __HYDROMODEL_HPP__ */
@@ -0,0 +1,231 @@
+/**
+  @file IndicatorsModel.hpp
+*/
+
+
+#ifndef __INDICATORSMODEL_HPP__
+#define __INDICATORSMODEL_HPP__
+
+
+#include <string>
+#include <vector>
+
+#include "BVServiceGraph.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Land indicators of a BVService graph, computed from the hydrologic results of SU and LI.
+  The topology and the data which do not change are built once, indicators of SU and LI
+  are stored by index of the unit in its class
+*/
+class IndicatorsModel
+{
+  public:
+
+    /**
+      Names of the real-valued indicators of SU and of LI computed at each computation,
+      in the order of the values given by getIndicatorsValues()
+    */
+    static const unsigned int IndicatorsValuesCount = 6;
+
+    static const char* SUIndicatorsNames[IndicatorsValuesCount];
+
+    static const char* LIIndicatorsNames[IndicatorsValuesCount];
+
+  private:
+
+    UnitsClassIndex m_Classes;
+
+    // upstream LI then upstream SU of each unit, in compressed rows
+    std::vector<unsigned int> m_UpBegins;
+    std::vector<unsigned int> m_UpUnits;
+
+    // downstream unit of each unit, the unit itself if none
+    std::vector<unsigned int> m_DownUnits;
+
+    // units reached from RS, and from RS or outlet LI, going upstream through SU and LI
+    std::vector<unsigned char> m_FromRS;
+    std::vector<unsigned char> m_FromRSOrOutletLI;
+
+    // contributive upper areas, which do not change
+    std::vector<double> m_UpperAreas;
+
+    // data of SU, by index of SU
+    std::vector<double> m_SUSlopes;
+    std::vector<long> m_SUBuffersCounts;
+    std::vector<double> m_SUInfiltVolSums;
+    std::vector<double> m_SURunoffVolDeltas;
+    std::vector<double> m_SURunoffVolRatios;
+    std::vector<double> m_SUInfiltVolRatios;
+    std::vector<double> m_SUInfiltVolRatioSums;
+    std::vector<double> m_SUConnDegrees;
+    std::vector<double> m_SUErosionRisks;
+    std::vector<double> m_SURunoffContribs;
+
+    // data of LI, by index of LI
+    std::vector<double> m_LILengths;
+    std::vector<unsigned char> m_LIOccupied;
+    std::vector<unsigned char> m_LIOutlets;
+    std::vector<double> m_LIRunoffVolDeltas;
+    std::vector<double> m_LIRunoffVolRatios;
+    std::vector<double> m_LIInfiltVolRatios;
+    std::vector<double> m_LIConcDegrees;
+    std::vector<double> m_LIImportanceDegrees;
+    std::vector<double> m_LIInterestDegrees;
+
+    // results of the current computation, by rank
+    std::vector<double> m_InfiltVolRatios;
+    std::vector<double> m_PathSums;
+
+
+    bool isSUOrLI(unsigned int Rank) const
+    {
+      return m_Classes.getClass(Rank) == SU_CLASS || m_Classes.getClass(Rank) == LI_CLASS;
+    }
+
+
+  public:
+
+    static void normalizeValues(std::vector<double>& Values);
+
+    static double computeRatioVolume(double UpRunoffVol, double DeltaVolume);
+
+    /**
+      Builds the topology and the data which do not change from the given graph
+      @return false if the graph is not consistent, with the error in Error
+    */
+    bool build(const BVServiceGraph& Graph, std::string& Error);
+
+    /**
+      Resets the cumulated SU infiltration ratios, kept between computations for SU not reached from the network
+    */
+    void reset();
+
+    /**
+      Computes the indicators from the incoming runoff volumes, outgoing runoff volumes and infiltration volumes
+      of the units, given by rank with the given stride between two units (typically the count of scenarios
+      of a runoff network). Only values of SU and LI are read
+    */
+    void compute(const double* UpRunoffVolumes, const double* RunoffVolumes, const double* InfiltVolumes,
+                 unsigned int Stride = 1);
+
+    /**
+      Copies the real-valued indicators of the last computation, IndicatorsValuesCount values per SU (by index of SU)
+      then IndicatorsValuesCount values per LI (by index of LI)
+    */
+    void getIndicatorsValues(double* Values) const;
+
+    const UnitsClassIndex& getClasses() const
+    {
+      return m_Classes;
+    }
+
+    /**
+      @return true if the unit of the given rank is reached from RS
+    */
+    bool isFromRS(unsigned int Rank) const
+    {
+      return m_FromRS[Rank];
+    }
+
+    /**
+      @return true if the unit of the given rank is reached from RS or from an outlet LI
+    */
+    bool isFromRSOrOutletLI(unsigned int Rank) const
+    {
+      return m_FromRSOrOutletLI[Rank];
+    }
+
+    /**
+      @return the contributive upper areas, by rank
+    */
+    const std::vector<double>& getUpperAreas() const
+    {
+      return m_UpperAreas;
+    }
+
+    /**
+      @return the numbers of buffer elements crossed to reach the network, by index of SU
+    */
+    const std::vector<long>& getSUBuffersCounts() const
+    {
+      return m_SUBuffersCounts;
+    }
+
+    const std::vector<double>& getSUInfiltVolSums() const
+    {
+      return m_SUInfiltVolSums;
+    }
+
+    const std::vector<double>& getSURunoffVolDeltas() const
+    {
+      return m_SURunoffVolDeltas;
+    }
+
+    const std::vector<double>& getSURunoffVolRatios() const
+    {
+      return m_SURunoffVolRatios;
+    }
+
+    const std::vector<double>& getSUInfiltVolRatios() const
+    {
+      return m_SUInfiltVolRatios;
+    }
+
+    const std::vector<double>& getSUInfiltVolRatioSums() const
+    {
+      return m_SUInfiltVolRatioSums;
+    }
+
+    const std::vector<double>& getSUConnDegrees() const
+    {
+      return m_SUConnDegrees;
+    }
+
+    const std::vector<double>& getSUErosionRisks() const
+    {
+      return m_SUErosionRisks;
+    }
+
+    const std::vector<double>& getSURunoffContribs() const
+    {
+      return m_SURunoffContribs;
+    }
+
+    const std::vector<double>& getLIRunoffVolDeltas() const
+    {
+      return m_LIRunoffVolDeltas;
+    }
+
+    const std::vector<double>& getLIRunoffVolRatios() const
+    {
+      return m_LIRunoffVolRatios;
+    }
+
+    const std::vector<double>& getLIInfiltVolRatios() const
+    {
+      return m_LIInfiltVolRatios;
+    }
+
+    const std::vector<double>& getLIConcDegrees() const
+    {
+      return m_LIConcDegrees;
+    }
+
+    const std::vector<double>& getLIImportanceDegrees() const
+    {
+      return m_LIImportanceDegrees;
+    }
+
+    const std::vector<double>& getLIInterestDegrees() const
+    {
+      return m_LIInterestDegrees;
+    }
+};
+
+
+#endif /* __INDICATORSMODEL_HPP__ */
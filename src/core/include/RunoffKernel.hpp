@@ -0,0 +1,27 @@
+/**
+  @file RunoffKernel.hpp
+*/
+
+
+#ifndef __RUNOFFKERNEL_HPP__
+#define __RUNOFFKERNEL_HPP__
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Computes SCS-CN runoffs of an array of water heights for a same S value.
+  The runoff is (H-0.2S)^2/(H+0.8S), limited to the water height H.
+  The limitation is branchless, so the loop can be vectorized by the compiler,
+  and gives the same results as the former comparison, including for NaN values
+  @param[in] WaterHeights the water heights
+  @param[in] S the S value, in meters
+  @param[out] Runoffs the runoffs, may be the same array as WaterHeights
+  @param[in] Count the count of water heights
+*/
+void computeRunoffs(const double* WaterHeights, double S, double* Runoffs, unsigned int Count);
+
+
+#endif /* __RUNOFFKERNEL_HPP__ */
@@ -0,0 +1,249 @@
+/**
+  @file RunoffNetwork.hpp
+*/
+
+
+#ifndef __RUNOFFNETWORK_HPP__
+#define __RUNOFFNETWORK_HPP__
+
+
+#include <vector>
+
+#include "UnitClasses.hpp"
+
+
+class WorkersPool;
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Hydrologic parameters of a unit, compiled once before the run so computations use no attribute nor map
+*/
+class UnitHydroParams
+{
+  public:
+
+    static const unsigned int MaxSubparts = 3;
+
+    // SU area, or LI efficient area (length * max ratio of subparts * LI width)
+    double Area = 0.0;
+
+    // SU S value
+    double S = 0.0;
+
+    // LI max ratio of subparts
+    double MaxRatio = 0.0;
+
+    // LI index of the subpart having the max ratio
+    unsigned char MaxRatioSubpart = 0;
+
+    // LI S values of the subparts crossed by runoff, in crossing order
+    double SubpartsS[MaxSubparts] = {};
+
+    unsigned char SubpartsCount = 0;
+
+    // SU column in the rainfall series
+    unsigned int RainColumn = 0;
+
+    UnitClass_t Class = OTHER_CLASS;
+};
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Dense runoff routing model: topology, parameters, rainfalls and results of all units,
+  indexed by the rank of the units in the process order, with one lane per rainfall scenario for each unit.
+
+  Results are kept between computations, so after a change of parameters or rainfalls on some units,
+  only these units and their downstream closure are recomputed. The propagation stops on units whose
+  outgoing runoff volumes are unchanged
+*/
+class RunoffNetwork
+{
+  private:
+
+    unsigned int m_ScenariosCount = 1;
+
+    std::vector<UnitHydroParams> m_Params;
+
+    // upstream LI then upstream SU of each unit, in compressed rows
+    std::vector<unsigned int> m_UpBegins;
+    std::vector<unsigned int> m_UpUnits;
+
+    // downstream units of each unit, in compressed rows
+    std::vector<unsigned int> m_DownBegins;
+    std::vector<unsigned int> m_DownUnits;
+
+    // units ranks grouped by levels of process order, in compressed rows
+    std::vector<unsigned int> m_LevelsBegins;
+    std::vector<unsigned int> m_LevelsUnits;
+
+    // rainfalls on SU, and results of the last computation
+    std::vector<double> m_Rains;
+    std::vector<double> m_RunoffVolumes;
+    std::vector<double> m_UpRunoffVolumes;
+    std::vector<double> m_Infiltrations;
+    std::vector<double> m_InfiltVolumes;
+
+    // units already queued by the current downstream computation
+    std::vector<unsigned char> m_Queued;
+
+    // levels smaller than this are computed by the main thread only
+    static const unsigned int MinParallelLevelSize = 256;
+
+    static const unsigned int ParallelChunkSize = 64;
+
+
+    void computeUpstreamRunoffVolumes(unsigned int Rank, double* UpRunoffVols) const;
+
+
+  public:
+
+    /**
+      Computes S from CN value (using metric system, S in returned in meters)
+    */
+    static double computeS(double CN)
+    {
+      return ((25.4/double(CN))-0.254);
+    }
+
+    /**
+      Computes the SCS-CN runoff of a water height as computeRunoffs() does, with its derivatives
+      with respect to the water height and to S
+    */
+    static double computeRunoffDerivatives(double H, double S, double& dRdH, double& dRdS);
+
+    /**
+      Sets the parameters of a LI from its length, the LI width and the ratios and S values of its subparts
+    */
+    static void setLIParams(UnitHydroParams& Params, double Length, double Width,
+                            const double* Ratios, const double* SubpartsS, unsigned int SubpartsCount);
+
+    /**
+      Builds the network from units parameters and upstream units, which must be sorted by process order.
+      Rainfalls and results are set to 0
+      @return false if an upstream unit is not before its downstream unit
+    */
+    bool build(const std::vector<UnitHydroParams>& Params,
+               const std::vector<unsigned int>& UpBegins, const std::vector<unsigned int>& UpUnits,
+               unsigned int ScenariosCount);
+
+    unsigned int getUnitsCount() const
+    {
+      return m_Params.size();
+    }
+
+    unsigned int getScenariosCount() const
+    {
+      return m_ScenariosCount;
+    }
+
+    const UnitHydroParams& getParams(unsigned int Rank) const
+    {
+      return m_Params[Rank];
+    }
+
+    /**
+      Changes the parameters of a unit, its class must not change.
+      Results are updated by computeDownstream()
+    */
+    void setParams(unsigned int Rank, const UnitHydroParams& Params)
+    {
+      m_Params[Rank] = Params;
+    }
+
+    const std::vector<unsigned int>& getUpBegins() const
+    {
+      return m_UpBegins;
+    }
+
+    const std::vector<unsigned int>& getUpUnits() const
+    {
+      return m_UpUnits;
+    }
+
+    const std::vector<unsigned int>& getDownBegins() const
+    {
+      return m_DownBegins;
+    }
+
+    const std::vector<unsigned int>& getDownUnits() const
+    {
+      return m_DownUnits;
+    }
+
+    /**
+      @return the rainfalls lanes of SU, which can be changed before a computation
+    */
+    std::vector<double>& rains()
+    {
+      return m_Rains;
+    }
+
+    const std::vector<double>& getRains() const
+    {
+      return m_Rains;
+    }
+
+    const std::vector<double>& getRunoffVolumes() const
+    {
+      return m_RunoffVolumes;
+    }
+
+    const std::vector<double>& getUpRunoffVolumes() const
+    {
+      return m_UpRunoffVolumes;
+    }
+
+    const std::vector<double>& getInfiltrations() const
+    {
+      return m_Infiltrations;
+    }
+
+    const std::vector<double>& getInfiltVolumes() const
+    {
+      return m_InfiltVolumes;
+    }
+
+    /**
+      Computes outgoing runoff volumes of the given count of scenarios for the LI of the given rank
+    */
+    void computeRunoffVolumesOnLI(unsigned int Rank, const double* IncomingWaterVolumes, double* RunoffVolumes,
+                                  unsigned int ScenariosCount) const;
+
+    /**
+      Computes the unit of the given rank, its upstream units must be computed.
+      Only results of this unit are written, so units of a same level can be computed concurrently
+    */
+    void computeUnit(unsigned int Rank);
+
+    /**
+      Computes all units, by levels of process order on the given pool if any
+    */
+    void computeAll(WorkersPool* Pool);
+
+    /**
+      Computes the given changed units and the units downstream of them whose incoming runoff changes,
+      other units keeping their results
+      @param[in] ChangedRanks the ranks of the changed units
+      @param[out] ComputedRanks if given, the ranks of the computed units are appended to it, by increasing rank
+      @return the count of computed units
+    */
+    unsigned int computeDownstream(const std::vector<unsigned int>& ChangedRanks,
+                                   std::vector<unsigned int>* ComputedRanks = nullptr);
+
+    /**
+      Copies the parameters and results of the given units from a network built with the same topology,
+      typically to cancel a computeDownstream() using the computed ranks it returned
+    */
+    void copyUnits(const RunoffNetwork& Source, const std::vector<unsigned int>& Ranks);
+};
+
+
+#endif /* __RUNOFFNETWORK_HPP__ */
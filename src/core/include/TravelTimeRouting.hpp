@@ -0,0 +1,143 @@
+/**
+  @file TravelTimeRouting.hpp
+*/
+
+
+#ifndef __TRAVELTIMEROUTING_HPP__
+#define __TRAVELTIMEROUTING_HPP__
+
+
+#include <string>
+#include <vector>
+
+#include "RunoffNetwork.hpp"
+#include "Convolution.hpp"
+
+
+class WorkersPool;
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Travel-time routing of the runoff reaching RS, producing the hydrograph of each RS
+  as volumes by intervals of a fixed duration, for the first scenario.
+
+  The runoff volume reaching a RS is split into the contributions of the SU generating it, each contribution
+  being the rainfall volume of the SU times the ratios of outgoing to incoming water of the units
+  on its path to the RS. A contribution reaches the RS after the travel time of the flow distances
+  on this path, then is spread by the unit hydrograph kernel.
+
+  Units are grouped by levels of same RS and same delay, so contributions are summed by level before
+  being added to the arrivals of the RS, and only the arrivals changed by a computation
+  are convolved with the kernel (FFT over the time axis)
+*/
+class TravelTimeRouting
+{
+  private:
+
+    double m_IntervalDuration = 60.0;
+
+    unsigned int m_IntervalsCount = 0;
+
+    // ranks of RS, by index of RS
+    std::vector<unsigned int> m_RSRanks;
+
+    // first downstream unit of each unit, the unit itself if none
+    std::vector<unsigned int> m_DownUnits;
+
+    // units reaching RS grouped by levels of same RS and same delay, in compressed rows
+    std::vector<unsigned int> m_LevelsBegins;
+    std::vector<unsigned int> m_LevelsUnits;
+    std::vector<unsigned int> m_LevelsRS;
+    std::vector<unsigned int> m_LevelsDelays;
+
+    // contributions of levels cumulated at the previous computation
+    std::vector<double> m_LevelsCumulContribs;
+
+    // ratios of the outgoing volume reaching RS to the incoming volume, by rank
+    std::vector<double> m_PathRatios;
+
+    // changes of arrivals of each RS by delay, with WindowLength values per RS
+    std::vector<double> m_ArrivalsChanges;
+
+    unsigned int m_WindowLength = 1;
+
+    KernelConvolution m_Convolution;
+
+    // hydrographs of RS, with m_IntervalsCount values per RS
+    std::vector<double> m_Hydrographs;
+
+
+  public:
+
+    /**
+      @return the unit hydrograph kernel of a triangular unit hydrograph of the given base duration,
+      peaking at 3/8 of the base as the SCS triangular unit hydrograph, by intervals of the given duration.
+      The kernel is a single interval for a null base duration
+    */
+    static std::vector<double> getTriangularKernel(double BaseDuration, double IntervalDuration);
+
+    /**
+      Builds the levels from the given built network and the flow distances of units (by rank, in m).
+      The travel time of a unit is the sum of the flow distances of the units from this unit to its RS,
+      these included, divided by the velocity. Hydrographs are set to 0
+      @param[in] EventDuration the duration after which no more runoff is added, in seconds,
+                 the hydrographs covering this duration and the delays of contributions
+      @return false if the routing parameters are not valid, with the error in Error
+    */
+    bool build(const RunoffNetwork& Network, const std::vector<double>& FlowDists, double Velocity,
+               double IntervalDuration, const std::vector<double>& Kernel, double EventDuration,
+               std::string& Error);
+
+    /**
+      Resets the cumulated contributions, for a new event starting from null rainfalls
+    */
+    void resetContributions();
+
+    /**
+      Resets the cumulated contributions and the hydrographs
+    */
+    void reset();
+
+    /**
+      Adds to the hydrographs the contributions of the runoff generated since the previous computation
+      (or reset), which start reaching RS at the given time
+      @param[in] Time the time of the runoff generation, in seconds from the beginning of the hydrographs
+    */
+    void addContributions(const RunoffNetwork& Network, double Time, WorkersPool* Pool);
+
+    double getIntervalDuration() const
+    {
+      return m_IntervalDuration;
+    }
+
+    unsigned int getIntervalsCount() const
+    {
+      return m_IntervalsCount;
+    }
+
+    const std::vector<unsigned int>& getRSRanks() const
+    {
+      return m_RSRanks;
+    }
+
+    /**
+      @return the hydrograph of the RS of the given index, as volumes by interval (m3)
+    */
+    const double* getHydrograph(unsigned int RSIndex) const
+    {
+      return &m_Hydrographs[RSIndex*m_IntervalsCount];
+    }
+
+    /**
+      @return the runoff volume reaching the RS of the given index during the intervals from BeginInterval
+      to EndInterval excluded, limited to the intervals of the hydrograph (m3)
+    */
+    double getVolume(unsigned int RSIndex, unsigned int BeginInterval, unsigned int EndInterval) const;
+};
+
+
+#endif /* __TRAVELTIMEROUTING_HPP__ */
@@ -0,0 +1,118 @@
+/**
+  @file UnitClasses.hpp
+*/
+
+
+#ifndef __UNITCLASSES_HPP__
+#define __UNITCLASSES_HPP__
+
+
+#include <string>
+#include <vector>
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Classes of the spatial units of the BVService graph, OTHER_CLASS being any other class
+*/
+enum UnitClass_t : unsigned char { SU_CLASS, LI_CLASS, RS_CLASS, OTHER_CLASS };
+
+static const unsigned int UnitClassesCount = 4;
+
+
+/**
+  @return the class of the given OpenFLUID units class name
+*/
+inline UnitClass_t getUnitClass(const std::string& ClassName)
+{
+  if (ClassName == "SU")
+    return SU_CLASS;
+  else if (ClassName == "LI")
+    return LI_CLASS;
+  else if (ClassName == "RS")
+    return RS_CLASS;
+
+  return OTHER_CLASS;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Classes of units indexed by their rank in the process order, with the dense index of each unit in its class,
+  so data of the units of a class are stored in contiguous arrays indexed by this index
+*/
+class UnitsClassIndex
+{
+  private:
+
+    std::vector<UnitClass_t> m_Classes;
+
+    std::vector<unsigned int> m_Indices;
+
+    // ranks of the units of each class, by index in the class
+    std::vector<unsigned int> m_ClassRanks[UnitClassesCount];
+
+
+  public:
+
+    void clear()
+    {
+      m_Classes.clear();
+      m_Indices.clear();
+
+      for (auto& Ranks : m_ClassRanks)
+        Ranks.clear();
+    }
+
+    /**
+      Adds a unit of the given class, ranks being given by order of addition
+      @return the index of the unit in its class
+    */
+    unsigned int add(UnitClass_t Class)
+    {
+      const unsigned int Index = m_ClassRanks[Class].size();
+
+      m_ClassRanks[Class].push_back(m_Classes.size());
+      m_Classes.push_back(Class);
+      m_Indices.push_back(Index);
+
+      return Index;
+    }
+
+    unsigned int getUnitsCount() const
+    {
+      return m_Classes.size();
+    }
+
+    UnitClass_t getClass(unsigned int Rank) const
+    {
+      return m_Classes[Rank];
+    }
+
+    unsigned int getIndex(unsigned int Rank) const
+    {
+      return m_Indices[Rank];
+    }
+
+    unsigned int getCount(UnitClass_t Class) const
+    {
+      return m_ClassRanks[Class].size();
+    }
+
+    /**
+      @return the ranks of the units of the given class, by index in the class
+    */
+    const std::vector<unsigned int>& getRanks(UnitClass_t Class) const
+    {
+      return m_ClassRanks[Class];
+    }
+};
+
+
+#endif /* __UNITCLASSES_HPP__ */
@@ -0,0 +1,174 @@
+/**
+  @file WorkersPool.hpp
+*/
+
+
+#ifndef __WORKERSPOOL_HPP__
+#define __WORKERSPOOL_HPP__
+
+
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Pool of persistent threads running parallel loops. The items of a loop are taken by chunks
+  from a shared counter, so fast threads take more chunks than slow ones.
+  The calling thread takes part in the loop, which returns once all items are done (barrier)
+*/
+class WorkersPool
+{
+  private:
+
+    std::vector<std::thread> m_Threads;
+
+    std::mutex m_Mutex;
+
+    std::condition_variable m_StartCond;
+
+    std::condition_variable m_DoneCond;
+
+    // incremented for each loop, so threads know a new loop is started
+    unsigned long m_Generation = 0;
+
+    unsigned int m_ActiveThreads = 0;
+
+    bool m_Stop = false;
+
+    const std::function<void(unsigned int)>* mp_Func = nullptr;
+
+    std::atomic<unsigned int> m_Next;
+
+    unsigned int m_End = 0;
+
+    unsigned int m_ChunkSize = 1;
+
+
+    void runChunks()
+    {
+      unsigned int Begin;
+
+      while ((Begin = m_Next.fetch_add(m_ChunkSize)) < m_End)
+      {
+        unsigned int End = std::min(Begin+m_ChunkSize,m_End);
+
+        for (unsigned int i = Begin; i < End; i++)
+          (*mp_Func)(i);
+      }
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    void runThread()
+    {
+      unsigned long LastGeneration = 0;
+
+      while (true)
+      {
+        {
+          std::unique_lock<std::mutex> Lock(m_Mutex);
+          m_StartCond.wait(Lock,[&]() { return m_Stop || m_Generation != LastGeneration; });
+
+          if (m_Stop)
+            return;
+
+          LastGeneration = m_Generation;
+        }
+
+        runChunks();
+
+        {
+          std::lock_guard<std::mutex> Lock(m_Mutex);
+          m_ActiveThreads--;
+        }
+        m_DoneCond.notify_one();
+      }
+    }
+
+
+  public:
+
+    /**
+      @param[in] ThreadsCount the total count of threads running the loops, including the calling thread
+    */
+    WorkersPool(unsigned int ThreadsCount) :
+      m_Next(0)
+    {
+      for (unsigned int t = 1; t < ThreadsCount; t++)
+        m_Threads.emplace_back(&WorkersPool::runThread,this);
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    ~WorkersPool()
+    {
+      {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_Stop = true;
+      }
+      m_StartCond.notify_all();
+
+      for (auto& Thread : m_Threads)
+        Thread.join();
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    unsigned int getThreadsCount() const
+    {
+      return m_Threads.size()+1;
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Runs Func(i) for each i in [Begin,End) on all threads of the pool and returns once all are done.
+      Func must not throw
+    */
+    void parallelFor(unsigned int Begin, unsigned int End, unsigned int ChunkSize,
+                     const std::function<void(unsigned int)>& Func)
+    {
+      if (Begin >= End)
+        return;
+
+      {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        mp_Func = &Func;
+        m_Next = Begin;
+        m_End = End;
+        m_ChunkSize = std::max(ChunkSize,1u);
+        m_ActiveThreads = m_Threads.size();
+        m_Generation++;
+      }
+      m_StartCond.notify_all();
+
+      runChunks();
+
+      std::unique_lock<std::mutex> Lock(m_Mutex);
+      m_DoneCond.wait(Lock,[this]() { return m_ActiveThreads == 0; });
+    }
+};
+
+
+#endif /* __WORKERSPOOL_HPP__ */
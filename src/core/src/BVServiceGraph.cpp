@@ -0,0 +1,93 @@
+/**
+  @file BVServiceGraph.cpp
+*/
+
+
+#include "BVServiceGraph.hpp"
+
+
+const char* const BVServiceGraph::LISubparts[BVServiceGraph::LISubpartsCount] = {"benches","grassbs","hedges"};
+
+
+// =====================================================================
+// =====================================================================
+
+
+void BVServiceGraph::clear()
+{
+  Classes.clear();
+  UpBegins.assign(1,0);
+  UpUnits.clear();
+  FlowDists.clear();
+
+  Areas.clear();
+  Slopes.clear();
+  LandUses.clear();
+  Buffers.clear();
+
+  Lengths.clear();
+  Ratios.clear();
+  Outlets.clear();
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+unsigned int BVServiceGraph::addUnit(UnitClass_t Class)
+{
+  Classes.push_back(Class);
+  UpBegins.push_back(UpUnits.size());
+  FlowDists.push_back(0.0);
+
+  Areas.push_back(0.0);
+  Slopes.push_back(0.0);
+  LandUses.push_back(0);
+  Buffers.push_back(0);
+
+  Lengths.push_back(0.0);
+  Ratios.insert(Ratios.end(),LISubpartsCount,0.0);
+  Outlets.push_back(0);
+
+  return Classes.size()-1;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool BVServiceGraph::check(std::string& Error) const
+{
+  const unsigned int UnitsCount = Classes.size();
+
+  if (UpBegins.size() != UnitsCount+1 || UpBegins.back() != UpUnits.size() || FlowDists.size() != UnitsCount ||
+      Areas.size() != UnitsCount || Slopes.size() != UnitsCount || LandUses.size() != UnitsCount ||
+      Buffers.size() != UnitsCount || Lengths.size() != UnitsCount ||
+      Ratios.size() != UnitsCount*LISubpartsCount || Outlets.size() != UnitsCount)
+  {
+    Error = "Spatial graph arrays sizes do not match the count of units";
+    return false;
+  }
+
+  for (unsigned int i = 0; i < UnitsCount; i++)
+  {
+    if (UpBegins[i] > UpBegins[i+1])
+    {
+      Error = "Spatial graph upstream rows are not increasing";
+      return false;
+    }
+
+    for (unsigned int u = UpBegins[i]; u < UpBegins[i+1]; u++)
+    {
+      if (UpUnits[u] >= i)
+      {
+        Error = "Spatial graph is not sorted by process order";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
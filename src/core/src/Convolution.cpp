@@ -0,0 +1,129 @@
+/**
+  @file Convolution.cpp
+*/
+
+
+#include <algorithm>
+#include <cmath>
+
+#include "Convolution.hpp"
+
+
+const unsigned int KernelConvolution::MaxDirectProducts;
+
+
+// =====================================================================
+// =====================================================================
+
+
+void computeFFT(std::complex<double>* Values, unsigned int Size, bool Inverse)
+{
+  const double Pi = 3.14159265358979323846;
+
+  // bit-reversal permutation
+  for (unsigned int i = 1, j = 0; i < Size; i++)
+  {
+    unsigned int Bit = Size >> 1;
+
+    for (; j & Bit; Bit >>= 1)
+      j ^= Bit;
+    j ^= Bit;
+
+    if (i < j)
+      std::swap(Values[i],Values[j]);
+  }
+
+  // butterflies of increasing lengths
+  for (unsigned int Length = 2; Length <= Size; Length <<= 1)
+  {
+    const double Angle = (Inverse ? 2.0 : -2.0)*Pi/Length;
+    const std::complex<double> Root(std::cos(Angle),std::sin(Angle));
+
+    for (unsigned int i = 0; i < Size; i += Length)
+    {
+      std::complex<double> Twiddle(1.0,0.0);
+
+      for (unsigned int j = 0; j < Length/2; j++)
+      {
+        const std::complex<double> U = Values[i+j];
+        const std::complex<double> V = Values[i+j+Length/2]*Twiddle;
+
+        Values[i+j] = U+V;
+        Values[i+j+Length/2] = U-V;
+        Twiddle *= Root;
+      }
+    }
+  }
+
+  if (Inverse)
+  {
+    for (unsigned int i = 0; i < Size; i++)
+      Values[i] /= Size;
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void KernelConvolution::setKernel(const std::vector<double>& Kernel, unsigned int SignalLength)
+{
+  m_Kernel = Kernel;
+  m_SignalLength = SignalLength;
+  m_FFTSize = 0;
+  m_KernelSpectrum.clear();
+
+  if (m_Kernel.empty())
+    m_Kernel.assign(1,1.0);
+
+  if (m_Kernel.size()*m_SignalLength <= MaxDirectProducts)
+    return;
+
+  m_FFTSize = 1;
+  while (m_FFTSize < getResultLength())
+    m_FFTSize <<= 1;
+
+  m_KernelSpectrum.assign(m_FFTSize,0.0);
+  std::copy(m_Kernel.begin(),m_Kernel.end(),m_KernelSpectrum.begin());
+  computeFFT(m_KernelSpectrum.data(),m_FFTSize,false);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void KernelConvolution::convolve(const double* Signal, double* Result,
+                                 std::vector<std::complex<double>>& Buffer) const
+{
+  const unsigned int ResultLength = getResultLength();
+
+  if (!m_FFTSize)
+  {
+    std::fill(Result,Result+ResultLength,0.0);
+
+    for (unsigned int i = 0; i < m_SignalLength; i++)
+    {
+      if (Signal[i] != 0.0)
+      {
+        for (unsigned int k = 0; k < m_Kernel.size(); k++)
+          Result[i+k] += Signal[i]*m_Kernel[k];
+      }
+    }
+    return;
+  }
+
+  Buffer.assign(m_FFTSize,0.0);
+  std::copy(Signal,Signal+m_SignalLength,Buffer.begin());
+
+  computeFFT(Buffer.data(),m_FFTSize,false);
+
+  for (unsigned int f = 0; f < m_FFTSize; f++)
+    Buffer[f] *= m_KernelSpectrum[f];
+
+  computeFFT(Buffer.data(),m_FFTSize,true);
+
+  for (unsigned int i = 0; i < ResultLength; i++)
+    Result[i] = Buffer[i].real();
+}
@@ -0,0 +1,275 @@
+/**
+  @file Ensemble.cpp
+*/
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include "Ensemble.hpp"
+
+
+const double EnsembleAccumulator::QuantilesProbs[EnsembleAccumulator::QuantilesCount] = {0.05,0.5,0.95};
+
+
+// =====================================================================
+// =====================================================================
+
+
+RandomGenerator::RandomGenerator(std::uint64_t Seed, std::uint64_t Stream)
+{
+  std::uint64_t X = Seed ^ (Stream*0xD1B54A32D192ED03ULL);
+
+  // SplitMix64
+  for (unsigned int i = 0; i < 4; i++)
+  {
+    X += 0x9E3779B97F4A7C15ULL;
+    std::uint64_t Z = X;
+    Z = (Z ^ (Z >> 30))*0xBF58476D1CE4E5B9ULL;
+    Z = (Z ^ (Z >> 27))*0x94D049BB133111EBULL;
+    m_State[i] = Z ^ (Z >> 31);
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+double RandomGenerator::normal()
+{
+  // 1-uniform() is in (0,1], so the log is finite
+  const double U1 = 1.0-uniform();
+  const double U2 = uniform();
+
+  return std::sqrt(-2.0*std::log(U1))*std::cos(6.283185307179586*U2);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool PerturbationDistribution::parse(const std::string& Str)
+{
+  std::string::size_type SepPos = Str.find(':');
+
+  if (SepPos == std::string::npos)
+    return false;
+
+  const std::string KindStr = Str.substr(0,SepPos);
+  const std::string ParamStr = Str.substr(SepPos+1);
+
+  if (KindStr == "normal")
+    Kind = NORMAL;
+  else if (KindStr == "uniform")
+    Kind = UNIFORM;
+  else if (KindStr == "triangular")
+    Kind = TRIANGULAR;
+  else if (KindStr == "lognormal")
+    Kind = LOGNORMAL;
+  else
+    return false;
+
+  char* End = nullptr;
+  Param = std::strtod(ParamStr.c_str(),&End);
+
+  return End != ParamStr.c_str() && *End == '\0' && Param >= 0.0;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+double PerturbationDistribution::sample(RandomGenerator& Generator) const
+{
+  switch (Kind)
+  {
+    case NORMAL:
+      return Param*Generator.normal();
+    case UNIFORM:
+      return Param*(2.0*Generator.uniform()-1.0);
+    case TRIANGULAR:
+      return Param*(Generator.uniform()+Generator.uniform()-1.0);
+    case LOGNORMAL:
+      // mean of exp(sigma*N - sigma^2/2) is 1
+      return std::exp(Param*Generator.normal()-0.5*Param*Param)-1.0;
+    default:
+      return 0.0;
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void P2Quantile::reset(double Prob)
+{
+  m_Prob = Prob;
+  m_Count = 0;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void P2Quantile::add(double Value)
+{
+  if (m_Count < 5)
+  {
+    // first values are kept sorted as initial markers
+    m_Heights[m_Count++] = Value;
+    std::sort(m_Heights,m_Heights+m_Count);
+
+    if (m_Count == 5)
+    {
+      for (unsigned int i = 0; i < 5; i++)
+        m_Positions[i] = i+1;
+
+      m_Desired[0] = 1;
+      m_Desired[1] = 1+2*m_Prob;
+      m_Desired[2] = 1+4*m_Prob;
+      m_Desired[3] = 3+2*m_Prob;
+      m_Desired[4] = 5;
+    }
+    return;
+  }
+
+  m_Count++;
+
+  // cell of the value, extreme markers being moved if needed
+  unsigned int Cell;
+
+  if (Value < m_Heights[0])
+  {
+    m_Heights[0] = Value;
+    Cell = 0;
+  }
+  else if (Value >= m_Heights[4])
+  {
+    m_Heights[4] = std::max(m_Heights[4],Value);
+    Cell = 3;
+  }
+  else
+  {
+    Cell = 0;
+    while (Value >= m_Heights[Cell+1])
+      Cell++;
+  }
+
+  for (unsigned int i = Cell+1; i < 5; i++)
+    m_Positions[i] += 1;
+
+  const double Increments[5] = {0,m_Prob/2,m_Prob,(1+m_Prob)/2,1};
+
+  for (unsigned int i = 0; i < 5; i++)
+    m_Desired[i] += Increments[i];
+
+  // adjustment of the middle markers by the piecewise-parabolic formula, or linear if not monotonic
+  for (unsigned int i = 1; i < 4; i++)
+  {
+    const double Delta = m_Desired[i]-m_Positions[i];
+
+    if ((Delta >= 1 && m_Positions[i+1]-m_Positions[i] > 1) || (Delta <= -1 && m_Positions[i-1]-m_Positions[i] < -1))
+    {
+      const double D = (Delta > 0) ? 1.0 : -1.0;
+
+      const double Parabolic =
+        m_Heights[i] + D/(m_Positions[i+1]-m_Positions[i-1]) *
+        ((m_Positions[i]-m_Positions[i-1]+D)*(m_Heights[i+1]-m_Heights[i])/(m_Positions[i+1]-m_Positions[i]) +
+         (m_Positions[i+1]-m_Positions[i]-D)*(m_Heights[i]-m_Heights[i-1])/(m_Positions[i]-m_Positions[i-1]));
+
+      if (m_Heights[i-1] < Parabolic && Parabolic < m_Heights[i+1])
+        m_Heights[i] = Parabolic;
+      else
+      {
+        const unsigned int j = (D > 0) ? i+1 : i-1;
+        m_Heights[i] += D*(m_Heights[j]-m_Heights[i])/(m_Positions[j]-m_Positions[i]);
+      }
+
+      m_Positions[i] += D;
+    }
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+double P2Quantile::get() const
+{
+  if (m_Count == 0)
+    return std::numeric_limits<double>::quiet_NaN();
+
+  // exact quantile of the first values, which are sorted
+  if (m_Count < 5)
+    return m_Heights[std::min<unsigned int>(m_Count-1,std::floor(m_Prob*m_Count))];
+
+  return m_Heights[2];
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void EnsembleAccumulator::reset()
+{
+  m_Count = 0;
+  m_Mean = 0.0;
+  m_M2 = 0.0;
+
+  for (unsigned int q = 0; q < QuantilesCount; q++)
+    m_Quantiles[q].reset(QuantilesProbs[q]);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void EnsembleAccumulator::add(double Value)
+{
+  // undefined values (e.g. indicators not relevant for a unit) are not counted
+  if (std::isnan(Value))
+    return;
+
+  m_Count++;
+
+  const double Delta = Value-m_Mean;
+  m_Mean += Delta/m_Count;
+  m_M2 += Delta*(Value-m_Mean);
+
+  for (unsigned int q = 0; q < QuantilesCount; q++)
+    m_Quantiles[q].add(Value);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+double EnsembleAccumulator::getStdDev() const
+{
+  if (m_Count < 2)
+    return 0.0;
+
+  return std::sqrt(m_M2/(m_Count-1));
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void EnsembleAccumulator::getQuantiles(double* Quantiles) const
+{
+  for (unsigned int q = 0; q < QuantilesCount; q++)
+    Quantiles[q] = m_Quantiles[q].get();
+}
@@ -0,0 +1,491 @@
+/**
+  @file HydroModel.cpp
+*/
+
+
+#include <algorithm>
+#include <functional>
+
+#include "HydroModel.hpp"
+#include "RunoffKernel.hpp"
+#include "WorkersPool.hpp"
+
+
+const double HydroModel::LISubpartsCN[BVServiceGraph::LISubpartsCount] = {
+                                                                            58,  // benches, like MEADOW
+                                                                            69,  // grassbs, like PASTURE
+                                                                            58,  // hedges, like FOREST
+                                                                          };
+
+const unsigned int HydroModel::ParallelChunkSize;
+
+const unsigned int HydroModel::EnsembleBatchSize;
+
+
+// =====================================================================
+// =====================================================================
+
+
+void HydroModel::setLIParams(UnitHydroParams& Params, double Length, const double* Ratios) const
+{
+  double SubpartsS[BVServiceGraph::LISubpartsCount];
+
+  for (unsigned int p = 0; p < BVServiceGraph::LISubpartsCount; p++)
+    SubpartsS[p] = RunoffNetwork::computeS(LISubpartsCN[p]);
+
+  RunoffNetwork::setLIParams(Params,Length,m_LIWidth,Ratios,SubpartsS,BVServiceGraph::LISubpartsCount);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool HydroModel::build(const BVServiceGraph& Graph, const std::vector<double>& LandUsesCN,
+                       unsigned int ScenariosCount, std::string& Error)
+{
+  static_assert(BVServiceGraph::LISubpartsCount <= UnitHydroParams::MaxSubparts,"Too many LI subparts");
+
+  if (!Graph.check(Error))
+    return false;
+
+  const unsigned int UnitsCount = Graph.getUnitsCount();
+
+  m_SULandUses.assign(UnitsCount,0);
+  m_LandUsesCN = LandUsesCN;
+  m_GraphLandUsesCount = LandUsesCN.size();
+  m_LILengths.assign(UnitsCount,0.0);
+
+  std::vector<double> LandUsesS;
+  for (auto CN : m_LandUsesCN)
+    LandUsesS.push_back(RunoffNetwork::computeS(CN));
+
+  std::vector<UnitHydroParams> AllParams(UnitsCount,UnitHydroParams());
+
+  for (unsigned int i = 0; i < UnitsCount; i++)
+  {
+    UnitHydroParams& Params = AllParams[i];
+    const UnitClass_t Class = Graph.Classes[i];
+
+    if (Class == SU_CLASS)
+    {
+      if (Graph.LandUses[i] >= LandUsesS.size())
+      {
+        Error = "No CN for land use index " + std::to_string(Graph.LandUses[i]);
+        return false;
+      }
+
+      Params.Class = SU_CLASS;
+      Params.Area = Graph.Areas[i];
+      Params.S = LandUsesS[Graph.LandUses[i]];
+      m_SULandUses[i] = Graph.LandUses[i];
+    }
+    else if (Class == LI_CLASS)
+    {
+      setLIParams(Params,Graph.Lengths[i],&Graph.Ratios[i*BVServiceGraph::LISubpartsCount]);
+      m_LILengths[i] = Graph.Lengths[i];
+    }
+    else if (Class == RS_CLASS)
+      Params.Class = RS_CLASS;
+  }
+
+  if (!m_Network.build(AllParams,Graph.UpBegins,Graph.UpUnits,ScenariosCount))
+  {
+    Error = "Spatial graph is not sorted by process order";
+    return false;
+  }
+
+  m_AdjointRunoffVolumes.assign(UnitsCount,0.0);
+  m_CNSensitivities.assign(UnitsCount,0.0);
+  m_RatiosSensitivities.assign(UnitsCount*BVServiceGraph::LISubpartsCount,0.0);
+
+  setEnsemble(m_EnsembleMembers,m_EnsembleSeed,m_EnsembleCNDistri,m_EnsembleRainDistri,mp_EnsembleIndicators);
+
+  return true;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void HydroModel::setEnsemble(unsigned int Members, unsigned long Seed,
+                             const PerturbationDistribution& CNDistri, const PerturbationDistribution& RainDistri,
+                             const IndicatorsModel* Indicators)
+{
+  const unsigned int UnitsCount = m_Network.getUnitsCount();
+
+  m_EnsembleMembers = Members;
+  m_EnsembleSeed = Seed;
+  m_EnsembleCNDistri = CNDistri;
+  m_EnsembleRainDistri = RainDistri;
+  mp_EnsembleIndicators = Indicators;
+
+  m_EnsembleMeans.assign(UnitsCount,0.0);
+  m_EnsembleStdDevs.assign(UnitsCount,0.0);
+  m_EnsembleQuantiles.assign(UnitsCount*EnsembleAccumulator::QuantilesCount,0.0);
+
+  m_MembersVolumes.clear();
+  m_MembersUpVolumes.clear();
+  m_MembersInfiltVolumes.clear();
+  m_MembersS.clear();
+  m_EnsembleAccumulators.clear();
+
+  m_MembersIndicatorsModels.clear();
+  m_MembersIndicators.clear();
+  m_IndicatorsAccumulators.clear();
+  m_EnsembleIndicatorsMeans.clear();
+  m_EnsembleIndicatorsStdDevs.clear();
+  m_EnsembleIndicatorsQuantiles.clear();
+
+  if (!m_EnsembleMembers)
+    return;
+
+  const unsigned int BatchSize = std::min(EnsembleBatchSize,m_EnsembleMembers);
+
+  m_MembersVolumes.assign(BatchSize*UnitsCount,0.0);
+  m_MembersS.assign(BatchSize*m_LandUsesCN.size(),0.0);
+  m_EnsembleAccumulators.assign(UnitsCount,EnsembleAccumulator());
+
+  if (!mp_EnsembleIndicators)
+    return;
+
+  const UnitsClassIndex& Classes = mp_EnsembleIndicators->getClasses();
+  const unsigned int ValuesCount = (Classes.getCount(SU_CLASS)+Classes.getCount(LI_CLASS))*
+                                   IndicatorsModel::IndicatorsValuesCount;
+
+  m_MembersUpVolumes.assign(BatchSize*UnitsCount,0.0);
+  m_MembersInfiltVolumes.assign(BatchSize*UnitsCount,0.0);
+  m_MembersIndicators.assign(BatchSize*ValuesCount,0.0);
+  m_IndicatorsAccumulators.assign(ValuesCount,EnsembleAccumulator());
+
+  m_EnsembleIndicatorsMeans.assign(ValuesCount,0.0);
+  m_EnsembleIndicatorsStdDevs.assign(ValuesCount,0.0);
+  m_EnsembleIndicatorsQuantiles.assign(ValuesCount*EnsembleAccumulator::QuantilesCount,0.0);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void HydroModel::setSUCN(unsigned int Rank, double CN)
+{
+  if (m_SULandUses[Rank] < m_GraphLandUsesCount)
+  {
+    m_SULandUses[Rank] = m_LandUsesCN.size();
+    m_LandUsesCN.push_back(CN);
+
+    if (m_EnsembleMembers)
+      m_MembersS.resize(std::min(EnsembleBatchSize,m_EnsembleMembers)*m_LandUsesCN.size());
+  }
+  else
+    m_LandUsesCN[m_SULandUses[Rank]] = CN;
+
+  UnitHydroParams Params = m_Network.getParams(Rank);
+  Params.S = RunoffNetwork::computeS(CN);
+  m_Network.setParams(Rank,Params);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void HydroModel::setLIRatios(unsigned int Rank, const double* Ratios)
+{
+  UnitHydroParams Params;
+  setLIParams(Params,m_LILengths[Rank],Ratios);
+  m_Network.setParams(Rank,Params);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Computes the sensitivities of the runoff volume reaching RS for the first scenario, by a backward pass
+  in reverse process order on the incoming volumes recorded by the forward pass (the routing tape).
+  The adjoint of each unit is the derivative of the runoff volume reaching RS with respect to its outgoing
+  runoff volume, so the sensitivities to all CN and ratios cost a single pass.
+  A change of ratio only acts through the max ratio, sensitivities of other subparts are null
+*/
+void HydroModel::computeSensitivities()
+{
+  const unsigned int ScenariosCount = m_Network.getScenariosCount();
+  const unsigned int SubpartsCount = BVServiceGraph::LISubpartsCount;
+  const std::vector<double>& Rains = m_Network.getRains();
+  const std::vector<double>& UpRunoffVolumes = m_Network.getUpRunoffVolumes();
+  const std::vector<unsigned int>& UpBegins = m_Network.getUpBegins();
+  const std::vector<unsigned int>& UpUnits = m_Network.getUpUnits();
+
+  std::fill(m_AdjointRunoffVolumes.begin(),m_AdjointRunoffVolumes.end(),0.0);
+  std::fill(m_RatiosSensitivities.begin(),m_RatiosSensitivities.end(),0.0);
+
+  for (unsigned int i = m_Network.getUnitsCount(); i-- > 0; )
+  {
+    const UnitHydroParams& Params = m_Network.getParams(i);
+    const double Adjoint = m_AdjointRunoffVolumes[i];
+    const double UpRunoffVolume = UpRunoffVolumes[i*ScenariosCount];
+    double UpAdjoint = 0.0;
+
+    if (Params.Class == RS_CLASS)
+      UpAdjoint = 1.0;
+    else if (Params.Class == SU_CLASS)
+    {
+      double dRdH, dRdS;
+      RunoffNetwork::computeRunoffDerivatives(Rains[i*ScenariosCount]+(UpRunoffVolume/Params.Area),Params.S,
+                                              dRdH,dRdS);
+
+      // S = 25.4/CN - 0.254, so dS/dCN = -(S+0.254)^2/25.4
+      const double dSdCN = -(Params.S+0.254)*(Params.S+0.254)/25.4;
+
+      UpAdjoint = Adjoint*dRdH;
+      m_CNSensitivities[i] = Adjoint*Params.Area*dRdS*dSdCN;
+    }
+    else if (Params.Class == LI_CLASS)
+    {
+      UpAdjoint = Adjoint;
+
+      if (Params.MaxRatio >= 0.01)
+      {
+        // the filtered water height does not depend on the max ratio, as the efficient area is proportional to it
+        const double FilteredHeight = UpRunoffVolume*Params.MaxRatio/Params.Area;
+
+        if (FilteredHeight > 0)
+        {
+          double Height = FilteredHeight;
+          double dHeight = 1.0;
+
+          for (unsigned int p = 0; p < Params.SubpartsCount; p++)
+          {
+            double dRdH, dRdS;
+            Height = RunoffNetwork::computeRunoffDerivatives(Height,Params.SubpartsS[p],dRdH,dRdS);
+            dHeight *= dRdH;
+          }
+
+          // outgoing volume = filtered height * efficient area + incoming volume * (1 - max ratio)
+          UpAdjoint = Adjoint*((1.0-Params.MaxRatio) + Params.MaxRatio*dHeight);
+          m_RatiosSensitivities[i*SubpartsCount+Params.MaxRatioSubpart] =
+            Adjoint*(Height*Params.Area/Params.MaxRatio - UpRunoffVolume);
+        }
+      }
+    }
+
+    for (unsigned int u = UpBegins[i]; u < UpBegins[i+1]; u++)
+      m_AdjointRunoffVolumes[UpUnits[u]] += UpAdjoint;
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Computes the ensemble member of the given number in the given slot of the batch.
+  The member perturbations only depend on the seed and on the member number
+*/
+void HydroModel::computeMember(unsigned int Member, unsigned int Slot)
+{
+  const unsigned int UnitsCount = m_Network.getUnitsCount();
+  const unsigned int ScenariosCount = m_Network.getScenariosCount();
+
+  const std::vector<double>& Rains = m_Network.getRains();
+  const std::vector<unsigned int>& UpBegins = m_Network.getUpBegins();
+  const std::vector<unsigned int>& UpUnits = m_Network.getUpUnits();
+
+  double* Volumes = &m_MembersVolumes[Slot*UnitsCount];
+  double* UpVolumes = mp_EnsembleIndicators ? &m_MembersUpVolumes[Slot*UnitsCount] : nullptr;
+  double* InfiltVolumes = mp_EnsembleIndicators ? &m_MembersInfiltVolumes[Slot*UnitsCount] : nullptr;
+  double* SValues = &m_MembersS[Slot*m_LandUsesCN.size()];
+
+  RandomGenerator Generator(m_EnsembleSeed,Member);
+
+  for (unsigned int l = 0; l < m_LandUsesCN.size(); l++)
+    SValues[l] = RunoffNetwork::computeS(std::min(std::max(m_LandUsesCN[l]+m_EnsembleCNDistri.sample(Generator),1.0),100.0));
+
+  const double RainFactor = std::max(1.0+m_EnsembleRainDistri.sample(Generator),0.0);
+
+  for (unsigned int i = 0; i < UnitsCount; i++)
+  {
+    const UnitHydroParams& Params = m_Network.getParams(i);
+    double UpRunoffVolume = 0.0;
+
+    for (unsigned int u = UpBegins[i]; u < UpBegins[i+1]; u++)
+      UpRunoffVolume += Volumes[UpUnits[u]];
+
+    if (Params.Class == SU_CLASS)
+    {
+      double IncomingWaterHeight = Rains[i*ScenariosCount]*RainFactor + (UpRunoffVolume / Params.Area);
+      double Runoff;
+
+      computeRunoffs(&IncomingWaterHeight,SValues[m_SULandUses[i]],&Runoff,1);
+      Volumes[i] = Runoff*Params.Area;
+
+      if (InfiltVolumes)
+        InfiltVolumes[i] = (IncomingWaterHeight-Runoff)*Params.Area;
+    }
+    else if (Params.Class == LI_CLASS)
+    {
+      m_Network.computeRunoffVolumesOnLI(i,&UpRunoffVolume,&Volumes[i],1);
+
+      if (InfiltVolumes)
+        InfiltVolumes[i] = UpRunoffVolume-Volumes[i];
+    }
+    else
+      Volumes[i] = UpRunoffVolume;
+
+    if (UpVolumes)
+      UpVolumes[i] = UpRunoffVolume;
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Computes the ensemble statistics of the outgoing runoff volumes (incoming for RS) of the first scenario,
+  and of the indicators if enabled.
+  Members are computed by batches, then added to the accumulators of the units in members order,
+  so statistics are the same whatever the count of threads
+*/
+void HydroModel::computeEnsemble(WorkersPool* Pool)
+{
+  const unsigned int UnitsCount = m_Network.getUnitsCount();
+  const unsigned int Quantiles = EnsembleAccumulator::QuantilesCount;
+  const unsigned int ValuesCount = m_IndicatorsAccumulators.size();
+  const unsigned int ThreadsCount = Pool ? Pool->getThreadsCount() : 1;
+
+  for (auto& Acc : m_EnsembleAccumulators)
+    Acc.reset();
+
+  for (auto& Acc : m_IndicatorsAccumulators)
+    Acc.reset();
+
+  if (mp_EnsembleIndicators && m_MembersIndicatorsModels.size() < ThreadsCount)
+    m_MembersIndicatorsModels.resize(ThreadsCount,*mp_EnsembleIndicators);
+
+  for (unsigned int Begin = 0; Begin < m_EnsembleMembers; Begin += EnsembleBatchSize)
+  {
+    const unsigned int Count = std::min(EnsembleBatchSize,m_EnsembleMembers-Begin);
+
+    const std::function<void(unsigned int)> ComputeMember = [this,Begin](unsigned int b)
+    {
+      computeMember(Begin+b,b);
+    };
+
+    const std::function<void(unsigned int)> AccumulateUnit = [this,Count,UnitsCount](unsigned int i)
+    {
+      for (unsigned int b = 0; b < Count; b++)
+        m_EnsembleAccumulators[i].add(m_MembersVolumes[b*UnitsCount+i]);
+    };
+
+    // each thread computes the indicators of the members of its stride with its own copy of the indicators model,
+    // the cumulated SU infiltration ratios being reset so members do not depend on each other
+    const std::function<void(unsigned int)> ComputeIndicators =
+      [this,Count,UnitsCount,ValuesCount,ThreadsCount](unsigned int t)
+    {
+      IndicatorsModel& Model = m_MembersIndicatorsModels[t];
+
+      for (unsigned int b = t; b < Count; b += ThreadsCount)
+      {
+        Model.reset();
+        Model.compute(&m_MembersUpVolumes[b*UnitsCount],&m_MembersVolumes[b*UnitsCount],
+                      &m_MembersInfiltVolumes[b*UnitsCount]);
+        Model.getIndicatorsValues(&m_MembersIndicators[b*ValuesCount]);
+      }
+    };
+
+    const std::function<void(unsigned int)> AccumulateIndicator = [this,Count,ValuesCount](unsigned int v)
+    {
+      for (unsigned int b = 0; b < Count; b++)
+        m_IndicatorsAccumulators[v].add(m_MembersIndicators[b*ValuesCount+v]);
+    };
+
+    if (Pool)
+    {
+      Pool->parallelFor(0,Count,1,ComputeMember);
+      Pool->parallelFor(0,UnitsCount,ParallelChunkSize,AccumulateUnit);
+
+      if (mp_EnsembleIndicators)
+      {
+        Pool->parallelFor(0,ThreadsCount,1,ComputeIndicators);
+        Pool->parallelFor(0,ValuesCount,ParallelChunkSize,AccumulateIndicator);
+      }
+    }
+    else
+    {
+      for (unsigned int b = 0; b < Count; b++)
+        ComputeMember(b);
+      for (unsigned int i = 0; i < UnitsCount; i++)
+        AccumulateUnit(i);
+
+      if (mp_EnsembleIndicators)
+      {
+        ComputeIndicators(0);
+        for (unsigned int v = 0; v < ValuesCount; v++)
+          AccumulateIndicator(v);
+      }
+    }
+  }
+
+  for (unsigned int i = 0; i < UnitsCount; i++)
+  {
+    m_EnsembleMeans[i] = m_EnsembleAccumulators[i].getMean();
+    m_EnsembleStdDevs[i] = m_EnsembleAccumulators[i].getStdDev();
+    m_EnsembleAccumulators[i].getQuantiles(&m_EnsembleQuantiles[i*Quantiles]);
+  }
+
+  for (unsigned int v = 0; v < ValuesCount; v++)
+  {
+    m_EnsembleIndicatorsMeans[v] = m_IndicatorsAccumulators[v].getMean();
+    m_EnsembleIndicatorsStdDevs[v] = m_IndicatorsAccumulators[v].getStdDev();
+    m_IndicatorsAccumulators[v].getQuantiles(&m_EnsembleIndicatorsQuantiles[v*Quantiles]);
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void HydroModel::computeAll(WorkersPool* Pool)
+{
+  m_Network.computeAll(Pool);
+
+  if (m_SensitivitiesEnabled)
+    computeSensitivities();
+
+  if (m_EnsembleMembers)
+    computeEnsemble(Pool);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool HydroModel::computeChanged(const std::vector<unsigned int>& ChangedRanks, WorkersPool* Pool)
+{
+  if (ChangedRanks.size() > MaxIncrementalRatio*m_Network.getUnitsCount())
+  {
+    computeAll(Pool);
+    return true;
+  }
+
+  if (!m_Network.computeDownstream(ChangedRanks))
+    return false;
+
+  // the sensitivities and the ensemble cover all units, so they are only computed when requested
+  if (m_SensitivitiesEnabled)
+    computeSensitivities();
+
+  if (m_EnsembleMembers)
+    computeEnsemble(Pool);
+
+  return true;
+}
@@ -0,0 +1,421 @@
+/**
+  @file IndicatorsModel.cpp
+*/
+
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "IndicatorsModel.hpp"
+
+
+const unsigned int IndicatorsModel::IndicatorsValuesCount;
+
+const char* IndicatorsModel::SUIndicatorsNames[IndicatorsModel::IndicatorsValuesCount] = {
+  "runoffvoldelta","runoffvolratio","infiltvolratio","conndegree","erosionrisk","runoffcontrib"
+};
+
+const char* IndicatorsModel::LIIndicatorsNames[IndicatorsModel::IndicatorsValuesCount] = {
+  "runoffvoldelta","runoffvolratio","infiltvolratio","concdegree","importancedegree","interestdegree"
+};
+
+
+/**
+  Knuth's "essentially equal" comparison, as openfluid::scientific::isVeryClose()
+*/
+static bool isVeryClose(double A, double B)
+{
+  const double Epsilon = std::numeric_limits<double>::epsilon();
+
+  return (std::fabs(B-A) <= Epsilon*std::fabs(A)) && (std::fabs(B-A) <= Epsilon*std::fabs(B));
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void IndicatorsModel::normalizeValues(std::vector<double>& Values)
+{
+  double Max = std::numeric_limits<double>::min();
+  double Min = std::numeric_limits<double>::max();
+
+  for (auto Val : Values)
+  {
+    if (!std::isnan(Val))
+    {
+      Min = std::min(Min,Val);
+      Max = std::max(Max,Val);
+    }
+  }
+
+  for (auto& Val : Values)
+  {
+    if (!std::isnan(Val))
+      Val = (Val - Min) / (Max - Min);
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+double IndicatorsModel::computeRatioVolume(double UpRunoffVol, double DeltaVolume)
+{
+  if (isVeryClose(UpRunoffVol,0.0))
+    return std::numeric_limits<double>::quiet_NaN();
+  else if (isVeryClose(DeltaVolume,0.0))
+    return 0.0;
+
+  return DeltaVolume / UpRunoffVol;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool IndicatorsModel::build(const BVServiceGraph& Graph, std::string& Error)
+{
+  if (!Graph.check(Error))
+    return false;
+
+  const unsigned int UnitsCount = Graph.getUnitsCount();
+
+  m_Classes.clear();
+  for (auto Class : Graph.Classes)
+    m_Classes.add(Class);
+
+  const unsigned int SUCount = m_Classes.getCount(SU_CLASS);
+  const unsigned int LICount = m_Classes.getCount(LI_CLASS);
+  const std::vector<unsigned int>& SURanks = m_Classes.getRanks(SU_CLASS);
+  const std::vector<unsigned int>& LIRanks = m_Classes.getRanks(LI_CLASS);
+
+  m_UpBegins = Graph.UpBegins;
+  m_UpUnits = Graph.UpUnits;
+
+  // the downstream unit is the first one in process order, upstream units being before it
+  m_DownUnits.resize(UnitsCount);
+
+  for (unsigned int i = 0; i < UnitsCount; i++)
+    m_DownUnits[i] = i;
+
+  for (unsigned int i = 0; i < UnitsCount; i++)
+  {
+    for (unsigned int u = m_UpBegins[i]; u < m_UpBegins[i+1]; u++)
+    {
+      if (m_DownUnits[m_UpUnits[u]] == m_UpUnits[u])
+        m_DownUnits[m_UpUnits[u]] = i;
+    }
+  }
+
+  // SU and LI attributes
+
+  std::vector<unsigned char> IsBuffer(UnitsCount,0);
+
+  m_SUSlopes.assign(SUCount,0.0);
+
+  for (unsigned int s = 0; s < SUCount; s++)
+  {
+    m_SUSlopes[s] = Graph.Slopes[SURanks[s]];
+    IsBuffer[SURanks[s]] = Graph.Buffers[SURanks[s]];
+  }
+
+  m_LILengths.assign(LICount,0.0);
+  m_LIOccupied.assign(LICount,0);
+  m_LIOutlets.assign(LICount,0);
+
+  for (unsigned int l = 0; l < LICount; l++)
+  {
+    const unsigned int Rank = LIRanks[l];
+
+    m_LILengths[l] = Graph.Lengths[Rank];
+    m_LIOutlets[l] = Graph.Outlets[Rank];
+
+    double RatiosSum = 0.0;
+
+    for (unsigned int p = 0; p < BVServiceGraph::LISubpartsCount; p++)
+    {
+      const double Ratio = Graph.Ratios[Rank*BVServiceGraph::LISubpartsCount+p];
+
+      if (Ratio > 0.0)
+        m_LIOccupied[l] = 1;
+
+      RatiosSum += Ratio;
+    }
+
+    if (RatiosSum > 0)
+      IsBuffer[Rank] = 1;
+  }
+
+  // Upper area, upstream units being before their downstream units
+
+  m_UpperAreas.assign(UnitsCount,0.0);
+
+  for (unsigned int i = 0; i < UnitsCount; i++)
+  {
+    double UpperAreaSum = 0.0;
+
+    for (unsigned int u = m_UpBegins[i]; u < m_UpBegins[i+1]; u++)
+      UpperAreaSum = UpperAreaSum + m_UpperAreas[m_UpUnits[u]];
+
+    if (m_Classes.getClass(i) == SU_CLASS)
+      UpperAreaSum = UpperAreaSum + Graph.Areas[i];
+
+    m_UpperAreas[i] = UpperAreaSum;
+  }
+
+  // Units reached from network, and buffers count to network, downstream units being after their upstream units
+
+  std::vector<long> BuffersCounts(UnitsCount,0);
+
+  m_FromRS.assign(UnitsCount,0);
+  m_FromRSOrOutletLI.assign(UnitsCount,0);
+
+  for (unsigned int i = UnitsCount; i-- > 0; )
+  {
+    const unsigned int Down = m_DownUnits[i];
+    const bool HasDown = (Down != i);
+
+    if (m_Classes.getClass(i) == RS_CLASS)
+    {
+      m_FromRS[i] = 1;
+      m_FromRSOrOutletLI[i] = 1;
+    }
+    else if (isSUOrLI(i) && HasDown)
+    {
+      m_FromRS[i] = m_FromRS[Down];
+      m_FromRSOrOutletLI[i] = m_FromRSOrOutletLI[Down];
+      BuffersCounts[i] = BuffersCounts[Down]+IsBuffer[Down];
+    }
+
+    if (m_Classes.getClass(i) == LI_CLASS && m_LIOutlets[m_Classes.getIndex(i)])
+      m_FromRSOrOutletLI[i] = 1;
+  }
+
+  m_SUBuffersCounts.assign(SUCount,0);
+  for (unsigned int s = 0; s < SUCount; s++)
+    m_SUBuffersCounts[s] = BuffersCounts[SURanks[s]];
+
+  m_SUInfiltVolSums.assign(SUCount,0.0);
+  m_SURunoffVolDeltas.assign(SUCount,0.0);
+  m_SURunoffVolRatios.assign(SUCount,0.0);
+  m_SUInfiltVolRatios.assign(SUCount,0.0);
+  m_SUInfiltVolRatioSums.assign(SUCount,0.0);
+  m_SUConnDegrees.assign(SUCount,0.0);
+  m_SUErosionRisks.assign(SUCount,0.0);
+  m_SURunoffContribs.assign(SUCount,0.0);
+
+  m_LIRunoffVolDeltas.assign(LICount,0.0);
+  m_LIRunoffVolRatios.assign(LICount,0.0);
+  m_LIInfiltVolRatios.assign(LICount,0.0);
+  m_LIConcDegrees.assign(LICount,0.0);
+  m_LIImportanceDegrees.assign(LICount,0.0);
+  m_LIInterestDegrees.assign(LICount,0.0);
+
+  m_InfiltVolRatios.assign(UnitsCount,0.0);
+  m_PathSums.assign(UnitsCount,0.0);
+
+  return true;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void IndicatorsModel::reset()
+{
+  std::fill(m_SUInfiltVolRatioSums.begin(),m_SUInfiltVolRatioSums.end(),0.0);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void IndicatorsModel::compute(const double* UpRunoffVolumes, const double* RunoffVolumes,
+                              const double* InfiltVolumes, unsigned int Stride)
+{
+  const unsigned int UnitsCount = m_Classes.getUnitsCount();
+  const std::vector<unsigned int>& SURanks = m_Classes.getRanks(SU_CLASS);
+  const std::vector<unsigned int>& LIRanks = m_Classes.getRanks(LI_CLASS);
+
+
+  // ============= Cumulated infiltration to network
+
+
+  // sums from RS to each unit, downstream units being after their upstream units
+  for (unsigned int i = UnitsCount; i-- > 0; )
+  {
+    if (m_FromRS[i] && isSUOrLI(i))
+    {
+      m_PathSums[i] = m_PathSums[m_DownUnits[i]];
+
+      if (m_Classes.getClass(i) == SU_CLASS)
+        m_PathSums[i] = m_PathSums[i] + InfiltVolumes[i*Stride];
+    }
+    else
+      m_PathSums[i] = 0.0;
+  }
+
+  for (unsigned int s = 0; s < SURanks.size(); s++)
+    m_SUInfiltVolSums[s] = m_PathSums[SURanks[s]];
+
+
+  // ============= SU delta volume and ratio volume
+
+
+  for (unsigned int s = 0; s < SURanks.size(); s++)
+  {
+    const unsigned int Rank = SURanks[s];
+    double UpRunoffVol = UpRunoffVolumes[Rank*Stride];
+    double RunoffVol = RunoffVolumes[Rank*Stride];
+
+    double DeltaVolume = RunoffVol - UpRunoffVol;
+
+    m_SURunoffVolDeltas[s] = DeltaVolume;
+    m_SURunoffVolRatios[s] = computeRatioVolume(UpRunoffVol,DeltaVolume);
+
+    m_SURunoffContribs[s] = DeltaVolume;
+    m_SUErosionRisks[s] = RunoffVol*m_SUSlopes[s];
+  }
+
+
+  // ============= LI delta volume, ratio volume and concentration degree
+
+
+  for (unsigned int l = 0; l < LIRanks.size(); l++)
+  {
+    const unsigned int Rank = LIRanks[l];
+    double UpRunoffVol = UpRunoffVolumes[Rank*Stride];
+    double RunoffVol = RunoffVolumes[Rank*Stride];
+
+    double DeltaVolume = RunoffVol - UpRunoffVol;
+
+    m_LIRunoffVolDeltas[l] = DeltaVolume;
+    m_LIRunoffVolRatios[l] = computeRatioVolume(UpRunoffVol,DeltaVolume);
+
+    m_LIConcDegrees[l] = UpRunoffVol/m_LILengths[l];
+  }
+
+
+  // ============= LI downstream infiltrated volume and importance degree
+
+
+  for (unsigned int l = 0; l < LIRanks.size(); l++)
+  {
+    const unsigned int Rank = LIRanks[l];
+    double InfiltVol = InfiltVolumes[Rank*Stride];
+    double UpRunoffVol = UpRunoffVolumes[Rank*Stride];
+
+    if (isVeryClose(UpRunoffVol,0.0))
+      m_InfiltVolRatios[Rank] = 0.0;
+    else
+      m_InfiltVolRatios[Rank] = InfiltVol/UpRunoffVol;
+
+    m_LIInfiltVolRatios[l] = m_InfiltVolRatios[Rank];
+
+    if (m_LIOccupied[l])
+    {
+      m_LIImportanceDegrees[l] = InfiltVol;
+      m_LIInterestDegrees[l] = std::numeric_limits<double>::quiet_NaN();
+    }
+    else
+    {
+      m_LIImportanceDegrees[l] = std::numeric_limits<double>::quiet_NaN();
+      m_LIInterestDegrees[l] = UpRunoffVol;
+    }
+  }
+
+
+  // ============= SU infiltration ratio
+
+
+  for (unsigned int s = 0; s < SURanks.size(); s++)
+  {
+    const unsigned int Rank = SURanks[s];
+    double UpRunoffVol = 0.0;
+
+    for (unsigned int u = m_UpBegins[Rank]; u < m_UpBegins[Rank+1]; u++)
+      UpRunoffVol += RunoffVolumes[m_UpUnits[u]*Stride];
+
+    double InfiltVol = InfiltVolumes[Rank*Stride];
+
+    if (isVeryClose(UpRunoffVol,0.0))
+      m_InfiltVolRatios[Rank] = 0.0;
+    else
+      m_InfiltVolRatios[Rank] = InfiltVol/UpRunoffVol;
+
+    m_SUInfiltVolRatios[s] = m_InfiltVolRatios[Rank];
+  }
+
+
+  // ============= SU downstream infiltrated volume and connectivity degree
+
+
+  // sums from RS or from outlet LI (for units not connected to network - review method) to each unit,
+  // not including the unit itself
+  for (unsigned int i = UnitsCount; i-- > 0; )
+  {
+    const unsigned int Down = m_DownUnits[i];
+    const bool IsOutletLI = (m_Classes.getClass(i) == LI_CLASS && m_LIOutlets[m_Classes.getIndex(i)]);
+
+    if (m_FromRSOrOutletLI[i] && isSUOrLI(i) && !IsOutletLI && Down != i)
+    {
+      m_PathSums[i] = m_PathSums[Down];
+
+      if (isSUOrLI(Down))
+        m_PathSums[i] = m_PathSums[i] + m_InfiltVolRatios[Down];
+    }
+    else
+      m_PathSums[i] = 0.0;
+  }
+
+  for (unsigned int s = 0; s < SURanks.size(); s++)
+  {
+    if (m_FromRSOrOutletLI[SURanks[s]])
+      m_SUInfiltVolRatioSums[s] = m_PathSums[SURanks[s]];
+
+    m_SUConnDegrees[s] = m_SUInfiltVolRatioSums[s];
+  }
+
+
+  // ============= Normalized indicators
+
+
+  normalizeValues(m_SUConnDegrees);
+  normalizeValues(m_SUErosionRisks);
+  normalizeValues(m_SURunoffContribs);
+
+  normalizeValues(m_LIImportanceDegrees);
+  normalizeValues(m_LIInterestDegrees);
+  normalizeValues(m_LIConcDegrees);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void IndicatorsModel::getIndicatorsValues(double* Values) const
+{
+  const std::vector<double>* SUValues[IndicatorsValuesCount] = {
+    &m_SURunoffVolDeltas,&m_SURunoffVolRatios,&m_SUInfiltVolRatios,&m_SUConnDegrees,&m_SUErosionRisks,
+    &m_SURunoffContribs
+  };
+  const std::vector<double>* LIValues[IndicatorsValuesCount] = {
+    &m_LIRunoffVolDeltas,&m_LIRunoffVolRatios,&m_LIInfiltVolRatios,&m_LIConcDegrees,&m_LIImportanceDegrees,
+    &m_LIInterestDegrees
+  };
+
+  for (unsigned int s = 0; s < m_SUSlopes.size(); s++)
+    for (unsigned int k = 0; k < IndicatorsValuesCount; k++)
+      *(Values++) = (*SUValues[k])[s];
+
+  for (unsigned int l = 0; l < m_LILengths.size(); l++)
+    for (unsigned int k = 0; k < IndicatorsValuesCount; k++)
+      *(Values++) = (*LIValues[k])[l];
+}
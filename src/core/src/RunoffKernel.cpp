@@ -0,0 +1,29 @@
+/**
+  @file RunoffKernel.cpp
+*/
+
+
+#include "RunoffKernel.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+void computeRunoffs(const double* WaterHeights, double S, double* Runoffs, unsigned int Count)
+{
+  // 0.2S and 0.8S are computed once, so no multiply-add can be contracted
+  const double S02 = 0.2*S;
+  const double S08 = 0.8*S;
+
+  for (unsigned int i = 0; i < Count; i++)
+  {
+    const double H = WaterHeights[i];
+    const double A = H-S02;
+    const double R = (A*A)/(H+S08);
+
+    // Low incoming water levels may generate more runoff than incoming water
+    // In this case, all incoming water is put to runoff
+    Runoffs[i] = (R > H) ? H : R;
+  }
+}
@@ -0,0 +1,380 @@
+/**
+  @file RunoffNetwork.cpp
+*/
+
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <queue>
+
+#include "RunoffNetwork.hpp"
+#include "RunoffKernel.hpp"
+#include "WorkersPool.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+double RunoffNetwork::computeRunoffDerivatives(double H, double S, double& dRdH, double& dRdS)
+{
+  const double A = H-0.2*S;
+  const double B = H+0.8*S;
+  const double R = (A*A)/B;
+
+  if (R > H)
+  {
+    dRdH = 1.0;
+    dRdS = 0.0;
+    return H;
+  }
+
+  dRdH = (2*A*B-A*A)/(B*B);
+  dRdS = (-0.4*A*B-0.8*A*A)/(B*B);
+  return R;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void RunoffNetwork::setLIParams(UnitHydroParams& Params, double Length, double Width,
+                                const double* Ratios, const double* SubpartsS, unsigned int SubpartsCount)
+{
+  Params.Class = LI_CLASS;
+  Params.MaxRatio = 0.0;
+  Params.MaxRatioSubpart = 0;
+  Params.SubpartsCount = 0;
+
+  for (unsigned int p = 0; p < SubpartsCount; p++)
+  {
+    if (Ratios[p] > Params.MaxRatio)
+    {
+      Params.MaxRatio = Ratios[p];
+      Params.MaxRatioSubpart = p;
+    }
+  }
+
+  Params.Area = Length * Params.MaxRatio * Width;
+
+  for (unsigned int p = 0; p < SubpartsCount; p++)
+  {
+    if (Ratios[p] > 0.01)
+      Params.SubpartsS[Params.SubpartsCount++] = SubpartsS[p];
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool RunoffNetwork::build(const std::vector<UnitHydroParams>& Params,
+                          const std::vector<unsigned int>& UpBegins, const std::vector<unsigned int>& UpUnits,
+                          unsigned int ScenariosCount)
+{
+  const unsigned int UnitsCount = Params.size();
+
+  m_ScenariosCount = ScenariosCount;
+  m_Params = Params;
+  m_UpBegins = UpBegins;
+  m_UpUnits = UpUnits;
+
+  // level of a unit is the longest count of units upstream of it
+  std::vector<unsigned int> Levels(UnitsCount,0);
+  unsigned int LevelsCount = 0;
+
+  m_DownBegins.assign(UnitsCount+1,0);
+
+  for (unsigned int i = 0; i < UnitsCount; i++)
+  {
+    for (unsigned int u = m_UpBegins[i]; u < m_UpBegins[i+1]; u++)
+    {
+      if (m_UpUnits[u] >= i)
+        return false;
+
+      Levels[i] = std::max(Levels[i],Levels[m_UpUnits[u]]+1);
+      m_DownBegins[m_UpUnits[u]+1]++;
+    }
+    LevelsCount = std::max(LevelsCount,Levels[i]+1);
+  }
+
+  for (unsigned int i = 0; i < UnitsCount; i++)
+    m_DownBegins[i+1] += m_DownBegins[i];
+
+  m_DownUnits.resize(m_UpUnits.size());
+  std::vector<unsigned int> DownPos(m_DownBegins.begin(),m_DownBegins.end()-1);
+  for (unsigned int i = 0; i < UnitsCount; i++)
+  {
+    for (unsigned int u = m_UpBegins[i]; u < m_UpBegins[i+1]; u++)
+      m_DownUnits[DownPos[m_UpUnits[u]]++] = i;
+  }
+
+  m_LevelsBegins.assign(LevelsCount+1,0);
+  for (unsigned int i = 0; i < UnitsCount; i++)
+    m_LevelsBegins[Levels[i]+1]++;
+  for (unsigned int l = 0; l < LevelsCount; l++)
+    m_LevelsBegins[l+1] += m_LevelsBegins[l];
+
+  m_LevelsUnits.resize(UnitsCount);
+  std::vector<unsigned int> LevelsPos(m_LevelsBegins.begin(),m_LevelsBegins.end()-1);
+  for (unsigned int i = 0; i < UnitsCount; i++)
+    m_LevelsUnits[LevelsPos[Levels[i]]++] = i;
+
+  const unsigned int LanesCount = UnitsCount*m_ScenariosCount;
+
+  m_Rains.assign(LanesCount,0.0);
+  m_RunoffVolumes.assign(LanesCount,0.0);
+  m_UpRunoffVolumes.assign(LanesCount,0.0);
+  m_Infiltrations.assign(LanesCount,0.0);
+  m_InfiltVolumes.assign(LanesCount,0.0);
+
+  m_Queued.assign(UnitsCount,0);
+
+  return true;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void RunoffNetwork::computeUpstreamRunoffVolumes(unsigned int Rank, double* UpRunoffVols) const
+{
+  for (unsigned int k = 0; k < m_ScenariosCount; k++)
+    UpRunoffVols[k] = 0.0;
+
+  for (unsigned int u = m_UpBegins[Rank]; u < m_UpBegins[Rank+1]; u++)
+  {
+    const double* UpUnitRunoffVols = &m_RunoffVolumes[m_UpUnits[u]*m_ScenariosCount];
+
+    for (unsigned int k = 0; k < m_ScenariosCount; k++)
+      UpRunoffVols[k] += UpUnitRunoffVols[k];
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void RunoffNetwork::computeRunoffVolumesOnLI(unsigned int Rank, const double* IncomingWaterVolumes,
+                                             double* RunoffVolumes, unsigned int ScenariosCount) const
+{
+  // 1. Find max ratio
+  // 2. Efficient water volume = incoming water volume * max ratio
+  // 3. Efficient area = length * max ratio * m_LIWidth;
+  // 4. Initial water height = Efficient water volume / Efficient area
+  // 5. Compute successive infiltration volume through LI subparts where
+
+  const UnitHydroParams& Params = m_Params[Rank];
+  const double MaxRatio = Params.MaxRatio;
+
+  if (MaxRatio < 0.01)
+  {
+    for (unsigned int k = 0; k < ScenariosCount; k++)
+      RunoffVolumes[k] = IncomingWaterVolumes[k];
+    return;
+  }
+
+  const double EfficientArea = Params.Area;
+
+  // current runoffs are computed in place
+  double* CurrentRunoffs = RunoffVolumes;
+  bool AllRunoffsPositive = true;
+
+  for (unsigned int k = 0; k < ScenariosCount; k++)
+  {
+    double RunoffVolumeToFilter = IncomingWaterVolumes[k] * MaxRatio;
+    CurrentRunoffs[k] = RunoffVolumeToFilter / EfficientArea;
+    AllRunoffsPositive = AllRunoffsPositive && (CurrentRunoffs[k] > 0);
+  }
+
+  for (unsigned int p = 0; p < Params.SubpartsCount; p++)
+  {
+    if (AllRunoffsPositive)
+      computeRunoffs(CurrentRunoffs,Params.SubpartsS[p],CurrentRunoffs,ScenariosCount);
+    else
+    {
+      // only positive runoffs are filtered, checked on runoffs entering the LI
+      for (unsigned int k = 0; k < ScenariosCount; k++)
+      {
+        if (IncomingWaterVolumes[k] * MaxRatio / EfficientArea > 0)
+          computeRunoffs(CurrentRunoffs+k,Params.SubpartsS[p],CurrentRunoffs+k,1);
+      }
+    }
+  }
+
+  for (unsigned int k = 0; k < ScenariosCount; k++)
+  {
+    double RunoffVolumeToFilter = IncomingWaterVolumes[k] * MaxRatio;
+    double BypassedRunoffVolume = IncomingWaterVolumes[k] - RunoffVolumeToFilter;
+
+    double FilteredRunoffVolume = CurrentRunoffs[k] * EfficientArea;
+
+    RunoffVolumes[k] = FilteredRunoffVolume+BypassedRunoffVolume;
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void RunoffNetwork::computeUnit(unsigned int Rank)
+{
+  const unsigned int ScenariosCount = m_ScenariosCount;
+  const unsigned int Lanes = Rank*ScenariosCount;
+
+  double* UpstreamRunoffVolumes = &m_UpRunoffVolumes[Lanes];
+  computeUpstreamRunoffVolumes(Rank,UpstreamRunoffVolumes);
+
+  const UnitHydroParams& Params = m_Params[Rank];
+
+  if (Params.Class == SU_CLASS)
+  {
+    const double Area = Params.Area;
+
+    // incoming water heights and runoffs are computed in place
+    double* IncomingWaterHeights = &m_Infiltrations[Lanes];
+    double* Runoffs = &m_RunoffVolumes[Lanes];
+
+    // Total incoming water = total rain + (UpstreamRunoffVolume / Area)
+    for (unsigned int k = 0; k < ScenariosCount; k++)
+      IncomingWaterHeights[k] = m_Rains[Lanes+k] + (UpstreamRunoffVolumes[k] / Area);
+
+    computeRunoffs(IncomingWaterHeights,Params.S,Runoffs,ScenariosCount);
+
+    for (unsigned int k = 0; k < ScenariosCount; k++)
+    {
+      double Infiltration = IncomingWaterHeights[k] - Runoffs[k];
+
+      m_RunoffVolumes[Lanes+k] = Runoffs[k]*Area;
+      m_Infiltrations[Lanes+k] = Infiltration;
+      m_InfiltVolumes[Lanes+k] = Infiltration*Area;
+    }
+  }
+  else if (Params.Class == LI_CLASS)
+  {
+    // Area = length * m_LIWidth
+    // Total incoming water = UpstreamRunoffVolume / Area
+
+    computeRunoffVolumesOnLI(Rank,UpstreamRunoffVolumes,&m_RunoffVolumes[Lanes],ScenariosCount);
+
+    for (unsigned int k = 0; k < ScenariosCount; k++)
+      m_InfiltVolumes[Lanes+k] = UpstreamRunoffVolumes[k] - m_RunoffVolumes[Lanes+k];
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void RunoffNetwork::computeAll(WorkersPool* Pool)
+{
+  if (Pool)
+  {
+    const std::function<void(unsigned int)> ComputeUnit = [this](unsigned int l)
+    {
+      computeUnit(m_LevelsUnits[l]);
+    };
+
+    // units of a level only depend on units of previous levels, which are completed when parallelFor returns
+    for (unsigned int l = 0; l+1 < m_LevelsBegins.size(); l++)
+    {
+      if (m_LevelsBegins[l+1]-m_LevelsBegins[l] < MinParallelLevelSize)
+      {
+        for (unsigned int u = m_LevelsBegins[l]; u < m_LevelsBegins[l+1]; u++)
+          computeUnit(m_LevelsUnits[u]);
+      }
+      else
+        Pool->parallelFor(m_LevelsBegins[l],m_LevelsBegins[l+1],ParallelChunkSize,ComputeUnit);
+    }
+  }
+  else
+  {
+    for (unsigned int i = 0; i < m_Params.size(); i++)
+      computeUnit(i);
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+unsigned int RunoffNetwork::computeDownstream(const std::vector<unsigned int>& ChangedRanks,
+                                              std::vector<unsigned int>* ComputedRanks)
+{
+  // ranks follow the process order, so computing queued units by increasing rank
+  // always computes a unit after all its changed upstream units
+  std::priority_queue<unsigned int,std::vector<unsigned int>,std::greater<unsigned int>> Queue;
+  std::vector<double> PreviousRunoffVolumes(m_ScenariosCount);
+  unsigned int ComputedCount = 0;
+
+  for (auto Rank : ChangedRanks)
+  {
+    if (!m_Queued[Rank])
+    {
+      m_Queued[Rank] = 1;
+      Queue.push(Rank);
+    }
+  }
+
+  while (!Queue.empty())
+  {
+    const unsigned int Rank = Queue.top();
+    Queue.pop();
+    m_Queued[Rank] = 0;
+
+    double* RunoffVolumes = &m_RunoffVolumes[Rank*m_ScenariosCount];
+    std::copy(RunoffVolumes,RunoffVolumes+m_ScenariosCount,PreviousRunoffVolumes.begin());
+
+    computeUnit(Rank);
+    ComputedCount++;
+
+    if (ComputedRanks)
+      ComputedRanks->push_back(Rank);
+
+    // downstream units are unchanged if the outgoing runoff volumes are exactly the same
+    if (std::memcmp(RunoffVolumes,PreviousRunoffVolumes.data(),m_ScenariosCount*sizeof(double)) == 0)
+      continue;
+
+    for (unsigned int d = m_DownBegins[Rank]; d < m_DownBegins[Rank+1]; d++)
+    {
+      const unsigned int DownRank = m_DownUnits[d];
+
+      if (!m_Queued[DownRank])
+      {
+        m_Queued[DownRank] = 1;
+        Queue.push(DownRank);
+      }
+    }
+  }
+
+  return ComputedCount;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void RunoffNetwork::copyUnits(const RunoffNetwork& Source, const std::vector<unsigned int>& Ranks)
+{
+  for (auto Rank : Ranks)
+  {
+    const unsigned int Lanes = Rank*m_ScenariosCount;
+
+    m_Params[Rank] = Source.m_Params[Rank];
+
+    std::copy_n(&Source.m_Rains[Lanes],m_ScenariosCount,&m_Rains[Lanes]);
+    std::copy_n(&Source.m_RunoffVolumes[Lanes],m_ScenariosCount,&m_RunoffVolumes[Lanes]);
+    std::copy_n(&Source.m_UpRunoffVolumes[Lanes],m_ScenariosCount,&m_UpRunoffVolumes[Lanes]);
+    std::copy_n(&Source.m_Infiltrations[Lanes],m_ScenariosCount,&m_Infiltrations[Lanes]);
+    std::copy_n(&Source.m_InfiltVolumes[Lanes],m_ScenariosCount,&m_InfiltVolumes[Lanes]);
+  }
+}
@@ -0,0 +1,276 @@
+/**
+  @file TravelTimeRouting.cpp
+*/
+
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <tuple>
+
+#include "TravelTimeRouting.hpp"
+#include "WorkersPool.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+std::vector<double> TravelTimeRouting::getTriangularKernel(double BaseDuration, double IntervalDuration)
+{
+  if (BaseDuration <= 0.0 || IntervalDuration <= 0.0)
+    return std::vector<double>(1,1.0);
+
+  const double Peak = 0.375*BaseDuration;
+
+  // cumulative distribution of the triangular unit hydrograph
+  const auto computeCumul = [BaseDuration,Peak](double T)
+  {
+    if (T <= 0.0)
+      return 0.0;
+    else if (T >= BaseDuration)
+      return 1.0;
+    else if (T <= Peak)
+      return T*T/(BaseDuration*Peak);
+
+    return 1.0-(BaseDuration-T)*(BaseDuration-T)/(BaseDuration*(BaseDuration-Peak));
+  };
+
+  const unsigned int Count = std::ceil(BaseDuration/IntervalDuration);
+  std::vector<double> Kernel(Count,0.0);
+
+  for (unsigned int k = 0; k < Count; k++)
+    Kernel[k] = computeCumul((k+1)*IntervalDuration)-computeCumul(k*IntervalDuration);
+
+  return Kernel;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool TravelTimeRouting::build(const RunoffNetwork& Network, const std::vector<double>& FlowDists, double Velocity,
+                              double IntervalDuration, const std::vector<double>& Kernel, double EventDuration,
+                              std::string& Error)
+{
+  const unsigned int UnitsCount = Network.getUnitsCount();
+
+  if (Velocity <= 0.0 || IntervalDuration <= 0.0)
+  {
+    Error = "Routing velocity and interval duration must be positive";
+    return false;
+  }
+
+  if (FlowDists.size() != UnitsCount)
+  {
+    Error = "Flow distances do not match the count of units";
+    return false;
+  }
+
+  m_IntervalDuration = IntervalDuration;
+
+  const std::vector<unsigned int>& DownBegins = Network.getDownBegins();
+  const std::vector<unsigned int>& DownUnits = Network.getDownUnits();
+
+  m_DownUnits.resize(UnitsCount);
+  m_RSRanks.clear();
+
+  for (unsigned int i = 0; i < UnitsCount; i++)
+  {
+    m_DownUnits[i] = (DownBegins[i] < DownBegins[i+1]) ? DownUnits[DownBegins[i]] : i;
+
+    if (Network.getParams(i).Class == RS_CLASS)
+      m_RSRanks.push_back(i);
+  }
+
+  // RS reached by each unit and flow distance to it, downstream units being after their upstream units
+  std::vector<int> UnitsRS(UnitsCount,-1);
+  std::vector<double> Dists(UnitsCount,0.0);
+
+  for (unsigned int r = 0; r < m_RSRanks.size(); r++)
+  {
+    UnitsRS[m_RSRanks[r]] = r;
+    Dists[m_RSRanks[r]] = FlowDists[m_RSRanks[r]];
+  }
+
+  for (unsigned int i = UnitsCount; i-- > 0; )
+  {
+    const unsigned int Down = m_DownUnits[i];
+
+    if (Network.getParams(i).Class != RS_CLASS && Down != i)
+    {
+      UnitsRS[i] = UnitsRS[Down];
+      Dists[i] = FlowDists[i]+Dists[Down];
+    }
+  }
+
+  // levels of SU of same RS and same delay, only SU generating runoff
+  std::vector<std::tuple<unsigned int,unsigned int,unsigned int>> Keys;
+  unsigned int MaxDelay = 0;
+
+  for (unsigned int i = 0; i < UnitsCount; i++)
+  {
+    if (Network.getParams(i).Class == SU_CLASS && UnitsRS[i] >= 0)
+    {
+      const unsigned int Delay = std::lround(Dists[i]/Velocity/IntervalDuration);
+
+      Keys.emplace_back(UnitsRS[i],Delay,i);
+      MaxDelay = std::max(MaxDelay,Delay);
+    }
+  }
+
+  std::sort(Keys.begin(),Keys.end());
+
+  m_LevelsBegins.assign(1,0);
+  m_LevelsUnits.clear();
+  m_LevelsRS.clear();
+  m_LevelsDelays.clear();
+
+  for (unsigned int k = 0; k < Keys.size(); k++)
+  {
+    if (k == 0 || std::get<0>(Keys[k]) != m_LevelsRS.back() || std::get<1>(Keys[k]) != m_LevelsDelays.back())
+    {
+      if (k > 0)
+        m_LevelsBegins.push_back(m_LevelsUnits.size());
+
+      m_LevelsRS.push_back(std::get<0>(Keys[k]));
+      m_LevelsDelays.push_back(std::get<1>(Keys[k]));
+    }
+
+    m_LevelsUnits.push_back(std::get<2>(Keys[k]));
+  }
+
+  if (!Keys.empty())
+    m_LevelsBegins.push_back(m_LevelsUnits.size());
+
+  m_WindowLength = MaxDelay+1;
+  m_Convolution.setKernel(Kernel,m_WindowLength);
+
+  // arrivals of the last generated runoff end at the last delay spread by the kernel
+  m_IntervalsCount = std::floor(std::max(EventDuration,0.0)/IntervalDuration)+m_Convolution.getResultLength();
+
+  m_PathRatios.assign(UnitsCount,0.0);
+  m_ArrivalsChanges.assign(m_RSRanks.size()*m_WindowLength,0.0);
+
+  reset();
+
+  return true;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void TravelTimeRouting::resetContributions()
+{
+  m_LevelsCumulContribs.assign(m_LevelsRS.size(),0.0);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void TravelTimeRouting::reset()
+{
+  resetContributions();
+  m_Hydrographs.assign(m_RSRanks.size()*m_IntervalsCount,0.0);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void TravelTimeRouting::addContributions(const RunoffNetwork& Network, double Time, WorkersPool* Pool)
+{
+  const unsigned int ScenariosCount = Network.getScenariosCount();
+  const std::vector<double>& Rains = Network.getRains();
+  const std::vector<double>& UpRunoffVolumes = Network.getUpRunoffVolumes();
+  const std::vector<double>& RunoffVolumes = Network.getRunoffVolumes();
+
+  // ratios of the water entering each unit which reaches RS, downstream units being after their upstream units
+  for (unsigned int i = Network.getUnitsCount(); i-- > 0; )
+  {
+    const UnitHydroParams& Params = Network.getParams(i);
+    const unsigned int Down = m_DownUnits[i];
+
+    if (Params.Class == RS_CLASS)
+      m_PathRatios[i] = 1.0;
+    else if (Down != i)
+    {
+      double InVolume = UpRunoffVolumes[i*ScenariosCount];
+
+      if (Params.Class == SU_CLASS)
+        InVolume += Rains[i*ScenariosCount]*Params.Area;
+
+      m_PathRatios[i] = (InVolume > 0.0) ? RunoffVolumes[i*ScenariosCount]/InVolume*m_PathRatios[Down] : 0.0;
+    }
+    else
+      m_PathRatios[i] = 0.0;
+  }
+
+  // contributions are summed by level, the changes since the previous computation being added to the arrivals
+  for (unsigned int l = 0; l+1 < m_LevelsBegins.size(); l++)
+  {
+    double Contrib = 0.0;
+
+    for (unsigned int u = m_LevelsBegins[l]; u < m_LevelsBegins[l+1]; u++)
+    {
+      const unsigned int Rank = m_LevelsUnits[u];
+      Contrib += Rains[Rank*ScenariosCount]*Network.getParams(Rank).Area*m_PathRatios[Rank];
+    }
+
+    m_ArrivalsChanges[m_LevelsRS[l]*m_WindowLength+m_LevelsDelays[l]] += Contrib-m_LevelsCumulContribs[l];
+    m_LevelsCumulContribs[l] = Contrib;
+  }
+
+  const unsigned int Start = std::floor(std::max(Time,0.0)/m_IntervalDuration);
+  const unsigned int ResultLength = m_Convolution.getResultLength();
+
+  const std::function<void(unsigned int)> ConvolveRS = [this,Start,ResultLength](unsigned int r)
+  {
+    double* Changes = &m_ArrivalsChanges[r*m_WindowLength];
+
+    if (std::all_of(Changes,Changes+m_WindowLength,[](double V) { return V == 0.0; }))
+      return;
+
+    std::vector<double> Result(ResultLength);
+    std::vector<std::complex<double>> Buffer;
+
+    m_Convolution.convolve(Changes,Result.data(),Buffer);
+
+    double* Hydrograph = &m_Hydrographs[r*m_IntervalsCount];
+
+    for (unsigned int k = 0; k < ResultLength && Start+k < m_IntervalsCount; k++)
+      Hydrograph[Start+k] += Result[k];
+
+    std::fill(Changes,Changes+m_WindowLength,0.0);
+  };
+
+  if (Pool)
+    Pool->parallelFor(0,m_RSRanks.size(),1,ConvolveRS);
+  else
+  {
+    for (unsigned int r = 0; r < m_RSRanks.size(); r++)
+      ConvolveRS(r);
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+double TravelTimeRouting::getVolume(unsigned int RSIndex, unsigned int BeginInterval, unsigned int EndInterval) const
+{
+  const double* Hydrograph = getHydrograph(RSIndex);
+  double Volume = 0.0;
+
+  for (unsigned int k = BeginInterval; k < std::min(EndInterval,m_IntervalsCount); k++)
+    Volume += Hydrograph[k];
+
+  return Volume;
+}
@@ -0,0 +1,148 @@
+/**
+  @file ConvolutionTest.cpp
+
+  Checks the FFT and the kernel convolutions computed by FFT against direct computations
+*/
+
+
+#include "CoreTestsTools.hpp"
+#include "Convolution.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+static std::vector<double> convolveDirect(const std::vector<double>& Signal, const std::vector<double>& Kernel)
+{
+  std::vector<double> Result(Signal.size()+Kernel.size()-1,0.0);
+
+  for (unsigned int i = 0; i < Signal.size(); i++)
+    for (unsigned int k = 0; k < Kernel.size(); k++)
+      Result[i+k] += Signal[i]*Kernel[k];
+
+  return Result;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+static std::vector<double> getRandomValues(unsigned int Count, bool Sparse)
+{
+  std::vector<double> Values(Count,0.0);
+
+  for (auto& V : Values)
+  {
+    if (!Sparse || std::rand()%4 == 0)
+      V = double(std::rand())/RAND_MAX;
+  }
+
+  return Values;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+static void testFFT()
+{
+  const unsigned int Size = 256;
+
+  // the transform of an impulse is constant
+  std::vector<std::complex<double>> Values(Size,0.0);
+  Values[0] = 1.0;
+  computeFFT(Values.data(),Size,false);
+
+  bool Constant = true;
+  for (auto V : Values)
+    Constant = Constant && std::abs(V-1.0) < 1e-15;
+  CORETEST_CHECK(Constant);
+
+  // the inverse transform gives back the values
+  std::vector<std::complex<double>> Original(Size);
+  for (unsigned int i = 0; i < Size; i++)
+    Original[i] = std::complex<double>(double(std::rand())/RAND_MAX,double(std::rand())/RAND_MAX);
+
+  Values = Original;
+  computeFFT(Values.data(),Size,false);
+  computeFFT(Values.data(),Size,true);
+
+  double MaxError = 0.0;
+  for (unsigned int i = 0; i < Size; i++)
+    MaxError = std::max(MaxError,std::abs(Values[i]-Original[i]));
+  CORETEST_CHECK(MaxError < 1e-13);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+static void testConvolutions()
+{
+  // small sizes are computed directly, larger ones by FFT, result lengths not being powers of 2
+  const unsigned int Sizes[][2] = {{1,1},{10,5},{64,64},{100,40},{1000,50},{1440,3},{3000,121},{4096,1}};
+
+  std::vector<std::complex<double>> Buffer;
+
+  for (const auto& Size : Sizes)
+  {
+    for (bool Sparse : {false,true})
+    {
+      const std::vector<double> Signal = getRandomValues(Size[0],Sparse);
+      const std::vector<double> Kernel = getRandomValues(Size[1],false);
+      const std::vector<double> Expected = convolveDirect(Signal,Kernel);
+
+      KernelConvolution Convolution;
+      Convolution.setKernel(Kernel,Signal.size());
+
+      CORETEST_CHECK(Convolution.getResultLength() == Expected.size());
+
+      std::vector<double> Result(Convolution.getResultLength(),-1.0);
+      Convolution.convolve(Signal.data(),Result.data(),Buffer);
+
+      double MaxExpected = 0.0;
+      double MaxError = 0.0;
+      for (unsigned int i = 0; i < Expected.size(); i++)
+      {
+        MaxExpected = std::max(MaxExpected,std::fabs(Expected[i]));
+        MaxError = std::max(MaxError,std::fabs(Result[i]-Expected[i]));
+      }
+
+      if (MaxError > 1e-12*std::max(MaxExpected,1.0))
+        std::fprintf(stderr,"convolution of %u values by %u values: error %g\n",Size[0],Size[1],MaxError);
+      CORETEST_CHECK(MaxError <= 1e-12*std::max(MaxExpected,1.0));
+    }
+  }
+
+  // an empty kernel is the identity
+  KernelConvolution Identity;
+  Identity.setKernel({},5000);
+
+  const std::vector<double> Signal = getRandomValues(5000,true);
+  std::vector<double> Result(Identity.getResultLength());
+  Identity.convolve(Signal.data(),Result.data(),Buffer);
+
+  double MaxError = 0.0;
+  for (unsigned int i = 0; i < Signal.size(); i++)
+    MaxError = std::max(MaxError,std::fabs(Result[i]-Signal[i]));
+  CORETEST_CHECK(Result.size() == Signal.size() && MaxError < 1e-12);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+int main()
+{
+  std::srand(13);
+
+  testFFT();
+  testConvolutions();
+
+  return FailuresCount ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+/**
+  @file CoreTestsTools.hpp
+*/
+
+
+#ifndef __CORETESTSTOOLS_HPP__
+#define __CORETESTSTOOLS_HPP__
+
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#include "BVServiceGraph.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+// count of failed checks of the test program, returned by main()
+static unsigned int FailuresCount = 0;
+
+
+/**
+  Checks a condition, displaying the failed expression with its location
+*/
+#define CORETEST_CHECK(Cond) \
+  do { \
+    if (!(Cond)) \
+    { \
+      std::fprintf(stderr,"%s:%d: check failed: %s\n",__FILE__,__LINE__,#Cond); \
+      FailuresCount++; \
+    } \
+  } while (0)
+
+
+/**
+  Checks that two values are equal within the given relative tolerance, NaN being equal to NaN
+*/
+#define CORETEST_CHECK_CLOSE(Value,Expected,Tolerance) \
+  do { \
+    const double CoreTestValue = (Value); \
+    const double CoreTestExpected = (Expected); \
+    if (!isCloseValue(CoreTestValue,CoreTestExpected,Tolerance)) \
+    { \
+      std::fprintf(stderr,"%s:%d: check failed: %s = %.17g, expected %.17g\n",__FILE__,__LINE__,#Value, \
+                   CoreTestValue,CoreTestExpected); \
+      FailuresCount++; \
+    } \
+  } while (0)
+
+
+// =====================================================================
+// =====================================================================
+
+
+inline bool isCloseValue(double Value, double Expected, double Tolerance)
+{
+  if (std::isnan(Value) || std::isnan(Expected))
+    return std::isnan(Value) && std::isnan(Expected);
+
+  return std::fabs(Value-Expected) <= Tolerance*std::max(std::fabs(Expected),1.0);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  @return true if the two arrays have the same bits
+*/
+inline bool isSameBits(const std::vector<double>& A, const std::vector<double>& B)
+{
+  return A.size() == B.size() && std::memcmp(A.data(),B.data(),A.size()*sizeof(double)) == 0;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Builds a random graph of the given count of units in process order, each SU or LI flowing to a later unit,
+  the last units being RS. Land uses are indices in [0,LandUsesCount)
+*/
+inline void buildRandomGraph(BVServiceGraph& Graph, unsigned int UnitsCount, unsigned int LandUsesCount,
+                             unsigned int Seed)
+{
+  const unsigned int RSCount = 5;
+
+  std::srand(Seed);
+
+  std::vector<UnitClass_t> Classes(UnitsCount);
+  for (unsigned int i = 0; i < UnitsCount; i++)
+    Classes[i] = (i >= UnitsCount-RSCount) ? RS_CLASS : ((std::rand()%3 == 0) ? LI_CLASS : SU_CLASS);
+
+  // upstream units of each unit, by class
+  std::vector<std::vector<unsigned int>> UpLI(UnitsCount);
+  std::vector<std::vector<unsigned int>> UpSU(UnitsCount);
+
+  for (unsigned int i = 0; i+RSCount < UnitsCount; i++)
+  {
+    const unsigned int Down = i+1+std::rand()%std::min(50u,UnitsCount-1-i);
+
+    if (Classes[i] == LI_CLASS)
+      UpLI[Down].push_back(i);
+    else
+      UpSU[Down].push_back(i);
+  }
+
+  Graph.clear();
+
+  for (unsigned int i = 0; i < UnitsCount; i++)
+  {
+    Graph.addUnit(Classes[i]);
+
+    for (auto Up : UpLI[i])
+      Graph.addUpstreamUnit(Up);
+    for (auto Up : UpSU[i])
+      Graph.addUpstreamUnit(Up);
+
+    Graph.FlowDists[i] = 10+std::rand()%200;
+    Graph.Areas[i] = 100+std::rand()%1000;
+    Graph.Slopes[i] = (std::rand()%100)/1000.0;
+    Graph.LandUses[i] = std::rand()%LandUsesCount;
+    Graph.Buffers[i] = (std::rand()%20 == 0);
+    Graph.Lengths[i] = 10+std::rand()%100;
+    Graph.Ratios[i*BVServiceGraph::LISubpartsCount+std::rand()%BVServiceGraph::LISubpartsCount] =
+      (std::rand()%100)/100.0;
+    Graph.Outlets[i] = (std::rand()%50 == 0);
+  }
+}
+
+
+#endif /* __CORETESTSTOOLS_HPP__ */
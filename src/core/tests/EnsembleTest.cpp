@@ -0,0 +1,150 @@
+/**
+  @file EnsembleTest.cpp
+
+  Checks the online accumulators (Welford mean and variance, P-square quantiles) on known samples,
+  and the reproducibility of the random streams of the members
+*/
+
+
+#include "CoreTestsTools.hpp"
+#include "Ensemble.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+static void testWelford()
+{
+  EnsembleAccumulator Acc;
+
+  CORETEST_CHECK(std::isnan(Acc.getMean()));
+  CORETEST_CHECK_CLOSE(Acc.getStdDev(),0.0,0.0);
+
+  // 1..N: mean (N+1)/2, sample variance N(N+1)/12
+  const unsigned int N = 1000;
+  for (unsigned int i = 1; i <= N; i++)
+    Acc.add(i);
+
+  CORETEST_CHECK(Acc.getCount() == N);
+  CORETEST_CHECK_CLOSE(Acc.getMean(),(N+1)/2.0,1e-14);
+  CORETEST_CHECK_CLOSE(Acc.getStdDev(),std::sqrt(N*(N+1)/12.0),1e-12);
+
+  // NaN values are ignored
+  Acc.add(std::nan(""));
+  CORETEST_CHECK(Acc.getCount() == N);
+  CORETEST_CHECK_CLOSE(Acc.getMean(),(N+1)/2.0,1e-14);
+
+  // a large offset does not lose the variance, as a sum of squares would
+  Acc.reset();
+  const double Offset = 1e9;
+  for (auto V : {4.0,7.0,13.0,16.0})
+    Acc.add(Offset+V);
+
+  CORETEST_CHECK_CLOSE(Acc.getMean(),Offset+10.0,1e-15);
+  CORETEST_CHECK_CLOSE(Acc.getStdDev(),std::sqrt(30.0),1e-6);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+static void testP2Quantiles()
+{
+  P2Quantile Median;
+
+  Median.reset(0.5);
+  CORETEST_CHECK(std::isnan(Median.get()));
+
+  // exact for less than 5 values
+  for (auto V : {3.0,1.0,2.0})
+    Median.add(V);
+  CORETEST_CHECK_CLOSE(Median.get(),2.0,0.0);
+
+  // 1..1001 in a shuffled order
+  std::vector<double> Values;
+  for (unsigned int i = 1; i <= 1001; i++)
+    Values.push_back(i);
+
+  std::srand(11);
+  for (unsigned int i = Values.size()-1; i > 0; i--)
+    std::swap(Values[i],Values[std::rand()%(i+1)]);
+
+  EnsembleAccumulator Acc;
+  for (auto V : Values)
+    Acc.add(V);
+
+  double Quantiles[EnsembleAccumulator::QuantilesCount];
+  Acc.getQuantiles(Quantiles);
+
+  for (unsigned int q = 0; q < EnsembleAccumulator::QuantilesCount; q++)
+  {
+    const double Exact = 1+EnsembleAccumulator::QuantilesProbs[q]*1000;
+    CORETEST_CHECK(std::fabs(Quantiles[q]-Exact) <= 10.0);
+  }
+
+  // quantiles of a standard normal sample
+  RandomGenerator Generator(5,0);
+  Acc.reset();
+  for (unsigned int i = 0; i < 100000; i++)
+    Acc.add(Generator.normal());
+
+  Acc.getQuantiles(Quantiles);
+
+  CORETEST_CHECK(std::fabs(Quantiles[0]+1.6449) < 0.03);
+  CORETEST_CHECK(std::fabs(Quantiles[1]) < 0.02);
+  CORETEST_CHECK(std::fabs(Quantiles[2]-1.6449) < 0.03);
+  CORETEST_CHECK(std::fabs(Acc.getMean()) < 0.01);
+  CORETEST_CHECK(std::fabs(Acc.getStdDev()-1.0) < 0.01);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+static void testRandomStreams()
+{
+  RandomGenerator A(42,7), B(42,7), C(42,8);
+
+  bool SameAsB = true;
+  bool SameAsC = true;
+
+  for (unsigned int i = 0; i < 100; i++)
+  {
+    const std::uint64_t Value = A.next();
+    SameAsB = SameAsB && (Value == B.next());
+    SameAsC = SameAsC && (Value == C.next());
+  }
+
+  CORETEST_CHECK(SameAsB);
+  CORETEST_CHECK(!SameAsC);
+
+  PerturbationDistribution Distri;
+  CORETEST_CHECK(Distri.parse("uniform:0.5") && Distri.Kind == PerturbationDistribution::UNIFORM);
+  CORETEST_CHECK(!Distri.parse("uniform") && !Distri.parse("gamma:1") && !Distri.parse("normal:-1"));
+
+  Distri.parse("uniform:0.5");
+  bool InRange = true;
+  for (unsigned int i = 0; i < 1000; i++)
+  {
+    const double V = Distri.sample(A);
+    InRange = InRange && V >= -0.5 && V <= 0.5;
+  }
+  CORETEST_CHECK(InRange);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+int main()
+{
+  testWelford();
+  testP2Quantiles();
+  testRandomStreams();
+
+  return FailuresCount ? 1 : 0;
+}
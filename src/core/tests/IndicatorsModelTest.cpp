@@ -0,0 +1,159 @@
+/**
+  @file IndicatorsModelTest.cpp
+
+  Checks the indicators of a small graph against values computed by hand:
+
+    SU A --> LI L (grass strips, occupied) --+
+                                             +--> SU C --> RS R
+    SU B --> LI M (no subpart)  -------------+
+
+    SU D, not connected
+*/
+
+
+#include <limits>
+
+#include "CoreTestsTools.hpp"
+#include "IndicatorsModel.hpp"
+
+
+enum { A = 0, B, L, M, C, R, D };
+
+
+// =====================================================================
+// =====================================================================
+
+
+int main()
+{
+  const double NaN = std::numeric_limits<double>::quiet_NaN();
+  const double Tol = 1e-14;
+
+  BVServiceGraph Graph;
+
+  Graph.addUnit(SU_CLASS);
+  Graph.Areas[A] = 100;
+  Graph.Slopes[A] = 0.1;
+
+  Graph.addUnit(SU_CLASS);
+  Graph.Areas[B] = 200;
+  Graph.Slopes[B] = 0.2;
+
+  Graph.addUnit(LI_CLASS);
+  Graph.addUpstreamUnit(A);
+  Graph.Lengths[L] = 10;
+  Graph.Ratios[L*BVServiceGraph::LISubpartsCount+1] = 0.5;
+
+  Graph.addUnit(LI_CLASS);
+  Graph.addUpstreamUnit(B);
+  Graph.Lengths[M] = 20;
+
+  Graph.addUnit(SU_CLASS);
+  Graph.addUpstreamUnit(L);
+  Graph.addUpstreamUnit(M);
+  Graph.Areas[C] = 300;
+  Graph.Slopes[C] = 0.3;
+
+  Graph.addUnit(RS_CLASS);
+  Graph.addUpstreamUnit(C);
+
+  Graph.addUnit(SU_CLASS);
+  Graph.Areas[D] = 50;
+  Graph.Slopes[D] = 0.4;
+
+  IndicatorsModel Model;
+  std::string Error;
+
+  CORETEST_CHECK(Model.build(Graph,Error));
+
+  // topology and data which do not change
+
+  const double UpperAreas[] = {100,200,100,200,600,600,50};
+  for (unsigned int i = 0; i < Graph.getUnitsCount(); i++)
+    CORETEST_CHECK_CLOSE(Model.getUpperAreas()[i],UpperAreas[i],0.0);
+
+  for (unsigned int i = 0; i < Graph.getUnitsCount(); i++)
+    CORETEST_CHECK(Model.isFromRS(i) == (i != D) && Model.isFromRSOrOutletLI(i) == (i != D));
+
+  // SU by index: A, B, C, D. Only A crosses a buffer (L) to reach the network
+  const long BuffersCounts[] = {1,0,0,0};
+  for (unsigned int s = 0; s < 4; s++)
+    CORETEST_CHECK(Model.getSUBuffersCounts()[s] == BuffersCounts[s]);
+
+  // hydrologic results, by rank
+  const double UpRunoffVolumes[] = {0,0,10,14,18,30,0};
+  const double RunoffVolumes[] = {10,14,6,12,30,0,5};
+  const double InfiltVolumes[] = {2,3,4,2,5,0,1};
+
+  Model.reset();
+  Model.compute(UpRunoffVolumes,RunoffVolumes,InfiltVolumes);
+
+  // SU infiltration sums from RS: C = 5, A = 5 + 2, B = 5 + 3
+  const double SUInfiltVolSums[] = {7,8,5,0};
+  const double SURunoffVolDeltas[] = {10,14,12,5};
+  const double SURunoffVolRatios[] = {NaN,NaN,12.0/18,NaN};
+  // SU infiltration ratios: infiltration over incoming runoff of upstream units (6 + 12 for C)
+  const double SUInfiltVolRatios[] = {0,0,5.0/18,0};
+  // normalized runoff volumes * slopes (1, 2.8, 9, 2) and runoff deltas
+  const double SUErosionRisks[] = {0,1.8/8,1,1.0/8};
+  const double SURunoffContribs[] = {5.0/9,1,7.0/9,0};
+  // infiltration ratios of the downstream units to the network: A via L (0.4) and C, B via M (1/7) and C
+  const double SUInfiltVolRatioSums[] = {0.4+5.0/18,1.0/7+5.0/18,0,0};
+  const double SUConnDegrees[] = {1,(1.0/7+5.0/18)/(0.4+5.0/18),0,0};
+
+  for (unsigned int s = 0; s < 4; s++)
+  {
+    CORETEST_CHECK_CLOSE(Model.getSUInfiltVolSums()[s],SUInfiltVolSums[s],Tol);
+    CORETEST_CHECK_CLOSE(Model.getSURunoffVolDeltas()[s],SURunoffVolDeltas[s],Tol);
+    CORETEST_CHECK_CLOSE(Model.getSURunoffVolRatios()[s],SURunoffVolRatios[s],Tol);
+    CORETEST_CHECK_CLOSE(Model.getSUInfiltVolRatios()[s],SUInfiltVolRatios[s],Tol);
+    CORETEST_CHECK_CLOSE(Model.getSUErosionRisks()[s],SUErosionRisks[s],Tol);
+    CORETEST_CHECK_CLOSE(Model.getSURunoffContribs()[s],SURunoffContribs[s],Tol);
+    CORETEST_CHECK_CLOSE(Model.getSUInfiltVolRatioSums()[s],SUInfiltVolRatioSums[s],Tol);
+    CORETEST_CHECK_CLOSE(Model.getSUConnDegrees()[s],SUConnDegrees[s],Tol);
+  }
+
+  // LI by index: L, M. Importance of occupied LI and interest of free LI are single values,
+  // whose normalization is undefined
+  const double LIRunoffVolDeltas[] = {-4,-2};
+  const double LIRunoffVolRatios[] = {-0.4,-2.0/14};
+  const double LIInfiltVolRatios[] = {0.4,2.0/14};
+  const double LIConcDegrees[] = {1,0};
+  const double LIImportanceDegrees[] = {NaN,NaN};
+  const double LIInterestDegrees[] = {NaN,NaN};
+
+  for (unsigned int l = 0; l < 2; l++)
+  {
+    CORETEST_CHECK_CLOSE(Model.getLIRunoffVolDeltas()[l],LIRunoffVolDeltas[l],Tol);
+    CORETEST_CHECK_CLOSE(Model.getLIRunoffVolRatios()[l],LIRunoffVolRatios[l],Tol);
+    CORETEST_CHECK_CLOSE(Model.getLIInfiltVolRatios()[l],LIInfiltVolRatios[l],Tol);
+    CORETEST_CHECK_CLOSE(Model.getLIConcDegrees()[l],LIConcDegrees[l],Tol);
+    CORETEST_CHECK_CLOSE(Model.getLIImportanceDegrees()[l],LIImportanceDegrees[l],Tol);
+    CORETEST_CHECK_CLOSE(Model.getLIInterestDegrees()[l],LIInterestDegrees[l],Tol);
+  }
+
+  // values of the SU then of the LI, as accumulated by the ensemble
+  std::vector<double> Values((4+2)*IndicatorsModel::IndicatorsValuesCount);
+  Model.getIndicatorsValues(Values.data());
+
+  CORETEST_CHECK_CLOSE(Values[2*IndicatorsModel::IndicatorsValuesCount+4],SUErosionRisks[2],Tol);
+  CORETEST_CHECK_CLOSE(Values[(4+1)*IndicatorsModel::IndicatorsValuesCount+3],LIConcDegrees[1],Tol);
+
+  // strided results give the same indicators
+  std::vector<double> Strided[3];
+  const double* Results[3] = {UpRunoffVolumes,RunoffVolumes,InfiltVolumes};
+
+  for (unsigned int r = 0; r < 3; r++)
+  {
+    for (unsigned int i = 0; i < Graph.getUnitsCount(); i++)
+      Strided[r].insert(Strided[r].end(),{Results[r][i],-1.0});
+  }
+
+  Model.reset();
+  Model.compute(Strided[0].data(),Strided[1].data(),Strided[2].data(),2);
+
+  for (unsigned int s = 0; s < 4; s++)
+    CORETEST_CHECK_CLOSE(Model.getSUConnDegrees()[s],SUConnDegrees[s],Tol);
+
+  return FailuresCount ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+/**
+  @file RunoffKernelTest.cpp
+
+  Checks that the batch runoffs computation gives the results of the computation of one water height
+  at a time with a branch, bit for bit, for array lengths around the vector widths and for special water heights
+*/
+
+
+#include <limits>
+
+#include "CoreTestsTools.hpp"
+#include "RunoffKernel.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  @return true if the two arrays hold the same values, NaN values being equal whatever their payload
+*/
+static bool isSameRunoffs(const std::vector<double>& A, const std::vector<double>& B)
+{
+  for (unsigned int i = 0; i < A.size(); i++)
+  {
+    if (std::isnan(A[i]) != std::isnan(B[i]))
+      return false;
+
+    if (!std::isnan(A[i]) && std::memcmp(&A[i],&B[i],sizeof(double)) != 0)
+      return false;
+  }
+
+  return true;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Runoff of a single water height, limited by a branch
+*/
+static double computeRunoff(double WaterHeight, double S)
+{
+  const double A = WaterHeight-0.2*S;
+  double Runoff = (A*A)/(WaterHeight+0.8*S);
+
+  if (Runoff > WaterHeight)
+    Runoff = WaterHeight;
+
+  return Runoff;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+int main()
+{
+  const std::vector<double> SValues = {0.0,0.01,0.0635,0.254};
+  const double Special[] = {0.0,-0.0,-0.01,1e-310,0.2*0.0635,std::numeric_limits<double>::infinity(),
+                            std::numeric_limits<double>::quiet_NaN(),1e300};
+
+  std::srand(7);
+
+  for (unsigned int Count = 0; Count <= 67; Count++)
+  {
+    std::vector<double> WaterHeights(Count);
+
+    for (unsigned int i = 0; i < Count; i++)
+    {
+      if (std::rand()%4 == 0)
+        WaterHeights[i] = Special[std::rand()%(sizeof(Special)/sizeof(double))];
+      else
+        WaterHeights[i] = 0.2*std::rand()/RAND_MAX;
+    }
+
+    for (auto S : SValues)
+    {
+      std::vector<double> Expected(Count);
+      for (unsigned int i = 0; i < Count; i++)
+        Expected[i] = computeRunoff(WaterHeights[i],S);
+
+      std::vector<double> Runoffs(Count);
+      computeRunoffs(WaterHeights.data(),S,Runoffs.data(),Count);
+
+      if (!isSameRunoffs(Runoffs,Expected))
+        std::fprintf(stderr,"batch runoffs differ for %u water heights, S = %g\n",Count,S);
+      CORETEST_CHECK(isSameRunoffs(Runoffs,Expected));
+
+      // in place
+      Runoffs = WaterHeights;
+      computeRunoffs(Runoffs.data(),S,Runoffs.data(),Count);
+      CORETEST_CHECK(isSameRunoffs(Runoffs,Expected));
+    }
+  }
+
+  // runoff of known values, limited to the water height
+  const double S = 0.0635;
+  const double WaterHeights[] = {0.0,0.2*S,0.1,0.01};
+  double Runoffs[4];
+  computeRunoffs(WaterHeights,S,Runoffs,4);
+
+  CORETEST_CHECK_CLOSE(Runoffs[0],0.0,0.0);
+  CORETEST_CHECK_CLOSE(Runoffs[1],0.0,0.0);
+  CORETEST_CHECK_CLOSE(Runoffs[2],(0.1-0.2*S)*(0.1-0.2*S)/(0.1+0.8*S),1e-15);
+  CORETEST_CHECK(Runoffs[3] <= WaterHeights[3]);
+
+  return FailuresCount ? 1 : 0;
+}
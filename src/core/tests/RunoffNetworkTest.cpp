@@ -0,0 +1,253 @@
+/**
+  @file RunoffNetworkTest.cpp
+
+  Checks that the runoff network gives the same results, bit for bit, whether computed serially, on a pool
+  of threads (with the ensemble) or incrementally from changed units, and that the changes of unit parameters of the hydro model
+  give the results of a model built from the changed graph
+*/
+
+
+#include "CoreTestsTools.hpp"
+#include "HydroModel.hpp"
+#include "WorkersPool.hpp"
+
+
+static const unsigned int UnitsCount = 20000;
+
+static const unsigned int ScenariosCount = 3;
+
+static const std::vector<double> LandUsesCN = {70,80,85,93};
+
+
+// =====================================================================
+// =====================================================================
+
+
+static void buildModel(HydroModel& Model, const BVServiceGraph& Graph, const std::vector<double>& CN)
+{
+  std::string Error;
+
+  if (!Model.build(Graph,CN,ScenariosCount,Error))
+  {
+    std::fprintf(stderr,"%s\n",Error.c_str());
+    std::exit(1);
+  }
+
+  std::vector<double>& Rains = Model.network().rains();
+
+  for (unsigned int i = 0; i < Graph.getUnitsCount(); i++)
+  {
+    if (Graph.Classes[i] == SU_CLASS)
+    {
+      for (unsigned int k = 0; k < ScenariosCount; k++)
+        Rains[i*ScenariosCount+k] = 0.01*(k+1)+0.0001*(i%7);
+    }
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+static bool isSameResults(const RunoffNetwork& A, const RunoffNetwork& B)
+{
+  return isSameBits(A.getRunoffVolumes(),B.getRunoffVolumes()) &&
+         isSameBits(A.getUpRunoffVolumes(),B.getUpRunoffVolumes()) &&
+         isSameBits(A.getInfiltrations(),B.getInfiltrations()) &&
+         isSameBits(A.getInfiltVolumes(),B.getInfiltVolumes());
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+static void testSerialVsPool(const BVServiceGraph& Graph)
+{
+  PerturbationDistribution Distri;
+  Distri.parse("normal:2");
+
+  IndicatorsModel Indicators;
+  std::string Error;
+  Indicators.build(Graph,Error);
+
+  HydroModel Serial, Pooled;
+  buildModel(Serial,Graph,LandUsesCN);
+  buildModel(Pooled,Graph,LandUsesCN);
+
+  for (auto Model : {&Serial,&Pooled})
+  {
+    Model->setSensitivities(true);
+    Model->setEnsemble(64,1,Distri,Distri,&Indicators);
+  }
+
+  WorkersPool Pool(4);
+
+  Serial.computeAll(nullptr);
+  Pooled.computeAll(&Pool);
+
+  CORETEST_CHECK(isSameResults(Serial.getNetwork(),Pooled.getNetwork()));
+  CORETEST_CHECK(isSameBits(Serial.getCNSensitivities(),Pooled.getCNSensitivities()));
+  CORETEST_CHECK(isSameBits(Serial.getEnsembleMeans(),Pooled.getEnsembleMeans()));
+  CORETEST_CHECK(isSameBits(Serial.getEnsembleStdDevs(),Pooled.getEnsembleStdDevs()));
+  CORETEST_CHECK(isSameBits(Serial.getEnsembleQuantiles(),Pooled.getEnsembleQuantiles()));
+  CORETEST_CHECK(isSameBits(Serial.getEnsembleIndicatorsMeans(),Pooled.getEnsembleIndicatorsMeans()));
+  CORETEST_CHECK(isSameBits(Serial.getEnsembleIndicatorsQuantiles(),Pooled.getEnsembleIndicatorsQuantiles()));
+
+  // runoff reaches the RS
+  double RSVolume = 0.0;
+  for (unsigned int i = 0; i < UnitsCount; i++)
+  {
+    if (Graph.Classes[i] == RS_CLASS)
+      RSVolume += Serial.getNetwork().getUpRunoffVolumes()[i*ScenariosCount];
+  }
+  CORETEST_CHECK(RSVolume > 0.0);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+static void testDownstreamVsAll(const BVServiceGraph& Graph)
+{
+  HydroModel Incremental, Full;
+  buildModel(Incremental,Graph,LandUsesCN);
+  buildModel(Full,Graph,LandUsesCN);
+
+  Incremental.network().computeAll(nullptr);
+
+  // a rainfall unchanged only computes its unit
+  std::vector<unsigned int> Changed;
+  for (unsigned int i = 0; i < UnitsCount && Changed.empty(); i++)
+  {
+    if (Graph.Classes[i] == SU_CLASS)
+      Changed.push_back(i);
+  }
+  CORETEST_CHECK(Incremental.network().computeDownstream(Changed) == 1);
+
+  // changes of rainfalls of SU and of parameters of LI
+  const RunoffNetwork Saved = Incremental.getNetwork();
+  Changed.clear();
+
+  for (unsigned int i = 0; i < UnitsCount; i += 97)
+  {
+    if (Graph.Classes[i] == SU_CLASS)
+    {
+      for (auto Model : {&Incremental,&Full})
+      {
+        for (unsigned int k = 0; k < ScenariosCount; k++)
+          Model->network().rains()[i*ScenariosCount+k] += 0.005;
+      }
+      Changed.push_back(i);
+    }
+    else if (Graph.Classes[i] == LI_CLASS)
+    {
+      const double Ratios[BVServiceGraph::LISubpartsCount] = {0.3,0.6,0.1};
+
+      for (auto Model : {&Incremental,&Full})
+      {
+        UnitHydroParams Params;
+        Model->setLIParams(Params,Graph.Lengths[i],Ratios);
+        Model->network().setParams(i,Params);
+      }
+      Changed.push_back(i);
+    }
+  }
+
+  std::vector<unsigned int> ComputedRanks;
+  const unsigned int ComputedCount = Incremental.network().computeDownstream(Changed,&ComputedRanks);
+  Full.network().computeAll(nullptr);
+
+  CORETEST_CHECK(ComputedCount == ComputedRanks.size());
+  CORETEST_CHECK(ComputedCount >= Changed.size() && ComputedCount < UnitsCount);
+  CORETEST_CHECK(std::is_sorted(ComputedRanks.begin(),ComputedRanks.end()));
+  CORETEST_CHECK(isSameResults(Incremental.getNetwork(),Full.getNetwork()));
+
+  // copying back the computed units cancels the computation
+  Incremental.network().copyUnits(Saved,ComputedRanks);
+  CORETEST_CHECK(isSameResults(Incremental.getNetwork(),Saved));
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+static void testUnitsChanges(const BVServiceGraph& Graph)
+{
+  PerturbationDistribution Distri;
+  Distri.parse("normal:2");
+
+  HydroModel Changed, Rebuilt;
+  BVServiceGraph ChangedGraph = Graph;
+  std::vector<double> ChangedCN = LandUsesCN;
+
+  buildModel(Changed,Graph,LandUsesCN);
+  Changed.setSensitivities(true);
+  Changed.setEnsemble(50,1,Distri,Distri);
+  Changed.computeAll(nullptr);
+
+  std::vector<unsigned int> ChangedRanks;
+
+  for (unsigned int i = 0; i < UnitsCount; i += 211)
+  {
+    if (Graph.Classes[i] == SU_CLASS)
+    {
+      // the first change of a SU gives it its own land use, the next ones change it
+      Changed.setSUCN(i,55);
+      Changed.setSUCN(i,60+i%7);
+      ChangedCN.push_back(60+i%7);
+      ChangedGraph.LandUses[i] = ChangedCN.size()-1;
+      ChangedRanks.push_back(i);
+    }
+    else if (Graph.Classes[i] == LI_CLASS)
+    {
+      const double Ratios[BVServiceGraph::LISubpartsCount] = {0.5,0.2,0.9};
+
+      Changed.setLIRatios(i,Ratios);
+      std::copy(Ratios,Ratios+BVServiceGraph::LISubpartsCount,
+                &ChangedGraph.Ratios[i*BVServiceGraph::LISubpartsCount]);
+      ChangedRanks.push_back(i);
+    }
+  }
+
+  CORETEST_CHECK(Changed.computeChanged(ChangedRanks,nullptr));
+
+  buildModel(Rebuilt,ChangedGraph,ChangedCN);
+  Rebuilt.setSensitivities(true);
+  Rebuilt.setEnsemble(50,1,Distri,Distri);
+  Rebuilt.computeAll(nullptr);
+
+  CORETEST_CHECK(isSameResults(Changed.getNetwork(),Rebuilt.getNetwork()));
+  CORETEST_CHECK(isSameBits(Changed.getCNSensitivities(),Rebuilt.getCNSensitivities()));
+  CORETEST_CHECK(isSameBits(Changed.getRatiosSensitivities(),Rebuilt.getRatiosSensitivities()));
+  CORETEST_CHECK(isSameBits(Changed.getEnsembleMeans(),Rebuilt.getEnsembleMeans()));
+
+  // sensitivities and ensemble are not computed by default
+  HydroModel Default;
+  buildModel(Default,Graph,LandUsesCN);
+  Default.computeAll(nullptr);
+
+  CORETEST_CHECK(!Default.isSensitivitiesEnabled() && !Default.getEnsembleMembers());
+  CORETEST_CHECK(std::all_of(Default.getCNSensitivities().begin(),Default.getCNSensitivities().end(),
+                             [](double V) { return V == 0.0; }));
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+int main()
+{
+  BVServiceGraph Graph;
+  buildRandomGraph(Graph,UnitsCount,LandUsesCN.size(),3);
+
+  testSerialVsPool(Graph);
+  testDownstreamVsAll(Graph);
+  testUnitsChanges(Graph);
+
+  return FailuresCount ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+/**
+  @file TravelTimeRoutingTest.cpp
+
+  Checks that the travel-time routing conserves the runoff volume reaching each RS, for a single event
+  and for rainfalls added over time, and that the volumes by step sum to the hydrographs
+*/
+
+
+#include "CoreTestsTools.hpp"
+#include "HydroModel.hpp"
+#include "TravelTimeRouting.hpp"
+#include "WorkersPool.hpp"
+
+
+static const unsigned int UnitsCount = 5000;
+
+static const std::vector<double> LandUsesCN = {70,80,85,93};
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Checks that the hydrograph of each RS holds the runoff volume reaching it, summed by windows of the given count
+  of intervals as the volumes by time step
+*/
+static void checkVolumes(const TravelTimeRouting& Routing, const RunoffNetwork& Network, unsigned int Window)
+{
+  const std::vector<unsigned int>& RSRanks = Routing.getRSRanks();
+  double TotalVolume = 0.0;
+
+  for (unsigned int r = 0; r < RSRanks.size(); r++)
+  {
+    const double Expected = Network.getUpRunoffVolumes()[RSRanks[r]*Network.getScenariosCount()];
+
+    double StepsVolume = 0.0;
+    for (unsigned int k = 0; k < Routing.getIntervalsCount(); k += Window)
+      StepsVolume += Routing.getVolume(r,k,k+Window);
+
+    CORETEST_CHECK_CLOSE(Routing.getVolume(r,0,Routing.getIntervalsCount()),Expected,1e-9*Expected);
+    CORETEST_CHECK_CLOSE(StepsVolume,Expected,1e-9*Expected);
+    CORETEST_CHECK(Routing.getVolume(r,Routing.getIntervalsCount(),Routing.getIntervalsCount()+10) == 0.0);
+
+    TotalVolume += Expected;
+  }
+
+  CORETEST_CHECK(TotalVolume > 0.0);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+int main()
+{
+  BVServiceGraph Graph;
+  buildRandomGraph(Graph,UnitsCount,LandUsesCN.size(),5);
+
+  HydroModel Model;
+  std::string Error;
+
+  if (!Model.build(Graph,LandUsesCN,1,Error))
+  {
+    std::fprintf(stderr,"%s\n",Error.c_str());
+    return 1;
+  }
+
+  RunoffNetwork& Network = Model.network();
+  const std::vector<double> Kernel = TravelTimeRouting::getTriangularKernel(1800,60);
+
+  for (unsigned int i = 0; i < UnitsCount; i++)
+  {
+    if (Graph.Classes[i] == SU_CLASS)
+      Network.rains()[i] = 0.02+0.001*(i%5);
+  }
+
+  Network.computeAll(nullptr);
+
+  // single event, with and without pool
+  WorkersPool Pool(3);
+
+  for (WorkersPool* P : {(WorkersPool*)nullptr,&Pool})
+  {
+    TravelTimeRouting Routing;
+    CORETEST_CHECK(Routing.build(Network,Graph.FlowDists,0.5,60,Kernel,0.0,Error));
+
+    Routing.addContributions(Network,0.0,P);
+    checkVolumes(Routing,Network,7);
+  }
+
+  // rainfalls cumulated over an event of 2 hours, added every 20 minutes
+  TravelTimeRouting Routing;
+  CORETEST_CHECK(Routing.build(Network,Graph.FlowDists,0.5,60,Kernel,7200,Error));
+
+  for (unsigned int t = 1200; t <= 7200; t += 1200)
+  {
+    for (unsigned int i = 0; i < UnitsCount; i++)
+    {
+      if (Graph.Classes[i] == SU_CLASS)
+        Network.rains()[i] += 0.004;
+    }
+
+    Network.computeAll(nullptr);
+    Routing.addContributions(Network,t,&Pool);
+  }
+
+  checkVolumes(Routing,Network,20);
+
+  // nothing reaches the RS before the first contributions
+  for (unsigned int r = 0; r < Routing.getRSRanks().size(); r++)
+    CORETEST_CHECK(Routing.getVolume(r,0,20) == 0.0);
+
+  return FailuresCount ? 1 : 0;
+}
@@ -34,6 +34,9 @@ class VarExportInfo
 
     std::string FieldName;
 
+    // index of the exported element for vector variables
+    unsigned long VectorIndex = 0;
+
     VarExportInfo(openfluid::core::Value::Type VT, const openfluid::core::VariableName_t& VN, const std::string& FN) :
       VarType(VT),VarName(VN),FieldName(FN)
     {
@@ -117,7 +120,8 @@ class BVServiceObserver : public openfluid::ware::PluggableObserver
     {
       for (auto& Info : Infos)
       {
-        if (Info.VarType == openfluid::core::Value::Type::DOUBLE)
+        if (Info.VarType == openfluid::core::Value::Type::DOUBLE ||
+            Info.VarType == openfluid::core::Value::Type::VECTOR)
         {
           OGRFieldDefn TmpField(Info.FieldName.c_str(),OFTReal);
           Layer->CreateField(&TmpField);
@@ -150,6 +154,53 @@ class BVServiceObserver : public openfluid::ware::PluggableObserver
           int Value = OPENFLUID_GetLatestVariable(U,Info.VarName).value()->asIntegerValue();
           Feature->SetField(Info.FieldName.c_str(),Value);
         }
+        else if (Info.VarType == openfluid::core::Value::Type::VECTOR)
+        {
+          double Value = OPENFLUID_GetLatestVariable(U,Info.VarName).value()->asVectorValue().at(Info.VectorIndex);
+          if (!std::isnan(Value))
+            Feature->SetField(Info.FieldName.c_str(),Value);
+        }
+      }
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Adds the per-scenario exports of vector variables, named <prefix><scenario number>,
+      when the vector variables have more than one scenario
+    */
+    void addScenariosExports(const openfluid::core::UnitsClass_t& UnitsClass, std::vector<VarExportInfo>& Infos)
+    {
+      const std::vector<std::pair<openfluid::core::VariableName_t,std::string>> ScenariosVars =
+        {
+          {"runoffvolumes","runoffv"},
+          {"uprunoffvolumes","uprunv"}
+        };
+
+      openfluid::core::SpatialUnit* U;
+
+      OPENFLUID_UNITS_ORDERED_LOOP(UnitsClass,U)
+      {
+        for (auto& Var : ScenariosVars)
+        {
+          if (OPENFLUID_IsVariableExist(U,Var.first))
+          {
+            unsigned long ScenariosCount =
+                OPENFLUID_GetLatestVariable(U,Var.first).value()->asVectorValue().getSize();
+
+            for (unsigned long k = 0; ScenariosCount > 1 && k < ScenariosCount; k++)
+            {
+              Infos.emplace_back(openfluid::core::Value::Type::VECTOR,Var.first,Var.second+std::to_string(k+1));
+              Infos.back().VectorIndex = k;
+            }
+          }
+        }
+
+        // all units of a class have the same scenarios, the first unit is enough
+        break;
       }
     }
 
@@ -189,6 +240,9 @@ class BVServiceObserver : public openfluid::ware::PluggableObserver
         VarExportInfo(openfluid::core::Value::Type::DOUBLE,"interestdegree","intdeg")
       };
 
+      addScenariosExports("SU",SUVarsToExport);
+      addScenariosExports("LI",LIVarsToExport);
+
 
 
       OGRRegisterAll();
@@ -357,6 +411,24 @@ class BVServiceObserver : public openfluid::ware::PluggableObserver
           CatchmentRunoffVol += RunoffVol;
         }
 
+        // runoff volumes at catchment scale for each rainfall scenario
+
+        std::vector<double> CatchmentRunoffVols;
+
+        OPENFLUID_UNITS_ORDERED_LOOP("RS",U)
+        {
+          if (OPENFLUID_IsVariableExist(U,"uprunoffvolumes"))
+          {
+            const openfluid::core::VectorValue& RunoffVols =
+                OPENFLUID_GetLatestVariable(U,"uprunoffvolumes").value()->asVectorValue();
+
+            CatchmentRunoffVols.resize(RunoffVols.getSize(),0.0);
+
+            for (unsigned long k = 0; k < RunoffVols.getSize(); k++)
+              CatchmentRunoffVols[k] += RunoffVols.at(k);
+          }
+        }
+
 
         // avoided runoff landcover
 
@@ -387,6 +459,14 @@ class BVServiceObserver : public openfluid::ware::PluggableObserver
         GlobalFile << "  \"catchment_contrib_area\" : " << CatchmentContribArea << ",\n";
         GlobalFile << "  \"rain_volume\" : " << RainVol << ",\n";
         GlobalFile << "  \"catchment_runoff_volume\" : " << CatchmentRunoffVol << ",\n";
+
+        if (CatchmentRunoffVols.size() > 1)
+        {
+          GlobalFile << "  \"catchment_runoff_volumes\" : [";
+          for (unsigned int k = 0; k < CatchmentRunoffVols.size(); k++)
+            GlobalFile << (k ? "," : "") << CatchmentRunoffVols[k];
+          GlobalFile << "],\n";
+        }
         GlobalFile << "  \"catchment_runoff_ratio\" : " << (CatchmentRunoffVol/RainVol) << ",\n";
         GlobalFile << "  \"avoided_runoff_linear_ratio\" : " << (-AvoidedRunoffVolLinear/RainVol) << ",\n";
         GlobalFile << "  \"avoided_runoff_landcover_ratio\" : " << (-AvoidedRunoffVolLandcover/RainVol) << "\n";
@@ -11,14 +11,28 @@
 
 
 #include <fstream>
-#include <regex>
 #include <iterator>
+#include <memory>
+#include <thread>
+#include <functional>
+#include <exception>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <algorithm>
+#include <map>
+#include <atomic>
 
 #include <ogrsf_frmts.h>
 
 #include <openfluid/ware/PluggableSimulator.hpp>
 #include <openfluid/tools/DataHelpers.hpp>
 
+#include "SpatialUnitData.hpp"
+#include "SpatialUnitsStore.hpp"
+#include "SpatialGraphCache.hpp"
+#include "BoundedQueue.hpp"
+
 
 // =====================================================================
 // =====================================================================
@@ -37,6 +51,15 @@ BEGIN_SIMULATOR_SIGNATURE("import.spatial.bvservice")
   DECLARE_REQUIRED_PARAMETER("RSshapefile","Ditches and river segments shapefile name","")
 
   DECLARE_USED_PARAMETER("forceRSconnect","Force subtrees to be connected to network","")
+  DECLARE_USED_PARAMETER("graphcache","Binary cache file of the spatial graph, rebuilt when shapefiles change (not used if empty)","")
+  DECLARE_USED_PARAMETER("parallelimport","Import SU, LI and RS shapefiles concurrently (0 or 1, default is 0)","")
+  DECLARE_USED_PARAMETER("importworkers","Number of threads parsing the features of each shapefile while another "
+                                         "thread reads them (0 for no pipelining, default is 0)","")
+  DECLARE_USED_PARAMETER("streamimport","Low memory import in two passes over the shapefiles, the first one for the topology "
+                                        "and the second one for the creation of units (0 or 1, default is 0). "
+                                        "The graph cache is not used in this mode","")
+  DECLARE_USED_PARAMETER("outlets","Original IDs of the outlets of the sub-catchment to import, separated by ';' "
+                                   "(whole area if empty)","")
 
   DECLARE_UPDATED_UNITSGRAPH("Creation of spatial graph for BVservice process")
   DECLARE_UPDATED_UNITSCLASS("SU","surface units")
@@ -48,6 +71,7 @@ BEGIN_SIMULATOR_SIGNATURE("import.spatial.bvservice")
   DECLARE_PRODUCED_ATTRIBUTE("origtoid","SU","original ID of the downstream unit","")
   DECLARE_PRODUCED_ATTRIBUTE("area","SU","area of the surface unit","m")
   DECLARE_PRODUCED_ATTRIBUTE("landuse","SU","","")
+  DECLARE_PRODUCED_ATTRIBUTE("landuseidx","SU","index of the land use code, the same for all SU having this code","")
   DECLARE_PRODUCED_ATTRIBUTE("slopemin","SU","","")
   DECLARE_PRODUCED_ATTRIBUTE("slopemean","SU","","")
   DECLARE_PRODUCED_ATTRIBUTE("slopemax","SU","","")
@@ -90,49 +114,179 @@ END_SIMULATOR_SIGNATURE
 // =====================================================================
 
 
-class SpatialUnitData
+class AttrImportInfo
 {
   public:
 
-    std::string OrigID;
+    OGRFieldType FieldType;
 
-    std::string OrigToID;
+    std::string FieldName;
 
-    std::string WktGeometry;
+    openfluid::core::AttributeName_t AttrName;
 
-    SpatialUnitData* FromSpatialUnit = nullptr;
 
-    SpatialUnitData* ToSpatialUnit = nullptr;
+    AttrImportInfo(OGRFieldType FT, const std::string& FN, const openfluid::core::AttributeName_t& AN) :
+      FieldType(FT),FieldName(FN),AttrName(AN)
+    { }
+};
+
+
+/**
+  Numerical parts of an original ID, such as SU#12N3 for polygons or LI#12N3-4N1 for lines
+*/
+class OrigIDParts
+{
+  public:
 
-    openfluid::core::UnitClassID_t ClassID;
+    unsigned int NumbersCount = 0;
 
-    openfluid::core::UnitClassID_t ToClassID;
+    std::uint64_t Numbers[4] = {0,0,0,0};
 
-    std::vector<openfluid::core::UnitClassID_t> FromClassID;
 
-    openfluid::core::Attributes Attributes;
+    bool isPolygon() const
+    {
+      return NumbersCount == 2;
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Parses an original ID using a single pass tokenizer, equivalent to the following grammars
+      polygon : [A-Za-z]+#[0-9]+N[0-9]+
+      line : [A-Za-z]+#[0-9]+N[0-9]+-[0-9]+N[0-9]+
+      @param[in] OrigID the original ID to parse
+      @return true if the original ID matches one of the grammars and all numbers fit in 32 bits
+    */
+    bool parse(const std::string& OrigID)
+    {
+      const char* Ptr = OrigID.c_str();
+      const char* End = Ptr+OrigID.size();
+
+      NumbersCount = 0;
+
+      // class name
+      const char* ClassBegin = Ptr;
+      while (Ptr != End && ((*Ptr >= 'A' && *Ptr <= 'Z') || (*Ptr >= 'a' && *Ptr <= 'z')))
+        Ptr++;
+
+      if (Ptr == ClassBegin || Ptr == End || *Ptr != '#')
+        return false;
+      Ptr++;
+
+      // one or two <n>N<m> groups, separated by a dash
+      while (true)
+      {
+        if (!parseNumber(Ptr,End,Numbers[NumbersCount]))
+          return false;
+        NumbersCount++;
 
+        if (Ptr == End || *Ptr != 'N')
+          return false;
+        Ptr++;
+
+        if (!parseNumber(Ptr,End,Numbers[NumbersCount]))
+          return false;
+        NumbersCount++;
+
+        if (Ptr == End)
+          return true;
+
+        if (*Ptr != '-' || NumbersCount == 4)
+          return false;
+        Ptr++;
+      }
+    }
+
+
+  private:
+
+    static bool parseNumber(const char*& Ptr, const char* End, std::uint64_t& Number)
+    {
+      const char* Begin = Ptr;
+      Number = 0;
+
+      while (Ptr != End && *Ptr >= '0' && *Ptr <= '9')
+      {
+        Number = Number*10 + std::uint64_t(*Ptr-'0');
+
+        if (Number > std::numeric_limits<std::uint32_t>::max())
+          return false;
+
+        Ptr++;
+      }
+
+      return (Ptr != Begin);
+    }
 };
 
 
+class FeatureDeleter
+{
+  public:
 
-class AttrImportInfo
+    void operator()(OGRFeature* Feature) const
+    {
+      OGRFeature::DestroyFeature(Feature);
+    }
+};
+
+
+typedef std::unique_ptr<OGRFeature,FeatureDeleter> FeaturePtr_t;
+
+
+/**
+  Counts of units of a class in the spatial graph
+*/
+class ClassDiagnostics
 {
   public:
 
-    OGRFieldType FieldType;
+    unsigned int UnitsCount = 0;
 
-    std::string FieldName;
+    unsigned int OutletsCount = 0;
 
-    openfluid::core::AttributeName_t AttrName;
+    unsigned int LeafsCount = 0;
 
+    // units without upstream nor downstream connection
+    unsigned int OrphansCount = 0;
+};
 
-    AttrImportInfo(OGRFieldType FT, const std::string& FN, const openfluid::core::AttributeName_t& AN) :
-      FieldType(FT),FieldName(FN),AttrName(AN)
-    { }
+
+/**
+  Feature read from a layer, with its rank in the layer
+*/
+class RankedFeature
+{
+  public:
+
+    unsigned int Rank = 0;
+
+    FeaturePtr_t Feature;
 };
 
 
+/**
+  Staged unit built from a feature, with the rank of the feature in the layer
+*/
+class ParsedFeature
+{
+  public:
+
+    unsigned int Rank = 0;
+
+    SpatialUnitData Data;
+
+    OrigIDParts IDParts;
+};
+
+
+// =====================================================================
+// =====================================================================
+
+
 /**
 
 */
@@ -147,13 +301,62 @@ class BVServiceImportSimulator : public openfluid::ware::PluggableSimulator
 
     std::string m_RSshapefile;
 
-    // Map<original ID,data>
-    std::map<std::string,SpatialUnitData> m_SpatialUnitsMap;
+    // staged units, indexed by original ID
+    SpatialUnitsStore m_SpatialUnitsStore;
 
+    bool m_ForceRSConnect = false;
 
-    int m_MinPcsOrd;
+    bool m_ParallelImport = false;
 
-    bool m_ForceRSConnect = false;
+    std::string m_GraphCacheFile;
+
+    std::vector<std::string> m_OutletsOrigIDs;
+
+    unsigned int m_ImportWorkers = 0;
+
+    bool m_StreamImport = false;
+
+    // index of each land use code, in order of first appearance among created SU
+    std::map<std::string,long> m_LandUsesIndices;
+
+    const std::vector<AttrImportInfo> m_SUAttrInfos =
+      {
+        AttrImportInfo(OFTReal,"Surface","area"),
+        AttrImportInfo(OFTString,"LandUse","landuse"),
+        AttrImportInfo(OFTReal,"SlopeMin","slopemin"),
+        AttrImportInfo(OFTReal,"SlopeMean","slopemean"),
+        AttrImportInfo(OFTReal,"SlopeMax","slopemax"),
+        AttrImportInfo(OFTReal,"FlowDist","flowdist")
+      };
+
+    const std::vector<AttrImportInfo> m_LIAttrInfos =
+      {
+        AttrImportInfo(OFTReal,"Length","length"),
+        AttrImportInfo(OFTReal,"FlowDist","flowdist"),
+        AttrImportInfo(OFTReal,"Hedges","hedgesratio"),
+        AttrImportInfo(OFTReal,"GrassBs","grassbsratio"),
+        AttrImportInfo(OFTReal,"Benches","benchesratio"),
+        AttrImportInfo(OFTReal,"HedgesL","hedgeslen"),
+        AttrImportInfo(OFTReal,"GrassBsL","grassbslen"),
+        AttrImportInfo(OFTReal,"BenchesL","bencheslen"),
+        AttrImportInfo(OFTReal,"SurfToLen","surftolen")
+      };
+
+    const std::vector<AttrImportInfo> m_RSAttrInfos =
+      {
+        AttrImportInfo(OFTReal,"Length","length"),
+        AttrImportInfo(OFTReal,"FlowDist","flowdist"),
+        AttrImportInfo(OFTReal,"Ditches","ditchesratio"),
+        AttrImportInfo(OFTReal,"Thalwegs","thalwegsratio"),
+        AttrImportInfo(OFTReal,"WaterCs","watercsratio"),
+        AttrImportInfo(OFTReal,"DitchesL","ditcheslen"),
+        AttrImportInfo(OFTReal,"ThalwegsL","thalwegslen"),
+        AttrImportInfo(OFTReal,"WaterCsL","watercslen"),
+        AttrImportInfo(OFTReal,"SurfToLen","surftolen")
+      };
+
+    // count of features waiting in the pipeline, per worker
+    static const unsigned int FeaturesQueueDepth = 64;
 
 
   public:
@@ -219,116 +422,275 @@ class BVServiceImportSimulator : public openfluid::ware::PluggableSimulator
     // =====================================================================
 
 
-    void importLayer(const std::string& UnitsClass, const std::string& Shapefile,
-                     const std::vector<AttrImportInfo>& AttrInfos, bool Optional = false)
+    /**
+      Finds the fields of IDs and of the given attributes in a layer
+      @param[out] FieldsIndexes the fields indexes, in the order of the attributes infos
+    */
+    void findFields(OGRLayer* Layer, const std::string& UnitsClass, const std::vector<AttrImportInfo>& AttrInfos,
+                    int& IDFldIdx, int& IDToFldIdx, std::vector<int>& FieldsIndexes)
     {
-      std::cout << "Importing file : " << Shapefile << std::endl;
+      // OGRLayer::FindFieldIndex() is not available in GDAL <= 1.10
+      // int IDFldIdx = Layer->FindFieldIndex("ID",true)
+      IDFldIdx = Layer->GetLayerDefn()->GetFieldIndex("ID");
+      if (IDFldIdx  < 0)
+        OPENFLUID_RaiseError("Cannot find ID attribute in "+UnitsClass+" shapefile");
 
-      OGRDataSource* Source = OGRSFDriverRegistrar::Open(Shapefile.c_str(),false);
+      // OGRLayer::FindFieldIndex() is not available in GDAL <= 1.10
+      // int IDToFldIdx = Layer->FindFieldIndex("IDTo",true);
+      IDToFldIdx = Layer->GetLayerDefn()->GetFieldIndex("IDTo");
+      if (IDToFldIdx  < 0)
+        OPENFLUID_RaiseError("Cannot find IDTo attribute in "+UnitsClass+" shapefile");
 
-      if (Source)
-      {
-        OGRLayer* Layer = Source->GetLayer(0);
 
-        // OGRLayer::FindFieldIndex() is not available in GDAL <= 1.10
-        // int IDFldIdx = Layer->FindFieldIndex("ID",true)
-        int IDFldIdx = Layer->GetLayerDefn()->GetFieldIndex("ID");
-        if (IDFldIdx  < 0)
-          OPENFLUID_RaiseError("Cannot find ID attribute in "+UnitsClass+" shapefile");
+      FieldsIndexes.clear();
 
+      for (auto& Info : AttrInfos)
+      {
         // OGRLayer::FindFieldIndex() is not available in GDAL <= 1.10
-        // int IDToFldIdx = Layer->FindFieldIndex("IDTo",true);
-        int IDToFldIdx = Layer->GetLayerDefn()->GetFieldIndex("IDTo");
-        if (IDToFldIdx  < 0)
-          OPENFLUID_RaiseError("Cannot find IDTo attribute in "+UnitsClass+" shapefile");
+        // int AttrFldIdx = Layer->FindFieldIndex(Info.FieldName.c_str(),true);
+        int AttrFldIdx = Layer->GetLayerDefn()->GetFieldIndex(Info.FieldName.c_str());
 
+        if (AttrFldIdx < 0)
+          OPENFLUID_RaiseError("Cannot find "+Info.FieldName+" attribute in "+UnitsClass+" shapefile");
 
-        std::map<std::string,int> FieldsIndexes;
+        if (Layer->GetLayerDefn()->GetFieldDefn(AttrFldIdx)->GetType() != Info.FieldType)
+          OPENFLUID_RaiseError("Field "+Info.FieldName+" attribute is not of type "+
+                               std::string(OGRFieldDefn::GetFieldTypeName(Info.FieldType))+" in "+UnitsClass+" shapefile");
 
-        for (auto& Info : AttrInfos)
-        {
-          // OGRLayer::FindFieldIndex() is not available in GDAL <= 1.10
-          // int AttrFldIdx = Layer->FindFieldIndex(Info.FieldName.c_str(),true);
-          int AttrFldIdx = Layer->GetLayerDefn()->GetFieldIndex(Info.FieldName.c_str());
+        FieldsIndexes.push_back(AttrFldIdx);
+      }
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Builds a staged unit from a feature: parsing of IDs, copy of attributes and transfer of the geometry.
+      The numerical ID of the unit is not set.
+      This is called concurrently by the import workers and must only use the given feature
+    */
+    void parseFeature(const std::string& UnitsClass, FeaturePtr_t Feature, int IDFldIdx, int IDToFldIdx,
+                      const std::vector<AttrImportInfo>& AttrInfos, const std::vector<int>& FieldsIndexes,
+                      SpatialUnitData& Data, OrigIDParts& IDParts)
+    {
+      std::string OrigID(Feature->GetFieldAsString(IDFldIdx));
 
-          if (AttrFldIdx < 0)
-            OPENFLUID_RaiseError("Cannot find "+Info.FieldName+" attribute in "+UnitsClass+" shapefile");
+      if (!IDParts.parse(OrigID))
+        OPENFLUID_RaiseError("ID error ("+OrigID+") in "+UnitsClass+" shapefile");
 
-          if (Layer->GetLayerDefn()->GetFieldDefn(AttrFldIdx)->GetType() != Info.FieldType)
-            OPENFLUID_RaiseError("Field "+Info.FieldName+" attribute is not of type "+
-                                 std::string(OGRFieldDefn::GetFieldTypeName(Info.FieldType))+" in "+UnitsClass+" shapefile");
+      std::string OrigToID(Feature->GetFieldAsString(IDToFldIdx));
+      if (OrigToID == "None")
+        OrigToID.clear();
 
-          FieldsIndexes[Info.FieldName] = AttrFldIdx;
+      Data.OrigID = OrigID;
+      Data.OrigToID = OrigToID;
+      Data.ClassID = {UnitsClass,0};
+
+      for (unsigned int i = 0; i < AttrInfos.size(); i++)
+      {
+        if (AttrInfos[i].FieldType == OFTReal)
+          Data.Attributes.setValue(AttrInfos[i].AttrName,
+                                   openfluid::core::DoubleValue(Feature->GetFieldAsDouble(FieldsIndexes[i])));
+        else if (AttrInfos[i].FieldType == OFTString)
+          Data.Attributes.setValue(AttrInfos[i].AttrName,
+                                   openfluid::core::StringValue(Feature->GetFieldAsString(FieldsIndexes[i])));
+      }
+
+      // the geometry is taken from the feature without copy
+      Data.Geometry.reset(Feature->StealGeometry());
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Imports the features of a layer into the given staging buffer.
+      The staging buffer is owned by the caller so layers can be imported concurrently,
+      the units are merged into the spatial units map by mergeLayer().
+      If TopologyOnly is true, the geometries and the fields other than IDs are not read.
+      Nothing is displayed from here since layers may be imported from worker threads
+    */
+    void importLayer(const std::string& UnitsClass, const std::string& Shapefile,
+                     const std::vector<AttrImportInfo>& AttrInfos, std::vector<SpatialUnitData>& LayerData,
+                     bool TopologyOnly, bool Optional = false)
+    {
+      OGRDataSource* Source = OGRSFDriverRegistrar::Open(Shapefile.c_str(),false);
+
+      if (Source)
+      {
+        OGRLayer* Layer = Source->GetLayer(0);
+
+        int IDFldIdx, IDToFldIdx;
+        std::vector<int> FieldsIndexes;
+        findFields(Layer,UnitsClass,AttrInfos,IDFldIdx,IDToFldIdx,FieldsIndexes);
+
+        if (TopologyOnly)
+        {
+          std::vector<const char*> IgnoredFields;
+
+          for (int i = 0; i < Layer->GetLayerDefn()->GetFieldCount(); i++)
+          {
+            if (i != IDFldIdx && i != IDToFldIdx)
+              IgnoredFields.push_back(Layer->GetLayerDefn()->GetFieldDefn(i)->GetNameRef());
+          }
+          IgnoredFields.push_back("OGR_GEOMETRY");
+          IgnoredFields.push_back(nullptr);
+
+          Layer->SetIgnoredFields(IgnoredFields.data());
         }
 
-        OGRFeature* Feature = nullptr;
         Layer->ResetReading();
 
-        unsigned int IncUnitID = 1;
-        while ((Feature = Layer->GetNextFeature()) != nullptr)
+        // numerical IDs of polygons are encoded and checked against each other once the whole layer is read
+        std::vector<OrigIDParts> LayerIDsParts;
+
+        GIntBig FeaturesCount = Layer->GetFeatureCount();
+        if (FeaturesCount > 0)
         {
-          std::string OrigID(Feature->GetFieldAsString(IDFldIdx));
+          LayerData.reserve(FeaturesCount);
+          LayerIDsParts.reserve(FeaturesCount);
+        }
 
-          if (m_SpatialUnitsMap.find(OrigID) != m_SpatialUnitsMap.end())
-            OPENFLUID_RaiseError("Duplicate entity "+OrigID);
+        auto ParseFeature = [&](FeaturePtr_t Feature, unsigned int Rank, SpatialUnitData& Data, OrigIDParts& IDParts)
+        {
+          parseFeature(UnitsClass,std::move(Feature),IDFldIdx,IDToFldIdx,AttrInfos,FieldsIndexes,Data,IDParts);
 
-          std::string OrigToID(Feature->GetFieldAsString(IDToFldIdx));
-          if (OrigToID == "None")
-            OrigToID.clear();
+          // numerical IDs of lines are the ranks of the features in the layer, as they always were:
+          // the four numbers of their original IDs do not fit in an OpenFLUID unit ID
+          Data.ClassID.second = Rank+1;
+        };
 
+        if (m_ImportWorkers == 0)
+        {
+          OGRFeature* Feature = nullptr;
 
-          // polygon : [A-Za-z]+\#[0-9]+N[0-9]+
-          // line : [A-Za-z]+\#[0-9]+N[0-9]+-#[0-9]+N[0-9]+
+          while ((Feature = Layer->GetNextFeature()) != nullptr)
+          {
+            LayerData.emplace_back();
+            LayerIDsParts.emplace_back();
+            ParseFeature(FeaturePtr_t(Feature),LayerData.size()-1,LayerData.back(),LayerIDsParts.back());
+          }
+        }
+        else
+        {
+          // features are read by this thread and parsed by the workers, then put back in layer order
+          BoundedQueue<RankedFeature> Queue(m_ImportWorkers*FeaturesQueueDepth);
+          std::vector<std::vector<ParsedFeature>> WorkersResults(m_ImportWorkers);
+          std::vector<std::exception_ptr> WorkersErrors(m_ImportWorkers);
+          std::vector<unsigned int> WorkersErrorsRanks(m_ImportWorkers,0);
+          std::atomic<bool> Failed(false);
+          std::vector<std::thread> Workers;
+
+          for (unsigned int w = 0; w < m_ImportWorkers; w++)
+          {
+            Workers.emplace_back([&,w]()
+            {
+              RankedFeature Item;
+
+              while (Queue.pop(Item))
+              {
+                try
+                {
+                  WorkersResults[w].emplace_back();
+                  ParsedFeature& Parsed = WorkersResults[w].back();
+                  Parsed.Rank = Item.Rank;
+                  ParseFeature(std::move(Item.Feature),Item.Rank,Parsed.Data,Parsed.IDParts);
+                }
+                catch (...)
+                {
+                  // the features preceding the failed one are still parsed,
+                  // so the reported error is the one of the first failed feature as in sequential mode
+                  if (!WorkersErrors[w] || Item.Rank < WorkersErrorsRanks[w])
+                  {
+                    WorkersErrors[w] = std::current_exception();
+                    WorkersErrorsRanks[w] = Item.Rank;
+                  }
+                  Failed = true;
+                }
+              }
+            });
+          }
 
-//          std::regex("[A-Za-z]+\#[0-9]+N[0-9]+");
-          unsigned int UnitID = IncUnitID;//
-          std::smatch MatchRes;
+          OGRFeature* Feature = nullptr;
+          unsigned int Rank = 0;
 
-          if (std::regex_match(OrigID, MatchRes, std::regex("[A-Za-z]+#[0-9]+N[0-9]+")))
+          while (!Failed && (Feature = Layer->GetNextFeature()) != nullptr)
           {
-            std::vector<std::string> StrParts = openfluid::tools::splitString(OrigID,"#");
-            StrParts = openfluid::tools::splitString(StrParts[1],"N");
+            RankedFeature Item;
+            Item.Rank = Rank++;
+            Item.Feature.reset(Feature);
+            Queue.push(std::move(Item));
+          }
 
-            UnitID = std::stoi(StrParts[0])*100 + std::stoi(StrParts[1]);
-            // std::cout << "SU ID : "  << OrigID << " -> " << UnitID << std::endl;
+          Queue.close();
 
+          for (auto& Worker : Workers)
+            Worker.join();
+
+          if (Failed)
+          {
+            unsigned int FirstError = 0;
+            for (unsigned int w = 0; w < m_ImportWorkers; w++)
+            {
+              if (WorkersErrors[w] && (!WorkersErrors[FirstError] || WorkersErrorsRanks[w] < WorkersErrorsRanks[FirstError]))
+                FirstError = w;
+            }
+
+            OGRDataSource::DestroyDataSource(Source);
+            std::rethrow_exception(WorkersErrors[FirstError]);
           }
-          else if (std::regex_match(OrigID, MatchRes, std::regex("[A-Za-z]+#[0-9]+N[0-9]+-[0-9]+N[0-9]+")))
+
+          LayerData.resize(Rank);
+          LayerIDsParts.resize(Rank);
+
+          for (auto& Results : WorkersResults)
           {
-            /* // for numerical ID based on original ID
-            std::vector<std::string> StrParts = openfluid::tools::splitString(OrigID,"#");
-            StrParts = openfluid::tools::splitString(StrParts[1],"N-");
-
-            UnitID = std::stoi(StrParts[0])*std::pow(100,3) +
-                     std::stoi(StrParts[1])*std::pow(100,2) +
-                     std::stoi(StrParts[2])*100 +
-                     std::stoi(StrParts[3]);
-                     */
-            // std::cout << "LI ID : "  << OrigID << " -> " << UnitID << std::endl;
+            for (auto& Parsed : Results)
+            {
+              LayerData[Parsed.Rank] = std::move(Parsed.Data);
+              LayerIDsParts[Parsed.Rank] = Parsed.IDParts;
+            }
           }
-          else
-            OPENFLUID_RaiseError("ID error ("+OrigID+") in "+UnitsClass+" shapefile");
+        }
 
-          m_SpatialUnitsMap[OrigID].OrigID = OrigID;
-          m_SpatialUnitsMap[OrigID].OrigToID = OrigToID;
-          m_SpatialUnitsMap[OrigID].ClassID = {UnitsClass,UnitID};
+        // numerical IDs of polygons are <n>*100+<m>, so they do not depend on the other features of the layer
+        const std::uint64_t Multiplier = 100;
 
-          char* WktBuffer = nullptr;
-          Feature->GetGeometryRef()->exportToWkt(&WktBuffer);
-          m_SpatialUnitsMap[OrigID].WktGeometry = std::string(WktBuffer);
-          OGRFree(WktBuffer);
+        // original IDs by numerical ID
+        std::unordered_map<openfluid::core::UnitID_t,const std::string*> UsedUnitIDs;
+        UsedUnitIDs.reserve(LayerData.size());
 
+        for (unsigned int i = 0; i < LayerData.size(); i++)
+        {
+          SpatialUnitData& Data = LayerData[i];
 
-          for (auto& Info : AttrInfos)
+          if (LayerIDsParts[i].isPolygon())
           {
-            if (Info.FieldType == OFTReal)
-              m_SpatialUnitsMap[OrigID].Attributes.setValue(Info.AttrName,openfluid::core::DoubleValue(Feature->GetFieldAsDouble(FieldsIndexes[Info.FieldName])));
-            else if (Info.FieldType == OFTString)
-              m_SpatialUnitsMap[OrigID].Attributes.setValue(Info.AttrName,openfluid::core::StringValue(Feature->GetFieldAsString(FieldsIndexes[Info.FieldName])));
-          }
+            const std::uint64_t MaxUnitID = std::numeric_limits<openfluid::core::UnitID_t>::max();
+            const std::uint64_t* Numbers = LayerIDsParts[i].Numbers;
 
+            if (Numbers[1] >= Multiplier)
+              OPENFLUID_RaiseError("ID error ("+Data.OrigID+") in "+UnitsClass+" shapefile : "
+                                   "the number after N must be less than 100");
 
-          IncUnitID++;
+            // checked before computing so the encoding cannot wrap around
+            if (Numbers[0] > (MaxUnitID - Numbers[1]) / Multiplier)
+              OPENFLUID_RaiseError("ID error ("+Data.OrigID+") in "+UnitsClass+" shapefile : "
+                                   "numerical ID is out of range");
+
+            Data.ClassID.second = openfluid::core::UnitID_t(Numbers[0]*Multiplier + Numbers[1]);
+          }
+
+          // same numbers written differently (e.g. SU#01N2 and SU#1N2) or polygons mixed with lines
+          // would be merged into a single unit
+          auto Inserted = UsedUnitIDs.emplace(Data.ClassID.second,&Data.OrigID);
+          if (!Inserted.second)
+            OPENFLUID_RaiseError("Entities "+*Inserted.first->second+" and "+Data.OrigID+" in "+UnitsClass+
+                                 " shapefile have the same numerical ID "+std::to_string(Data.ClassID.second));
         }
       }
       else
@@ -345,49 +707,343 @@ class BVServiceImportSimulator : public openfluid::ware::PluggableSimulator
     // =====================================================================
 
 
-    void computeProcessOrderRecursively(openfluid::core::SpatialUnit* U, int PcsOrd)
+    /**
+      Moves the units of a staging buffer into the spatial units store, the staging buffer is emptied
+    */
+    void mergeLayer(std::vector<SpatialUnitData>& LayerData)
     {
-      // postfixed depth-first search to process leafs first and go back to root
+      for (auto& Data : LayerData)
+      {
+        std::string OrigID = Data.OrigID;
+
+        if (m_SpatialUnitsStore.insert(std::move(Data)) == NoSpatialUnitIndex)
+          OPENFLUID_RaiseError("Duplicate entity "+OrigID);
+      }
+
+      LayerData.clear();
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Moves an imported geometry into the given spatial unit.
+      Rings of polygons and parts of multi-geometries are moved without copy and points of lines are copied
+      as binary coordinates. Other geometry types are transferred through WKT, as this is the only import format
+      of spatial units.
+      The imported geometry is released once transferred.
+    */
+    static void transferGeometry(GeometryPtr_t& Geom, openfluid::core::SpatialUnit* U)
+    {
+      if (!Geom)
+        return;
+
+      OGRwkbGeometryType GeomType = wkbFlatten(Geom->getGeometryType());
+
+      if (GeomType == wkbPolygon)
+      {
+        U->importGeometryFromWkt("POLYGON EMPTY");
+        OGRPolygon* DestPoly = dynamic_cast<OGRPolygon*>(U->geometry());
+
+        if (DestPoly)
+        {
+          OGRPolygon* SrcPoly = static_cast<OGRPolygon*>(Geom.get());
+          int InteriorCount = SrcPoly->getNumInteriorRings();
+
+          OGRLinearRing* Ring = SrcPoly->stealExteriorRing();
+          if (Ring)
+            DestPoly->addRingDirectly(Ring);
+
+          for (int i = 0; i < InteriorCount; i++)
+          {
+            Ring = SrcPoly->stealInteriorRing(i);
+            if (Ring)
+              DestPoly->addRingDirectly(Ring);
+          }
+
+          Geom.reset();
+          return;
+        }
+      }
+      else if (GeomType == wkbMultiPolygon || GeomType == wkbMultiLineString)
+      {
+        U->importGeometryFromWkt(GeomType == wkbMultiPolygon ? "MULTIPOLYGON EMPTY" : "MULTILINESTRING EMPTY");
+        OGRGeometryCollection* DestColl = dynamic_cast<OGRGeometryCollection*>(U->geometry());
+
+        if (DestColl)
+        {
+          OGRGeometryCollection* SrcColl = static_cast<OGRGeometryCollection*>(Geom.get());
+          std::vector<OGRGeometry*> Parts(SrcColl->getNumGeometries(),nullptr);
+
+          // parts are detached from the last one to avoid shifting the remaining parts
+          for (int i = int(Parts.size())-1; i >= 0; i--)
+          {
+            Parts[i] = SrcColl->getGeometryRef(i);
+            SrcColl->removeGeometry(i,false);
+          }
+
+          for (auto Part : Parts)
+            DestColl->addGeometryDirectly(Part);
+
+          Geom.reset();
+          return;
+        }
+      }
+      else if (GeomType == wkbLineString)
+      {
+        U->importGeometryFromWkt("LINESTRING EMPTY");
+        OGRLineString* DestLine = dynamic_cast<OGRLineString*>(U->geometry());
+
+        if (DestLine)
+        {
+          OGRLineString* SrcLine = static_cast<OGRLineString*>(Geom.get());
+          std::vector<OGRRawPoint> Points(SrcLine->getNumPoints());
+
+          if (!Points.empty())
+          {
+            SrcLine->getPoints(Points.data());
+            DestLine->setPoints(int(Points.size()),Points.data());
+          }
+
+          Geom.reset();
+          return;
+        }
+      }
+
+      // fallback through WKT
+      char* WktBuffer = nullptr;
+      Geom->exportToWkt(&WktBuffer);
+      U->importGeometryFromWkt(std::string(WktBuffer));
+      OGRFree(WktBuffer);
+
+      Geom.reset();
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Creates the spatial unit of a staged unit, with its attributes and geometry
+    */
+    void createUnit(SpatialUnitData& Ent)
+    {
+      OPENFLUID_AddUnit(Ent.ClassID.first,Ent.ClassID.second,Ent.ProcessOrder);
+
+      openfluid::core::SpatialUnit* U = OPENFLUID_GetUnit(Ent.ClassID.first,Ent.ClassID.second);
+
+      if (U)
+      {
+        transferGeometry(Ent.Geometry,U);
+
+        OPENFLUID_SetAttribute(U,"origid",Ent.OrigID);
+        OPENFLUID_SetAttribute(U,"origtoid",Ent.OrigToID);
+
+        for (auto& Attr : Ent.Attributes.getAttributesNames())
+        {
+          OPENFLUID_SetAttribute(U,Attr,*(Ent.Attributes.value(Attr)));
+        }
+
+        // land uses are dictionary-encoded, so simulators map each distinct code once
+        const openfluid::core::Value* LandUse = Ent.Attributes.value("landuse");
+
+        if (Ent.ClassID.first == "SU" && LandUse)
+        {
+          auto itIndex = m_LandUsesIndices.insert({LandUse->toString(),long(m_LandUsesIndices.size())}).first;
+          OPENFLUID_SetAttribute(U,"landuseidx",itIndex->second);
+        }
+      }
+    }
+
+
+    // =====================================================================
+    // =====================================================================
 
-     /*OPENFLUID_DisplayInfo("PcsOrd : entering unit " << U->getClass() << "#" << U->getID());*/
 
-      std::set<openfluid::core::SpatialUnit*> UpperUnits;
+    /**
+      Second pass of the streaming import: reads again the features of a layer and creates
+      the spatial units of the staged topology, one feature at a time.
+      Features which are not in the staged topology (orphaned or outside of the sub-catchment) are skipped
+    */
+    void createUnitsFromLayer(const std::string& UnitsClass, const std::string& Shapefile,
+                              const std::vector<AttrImportInfo>& AttrInfos, bool Optional = false)
+    {
+      OGRDataSource* Source = OGRSFDriverRegistrar::Open(Shapefile.c_str(),false);
 
-      openfluid::core::UnitsPtrList_t* TmpUpperList;
-      TmpUpperList = U->fromSpatialUnits("SU");
-      if (TmpUpperList != nullptr)
+      if (!Source)
       {
-        for (auto TmpU : *TmpUpperList)
-          UpperUnits.insert(TmpU);
+        if (!Optional)
+          OPENFLUID_RaiseError("Cannot open "+UnitsClass+" shapefile " + Shapefile);
+        return;
       }
 
+      OGRLayer* Layer = Source->GetLayer(0);
+
+      int IDFldIdx, IDToFldIdx;
+      std::vector<int> FieldsIndexes;
+      findFields(Layer,UnitsClass,AttrInfos,IDFldIdx,IDToFldIdx,FieldsIndexes);
+
+      Layer->ResetReading();
+
+      OGRFeature* Feature = nullptr;
 
-      TmpUpperList = U->fromSpatialUnits("LI");
-      if (TmpUpperList != nullptr)
+      while ((Feature = Layer->GetNextFeature()) != nullptr)
       {
-        for (auto TmpU : *TmpUpperList)
-          UpperUnits.insert(TmpU);
+        FeaturePtr_t FeaturePtr(Feature);
+
+        unsigned int Index = m_SpatialUnitsStore.find(Feature->GetFieldAsString(IDFldIdx));
+
+        if (Index != NoSpatialUnitIndex)
+        {
+          SpatialUnitData& Staged = m_SpatialUnitsStore[Index];
+
+          SpatialUnitData Data;
+          OrigIDParts IDParts;
+          parseFeature(UnitsClass,std::move(FeaturePtr),IDFldIdx,IDToFldIdx,AttrInfos,FieldsIndexes,Data,IDParts);
+
+          Data.ClassID = Staged.ClassID;
+          Data.ProcessOrder = Staged.ProcessOrder;
+
+          for (auto& Attr : Staged.Attributes.getAttributesNames())
+            Data.Attributes.setValue(Attr,*(Staged.Attributes.value(Attr)));
+
+          createUnit(Data);
+        }
       }
 
+      OGRDataSource::DestroyDataSource(Source);
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Checks the staged spatial graph in a single pass over the to connections, before process orders are computed.
+      As each unit has at most one downstream unit, each unit is visited once by following the downstream paths.
+      Displays the counts of units, outlets, leafs and orphans per class and the length of the longest flow path,
+      then raises an error listing the loops if any
+      @param[in] RemovedLIOrphansCount the count of orphaned LI already removed from the staged graph,
+                 added to the LI orphans
+    */
+    void checkSpatialGraph(unsigned int RemovedLIOrphansCount)
+    {
+      const unsigned int MaxReportedLoops = 10;
+      const unsigned int MaxReportedLoopLength = 20;
 
-      openfluid::core::SpatialUnit* UpU = nullptr;
+      enum VisitState : unsigned char { NOT_VISITED, ON_PATH, VISITED };
 
-      // --- go to leafs recursively
-      if (!UpperUnits.empty()) //if UpperUnits not empty, upstream Units are present
+      const unsigned int UnitsCount = m_SpatialUnitsStore.size();
+      std::vector<VisitState> States(UnitsCount,NOT_VISITED);
+      // count of units from each unit to its outlet, loops excluded
+      std::vector<unsigned int> Depths(UnitsCount,0);
+      std::vector<unsigned int> Path;
+      std::vector<std::vector<unsigned int>> Loops;
+      unsigned int LoopsCount = 0;
+      unsigned int MaxDepth = 0;
+
+      for (unsigned int i = 0; i < UnitsCount; i++)
       {
-        for(auto UpU : UpperUnits) // loop for each upstream unit
+        if (States[i] != NOT_VISITED)
+          continue;
+
+        Path.clear();
+        unsigned int Current = i;
+
+        while (Current != NoSpatialUnitIndex && States[Current] == NOT_VISITED)
+        {
+          States[Current] = ON_PATH;
+          Path.push_back(Current);
+          Current = m_SpatialUnitsStore[Current].ToSpatialUnit;
+        }
+
+        unsigned int Depth = 0;
+
+        if (Current != NoSpatialUnitIndex && States[Current] == ON_PATH)
         {
-          computeProcessOrderRecursively(UpU,PcsOrd-1);
+          // the path reached itself, its end from Current is a loop
+          auto LoopBegin = std::find(Path.begin(),Path.end(),Current);
+
+          if (LoopsCount < MaxReportedLoops)
+            Loops.emplace_back(LoopBegin,Path.end());
+          LoopsCount++;
+
+          for (auto it = LoopBegin; it != Path.end(); ++it)
+            States[*it] = VISITED;
+
+          Path.erase(LoopBegin,Path.end());
         }
+        else if (Current != NoSpatialUnitIndex)
+          Depth = Depths[Current];
+
+        for (auto it = Path.rbegin(); it != Path.rend(); ++it)
+        {
+          Depth++;
+          Depths[*it] = Depth;
+          States[*it] = VISITED;
+        }
+
+        MaxDepth = std::max(MaxDepth,Depth);
       }
 
 
-      /*OPENFLUID_DisplayInfo("PcsOrd : processing unit " << U->getClass() << "#" << U->getID());*/
+      std::map<std::string,ClassDiagnostics> ClassesDiags;
+
+      for (auto& Ent : m_SpatialUnitsStore)
+      {
+        ClassDiagnostics& Diag = ClassesDiags[Ent.ClassID.first];
+
+        Diag.UnitsCount++;
+
+        if (Ent.ToSpatialUnit == NoSpatialUnitIndex)
+          Diag.OutletsCount++;
+
+        if (Ent.FromSpatialUnit == NoSpatialUnitIndex)
+          Diag.LeafsCount++;
+
+        if (Ent.ToSpatialUnit == NoSpatialUnitIndex && Ent.FromSpatialUnit == NoSpatialUnitIndex)
+          Diag.OrphansCount++;
+      }
+
+      if (RemovedLIOrphansCount)
+        ClassesDiags["LI"].OrphansCount += RemovedLIOrphansCount;
+
+      for (auto& Diag : ClassesDiags)
+      {
+        OPENFLUID_DisplayInfo(Diag.first << " : " << Diag.second.UnitsCount << " units, " <<
+                              Diag.second.OutletsCount << " outlets, " << Diag.second.LeafsCount << " leafs, " <<
+                              Diag.second.OrphansCount << " orphans");
+      }
+
+      OPENFLUID_DisplayInfo("Longest flow path : " << MaxDepth << " units");
+
+
+      if (LoopsCount)
+      {
+        std::string Report = std::to_string(LoopsCount)+" loop(s) detected in spatial graph";
+
+        for (auto& Loop : Loops)
+        {
+          Report += "\n  ";
+
+          for (unsigned int l = 0; l < Loop.size() && l < MaxReportedLoopLength; l++)
+            Report += m_SpatialUnitsStore[Loop[l]].OrigID+" -> ";
 
-      U->setProcessOrder(PcsOrd);
+          if (Loop.size() > MaxReportedLoopLength)
+            Report += "... -> ";
 
-      m_MinPcsOrd = std::min(m_MinPcsOrd,PcsOrd);
+          Report += m_SpatialUnitsStore[Loop.front()].OrigID;
+        }
+
+        if (LoopsCount > Loops.size())
+          Report += "\n  ...";
 
+        OPENFLUID_RaiseError(Report);
+      }
     }
 
 
@@ -395,15 +1051,55 @@ class BVServiceImportSimulator : public openfluid::ware::PluggableSimulator
     // =====================================================================
 
 
-    void initParams(const openfluid::ware::WareParams_t& Params)
+    /**
+      Computes process orders of staged spatial units in a single pass over the from/to connections.
+      Leafs get the process order 1 and each other unit gets the highest process order of its upstream units plus one,
+      so each unit and each connection is visited exactly once (Kahn algorithm)
+    */
+    void computeProcessOrders()
     {
-      OPENFLUID_GetSimulatorParameter(Params,"SUshapefile",m_SUshapefile);
-      OPENFLUID_GetSimulatorParameter(Params,"LIshapefile",m_LIshapefile);
-      OPENFLUID_GetSimulatorParameter(Params,"RSshapefile",m_RSshapefile);
+      std::vector<unsigned int> ReadyUnits;
+      unsigned int ProcessedCount = 0;
 
-      long Force = 0;
-//      OPENFLUID_GetSimulatorParameter(Params,"forceRSconnect",Force);
-      m_ForceRSConnect = Force;
+      for (auto& Ent : m_SpatialUnitsStore)
+      {
+        Ent.ProcessOrder = 1;
+        Ent.PendingFromCount = 0;
+      }
+
+      for (auto& Ent : m_SpatialUnitsStore)
+      {
+        if (Ent.ToSpatialUnit != NoSpatialUnitIndex)
+          m_SpatialUnitsStore[Ent.ToSpatialUnit].PendingFromCount++;
+      }
+
+      for (unsigned int i = 0; i < m_SpatialUnitsStore.size(); i++)
+      {
+        if (m_SpatialUnitsStore[i].PendingFromCount == 0)
+          ReadyUnits.push_back(i);
+      }
+
+      while (!ReadyUnits.empty())
+      {
+        SpatialUnitData& CurrentEnt = m_SpatialUnitsStore[ReadyUnits.back()];
+        ReadyUnits.pop_back();
+        ProcessedCount++;
+
+        if (CurrentEnt.ToSpatialUnit != NoSpatialUnitIndex)
+        {
+          SpatialUnitData& ToEnt = m_SpatialUnitsStore[CurrentEnt.ToSpatialUnit];
+
+          ToEnt.ProcessOrder = std::max(ToEnt.ProcessOrder,CurrentEnt.ProcessOrder+1);
+          ToEnt.PendingFromCount--;
+
+          // all upstream units of the downstream unit are processed, its process order is final
+          if (ToEnt.PendingFromCount == 0)
+            ReadyUnits.push_back(CurrentEnt.ToSpatialUnit);
+        }
+      }
+
+      if (ProcessedCount != m_SpatialUnitsStore.size())
+        OPENFLUID_RaiseError("Loop detected in spatial graph, process orders cannot be computed");
     }
 
 
@@ -411,179 +1107,356 @@ class BVServiceImportSimulator : public openfluid::ware::PluggableSimulator
     // =====================================================================
 
 
-    void prepareData()
+    /**
+      Imports the layers and builds the staged spatial graph: connections, outlets and leafs,
+      removal of orphaned LI and process orders
+      @param[in] TopologyOnly if true, only IDs are imported, without attributes and geometries
+    */
+    void buildSpatialGraph(bool TopologyOnly)
     {
+      // staging buffers, one per layer
+      std::vector<SpatialUnitData> SUData, LIData, RSData;
 
-      OGRRegisterAll();
+      // only IDs are read for the topology
+      const std::vector<AttrImportInfo> NoAttrInfos;
 
+      std::vector<std::function<void()>> LayersImports =
+        {
+          [&]() { importLayer("SU",m_SUshapefile,TopologyOnly ? NoAttrInfos : m_SUAttrInfos,SUData,TopologyOnly); },
+          [&]() { importLayer("LI",m_LIshapefile,TopologyOnly ? NoAttrInfos : m_LIAttrInfos,LIData,TopologyOnly); },
+          [&]() { importLayer("RS",m_RSshapefile,TopologyOnly ? NoAttrInfos : m_RSAttrInfos,RSData,TopologyOnly,true); }
+        };
 
-      if (m_SUshapefile.empty())
-        OPENFLUID_RaiseError("SU shapefile path is empty");
+      const std::vector<std::string> LayersFiles = {m_SUshapefile,m_LIshapefile,m_RSshapefile};
 
-      if (m_LIshapefile.empty())
-        OPENFLUID_RaiseError("LI shapefile path is empty");
+      if (m_ParallelImport)
+      {
+        // files are displayed from the calling thread, before the concurrent imports
+        for (auto& File : LayersFiles)
+          OPENFLUID_DisplayInfo("Importing file : " << File);
 
-/*      if (m_RSshapefile.empty())
-        OPENFLUID_RaiseError("RS shapefile path is empty");*/
+        // each layer has its own file and datasource, they are read concurrently
+        std::vector<std::thread> ImportThreads;
+        std::vector<std::exception_ptr> ImportErrors(LayersImports.size());
+
+        for (unsigned int i = 0; i < LayersImports.size(); i++)
+        {
+          ImportThreads.emplace_back([&LayersImports,&ImportErrors,i]()
+          {
+            try
+            {
+              LayersImports[i]();
+            }
+            catch (...)
+            {
+              ImportErrors[i] = std::current_exception();
+            }
+          });
+        }
 
+        for (auto& Thread : ImportThreads)
+          Thread.join();
 
-      importLayer("SU",m_SUshapefile,
-                  {
-                    AttrImportInfo(OFTReal,"Surface","area"),
-                    AttrImportInfo(OFTString,"LandUse","landuse"),
-                    AttrImportInfo(OFTReal,"SlopeMin","slopemin"),
-                    AttrImportInfo(OFTReal,"SlopeMean","slopemean"),
-                    AttrImportInfo(OFTReal,"SlopeMax","slopemax"),
-                    AttrImportInfo(OFTReal,"FlowDist","flowdist")
-                  });
-
-      importLayer("LI",m_LIshapefile,
-                  {
-                    AttrImportInfo(OFTReal,"Length","length"),
-                    AttrImportInfo(OFTReal,"FlowDist","flowdist"),
-                    AttrImportInfo(OFTReal,"Hedges","hedgesratio"),
-                    AttrImportInfo(OFTReal,"GrassBs","grassbsratio"),
-                    AttrImportInfo(OFTReal,"Benches","benchesratio"),
-                    AttrImportInfo(OFTReal,"HedgesL","hedgeslen"),
-                    AttrImportInfo(OFTReal,"GrassBsL","grassbslen"),
-                    AttrImportInfo(OFTReal,"BenchesL","bencheslen"),
-                    AttrImportInfo(OFTReal,"SurfToLen","surftolen")
-                  });
-      importLayer("RS",m_RSshapefile,
-                  {
-                    AttrImportInfo(OFTReal,"Length","length"),
-                    AttrImportInfo(OFTReal,"FlowDist","flowdist"),
-                    AttrImportInfo(OFTReal,"Ditches","ditchesratio"),
-                    AttrImportInfo(OFTReal,"Thalwegs","thalwegsratio"),
-                    AttrImportInfo(OFTReal,"WaterCs","watercsratio"),
-                    AttrImportInfo(OFTReal,"DitchesL","ditcheslen"),
-                    AttrImportInfo(OFTReal,"ThalwegsL","thalwegslen"),
-                    AttrImportInfo(OFTReal,"WaterCsL","watercslen"),
-                    AttrImportInfo(OFTReal,"SurfToLen","surftolen")
-                  },
-                  true);
+        // errors are reported in layers order, whatever the thread which raised it first
+        for (auto& Error : ImportErrors)
+        {
+          if (Error)
+            std::rethrow_exception(Error);
+        }
+      }
+      else
+      {
+        for (unsigned int i = 0; i < LayersImports.size(); i++)
+        {
+          OPENFLUID_DisplayInfo("Importing file : " << LayersFiles[i]);
+          LayersImports[i]();
+        }
+      }
+
+      // merge in a fixed order so the result does not depend on the import mode
+      m_SpatialUnitsStore.reserve(SUData.size()+LIData.size()+RSData.size());
+      mergeLayer(SUData);
+      mergeLayer(LIData);
+      mergeLayer(RSData);
 
 
-     // Rebuild of map connections
-      for (auto itEnt = m_SpatialUnitsMap.begin(); itEnt != m_SpatialUnitsMap.end(); ++itEnt)
+     // Rebuild of connections
+      for (unsigned int i = 0; i < m_SpatialUnitsStore.size(); i++)
       {
+        SpatialUnitData& Ent = m_SpatialUnitsStore[i];
 
-        if (!(*itEnt).second.OrigToID.empty() && (*itEnt).second.ToSpatialUnit == nullptr &&
-            (*itEnt).second.OrigToID != (*itEnt).second.OrigID)
+        if (!Ent.OrigToID.empty() && Ent.ToSpatialUnit == NoSpatialUnitIndex && Ent.OrigToID != Ent.OrigID)
         {
-          auto itToEnt = m_SpatialUnitsMap.find((*itEnt).second.OrigToID);
+          unsigned int ToIndex = m_SpatialUnitsStore.find(Ent.OrigToID);
 
-          if (itToEnt != m_SpatialUnitsMap.end())
+          if (ToIndex != NoSpatialUnitIndex)
           {
-            (*itToEnt).second.FromSpatialUnit = &(m_SpatialUnitsMap[(*itEnt).first]);
-            (*itToEnt).second.FromClassID.push_back((*itEnt).second.ClassID);
-            (*itEnt).second.ToSpatialUnit = &(m_SpatialUnitsMap[(*itEnt).second.OrigToID]);
-            (*itEnt).second.ToClassID = (*itToEnt).second.ClassID;
+            SpatialUnitData& ToEnt = m_SpatialUnitsStore[ToIndex];
+
+            ToEnt.FromSpatialUnit = i;
+            ToEnt.FromClassID.push_back(Ent.ClassID);
+            Ent.ToSpatialUnit = ToIndex;
+            Ent.ToClassID = ToEnt.ClassID;
           }
         }
       }
 
 
       // mark outlets and leafs
-      for (auto itEnt = m_SpatialUnitsMap.begin(); itEnt != m_SpatialUnitsMap.end(); ++itEnt)
+      for (auto& Ent : m_SpatialUnitsStore)
       {
-        if ((*itEnt).second.ToSpatialUnit)
-          (*itEnt).second.Attributes.setValue("isoutlet",openfluid::core::BooleanValue(false));
+        if (Ent.ToSpatialUnit != NoSpatialUnitIndex)
+          Ent.Attributes.setValue("isoutlet",openfluid::core::BooleanValue(false));
         else
-          (*itEnt).second.Attributes.setValue("isoutlet",openfluid::core::BooleanValue(true));
+          Ent.Attributes.setValue("isoutlet",openfluid::core::BooleanValue(true));
 
-        if ((*itEnt).second.FromSpatialUnit)
-          (*itEnt).second.Attributes.setValue("isleaf",openfluid::core::BooleanValue(false));
+        if (Ent.FromSpatialUnit != NoSpatialUnitIndex)
+          Ent.Attributes.setValue("isleaf",openfluid::core::BooleanValue(false));
         else
-          (*itEnt).second.Attributes.setValue("isleaf",openfluid::core::BooleanValue(true));
+          Ent.Attributes.setValue("isleaf",openfluid::core::BooleanValue(true));
       }
 
 
-      // remove orphaned LI (no input and no output connection)
+      // remove orphaned LI (no input and no output connection), counted for the check of the graph
+      unsigned int RemovedLIOrphansCount = 0;
+
+      m_SpatialUnitsStore.removeIf([&RemovedLIOrphansCount](const SpatialUnitData& Ent)
       {
-        auto itEntClean = m_SpatialUnitsMap.begin();
-        while (itEntClean != m_SpatialUnitsMap.end())
+        const bool IsOrphan = (Ent.ClassID.first == "LI" &&
+                               Ent.ToSpatialUnit == NoSpatialUnitIndex && Ent.FromSpatialUnit == NoSpatialUnitIndex);
+
+        RemovedLIOrphansCount += IsOrphan;
+        return IsOrphan;
+      });
+
+      // Check of the graph, before any unit is created
+      checkSpatialGraph(RemovedLIOrphansCount);
+
+      // Compute of process orders
+      computeProcessOrders();
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Keeps only the staged units contributing to the given outlets, found by a reverse traversal of
+      the to connections. Process orders are left unchanged as all upstream units of a kept unit are kept
+    */
+    void extractSubCatchment(const std::vector<std::string>& OutletsOrigIDs)
+    {
+      const unsigned int UnitsCount = m_SpatialUnitsStore.size();
+
+      // upstream units of each unit, in compressed rows
+      std::vector<unsigned int> FromBegins(UnitsCount+1,0);
+      std::vector<unsigned int> FromUnits;
+      unsigned int ConnectionsCount = 0;
+
+      for (auto& Ent : m_SpatialUnitsStore)
+      {
+        if (Ent.ToSpatialUnit != NoSpatialUnitIndex)
         {
-/*          std::cout << (*itEntClean).second.ClassID.first << "#" << (*itEntClean).second.ClassID.second << " ->" <<
-                       ((*itEntClean).second.ToSpatialUnit != nullptr) << "," << ((*itEntClean).second.FromSpatialUnit != nullptr) << std::endl;*/
-          if ((*itEntClean).second.ClassID.first == "LI" &&
-              (*itEntClean).second.ToSpatialUnit == nullptr && (*itEntClean).second.FromSpatialUnit == nullptr)
-          {
-//            std::cout << "Removing " << (*itEntClean).second.ClassID.first << "#" << (*itEntClean).second.ClassID.second << std::endl;
-            itEntClean = m_SpatialUnitsMap.erase(itEntClean);
-          }
-          else
-          {
-            ++itEntClean;
-          }
+          FromBegins[Ent.ToSpatialUnit+1]++;
+          ConnectionsCount++;
         }
       }
 
-      // Creation of spatial units
-      for (auto& Ent : m_SpatialUnitsMap)
+      for (unsigned int i = 0; i < UnitsCount; i++)
+        FromBegins[i+1] += FromBegins[i];
+
+      FromUnits.resize(ConnectionsCount);
+      std::vector<unsigned int> FromPos(FromBegins.begin(),FromBegins.end()-1);
+
+      for (unsigned int i = 0; i < UnitsCount; i++)
       {
-        OPENFLUID_AddUnit(Ent.second.ClassID.first,Ent.second.ClassID.second,1);
+        if (m_SpatialUnitsStore[i].ToSpatialUnit != NoSpatialUnitIndex)
+          FromUnits[FromPos[m_SpatialUnitsStore[i].ToSpatialUnit]++] = i;
+      }
+
 
-        openfluid::core::SpatialUnit* U = OPENFLUID_GetUnit(Ent.second.ClassID.first,Ent.second.ClassID.second);
+      std::vector<bool> Kept(UnitsCount,false);
+      std::vector<unsigned int> PendingUnits;
 
-        if (U)
+      for (auto& OrigID : OutletsOrigIDs)
+      {
+        unsigned int Index = m_SpatialUnitsStore.find(OrigID);
+
+        if (Index == NoSpatialUnitIndex)
+          OPENFLUID_RaiseError("Outlet "+OrigID+" does not exist in spatial graph");
+
+        if (!Kept[Index])
         {
-          U->importGeometryFromWkt(Ent.second.WktGeometry);
+          Kept[Index] = true;
+          PendingUnits.push_back(Index);
+        }
+      }
 
-          OPENFLUID_SetAttribute(U,"origid",Ent.second.OrigID);
-          OPENFLUID_SetAttribute(U,"origtoid",Ent.second.OrigToID);
+      while (!PendingUnits.empty())
+      {
+        unsigned int Index = PendingUnits.back();
+        PendingUnits.pop_back();
 
-          for (auto& Attr : Ent.second.Attributes.getAttributesNames())
+        for (unsigned int f = FromBegins[Index]; f < FromBegins[Index+1]; f++)
+        {
+          if (!Kept[FromUnits[f]])
           {
-            OPENFLUID_SetAttribute(U,Attr,*(Ent.second.Attributes.value(Attr)));
+            Kept[FromUnits[f]] = true;
+            PendingUnits.push_back(FromUnits[f]);
           }
         }
       }
 
-      // Workaround when there is no RS - not clean!
-      if (!OPENFLUID_IsUnitsClassExist("RS"))
-        OPENFLUID_AddUnit("RS",1,1);
-
 
-      // Creation of connections
-      for (auto& Ent : m_SpatialUnitsMap)
+      // the selected outlets are the outlets of the sub-catchment
+      for (unsigned int i = 0; i < UnitsCount; i++)
       {
-        if (OPENFLUID_IsUnitExist(Ent.second.ClassID.first,Ent.second.ClassID.second) &&
-            OPENFLUID_IsUnitExist(Ent.second.ToClassID.first,Ent.second.ToClassID.second))
+        SpatialUnitData& Ent = m_SpatialUnitsStore[i];
+
+        if (Kept[i] && Ent.ToSpatialUnit != NoSpatialUnitIndex && !Kept[Ent.ToSpatialUnit])
         {
-          OPENFLUID_AddFromToConnection(Ent.second.ClassID.first,Ent.second.ClassID.second,Ent.second.ToClassID.first,Ent.second.ToClassID.second);
+          Ent.ToClassID = openfluid::core::UnitClassID_t();
+          Ent.Attributes.setValue("isoutlet",openfluid::core::BooleanValue(true));
         }
       }
 
+      unsigned int Index = 0;
+      m_SpatialUnitsStore.removeIf([&Kept,&Index](const SpatialUnitData&)
+      {
+        return !Kept[Index++];
+      });
 
-      openfluid::core::SpatialUnit* U;
+      OPENFLUID_DisplayInfo(m_SpatialUnitsStore.size() << " of " << UnitsCount <<
+                            " spatial units are upstream of the selected outlets");
+    }
 
 
-      // Compute of process orders
+    // =====================================================================
+    // =====================================================================
+
+
+    void initParams(const openfluid::ware::WareParams_t& Params)
+    {
+      OPENFLUID_GetSimulatorParameter(Params,"SUshapefile",m_SUshapefile);
+      OPENFLUID_GetSimulatorParameter(Params,"LIshapefile",m_LIshapefile);
+      OPENFLUID_GetSimulatorParameter(Params,"RSshapefile",m_RSshapefile);
 
-      std::vector<openfluid::core::SpatialUnit*> Outlets;
+      long Force = 0;
+//      OPENFLUID_GetSimulatorParameter(Params,"forceRSconnect",Force);
+      m_ForceRSConnect = Force;
 
-      OPENFLUID_ALLUNITS_ORDERED_LOOP(U)
+      long Parallel = 0;
+      OPENFLUID_GetSimulatorParameter(Params,"parallelimport",Parallel);
+      m_ParallelImport = Parallel;
+
+      OPENFLUID_GetSimulatorParameter(Params,"graphcache",m_GraphCacheFile);
+
+      long Stream = 0;
+      OPENFLUID_GetSimulatorParameter(Params,"streamimport",Stream);
+      m_StreamImport = Stream;
+
+      long Workers = 0;
+      OPENFLUID_GetSimulatorParameter(Params,"importworkers",Workers);
+      m_ImportWorkers = std::max(Workers,0L);
+
+      std::string Outlets;
+      OPENFLUID_GetSimulatorParameter(Params,"outlets",Outlets);
+      openfluid::tools::tokenizeString(Outlets,m_OutletsOrigIDs,";");
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    void prepareData()
+    {
+
+      OGRRegisterAll();
+
+      m_LandUsesIndices.clear();
+
+
+      if (m_SUshapefile.empty())
+        OPENFLUID_RaiseError("SU shapefile path is empty");
+
+      if (m_LIshapefile.empty())
+        OPENFLUID_RaiseError("LI shapefile path is empty");
+
+/*      if (m_RSshapefile.empty())
+        OPENFLUID_RaiseError("RS shapefile path is empty");*/
+
+
+      if (m_StreamImport)
       {
-        if (U->toSpatialUnits("SU") == nullptr && U->toSpatialUnits("RS") == nullptr && U->toSpatialUnits("LI") == nullptr)
-          Outlets.push_back(U);
+        if (!m_GraphCacheFile.empty())
+          OPENFLUID_LogAndDisplayWarning("Spatial graph cache is not used in streaming import mode");
+
+        buildSpatialGraph(true);
       }
+      else
+      {
+        bool GraphLoaded = false;
+        SpatialGraphCache::InputsKey_t InputsKey;
 
+        if (!m_GraphCacheFile.empty())
+        {
+          InputsKey = SpatialGraphCache::computeInputsKey({m_SUshapefile,m_LIshapefile,m_RSshapefile});
+          GraphLoaded = SpatialGraphCache::load(m_GraphCacheFile,InputsKey,m_SpatialUnitsStore);
 
-      for (auto OutU : Outlets)
-      {
-//        OPENFLUID_DisplayInfo("PcsOrd : processing outlet " << OutU->getClass() << "#" << OutU->getID());
+          if (GraphLoaded)
+            OPENFLUID_DisplayInfo("Spatial graph loaded from cache file " << m_GraphCacheFile);
+        }
+
+        if (!GraphLoaded)
+        {
+          buildSpatialGraph(false);
+
+          if (!m_GraphCacheFile.empty() && !SpatialGraphCache::save(m_GraphCacheFile,InputsKey,m_SpatialUnitsStore))
+            OPENFLUID_LogAndDisplayWarning("Cannot write spatial graph cache file " << m_GraphCacheFile);
+        }
+      }
 
-        m_MinPcsOrd = 0;
+      // the cache always holds the whole graph, the sub-catchment is extracted afterwards
+      if (!m_OutletsOrigIDs.empty())
+        extractSubCatchment(m_OutletsOrigIDs);
+
+
+      // Creation of spatial units
+      if (m_StreamImport)
+      {
+        createUnitsFromLayer("SU",m_SUshapefile,m_SUAttrInfos);
+        createUnitsFromLayer("LI",m_LIshapefile,m_LIAttrInfos);
+        createUnitsFromLayer("RS",m_RSshapefile,m_RSAttrInfos,true);
+      }
+      else
+      {
+        for (auto& Ent : m_SpatialUnitsStore)
+          createUnit(Ent);
+      }
 
-        computeProcessOrderRecursively(OutU,0); // first recursive pass to detect the minimal process order
+      // Workaround when there is no RS - not clean!
+      if (!OPENFLUID_IsUnitsClassExist("RS"))
+        OPENFLUID_AddUnit("RS",1,1);
 
-        computeProcessOrderRecursively(OutU,-m_MinPcsOrd+1); // second recursive pass to shift all process orders as the minimal is now one
 
+      // Creation of connections
+      for (auto& Ent : m_SpatialUnitsStore)
+      {
+        if (OPENFLUID_IsUnitExist(Ent.ClassID.first,Ent.ClassID.second) &&
+            OPENFLUID_IsUnitExist(Ent.ToClassID.first,Ent.ToClassID.second))
+        {
+          OPENFLUID_AddFromToConnection(Ent.ClassID.first,Ent.ClassID.second,Ent.ToClassID.first,Ent.ToClassID.second);
+        }
       }
 
+
       mp_SpatialData->sortUnitsByProcessOrder();
 
+      // staged units are not needed anymore
+      m_SpatialUnitsStore.clear();
+
 
 
 /*
@@ -0,0 +1,126 @@
+/**
+  @file BoundedQueue.hpp
+*/
+
+
+#ifndef __BOUNDEDQUEUE_HPP__
+#define __BOUNDEDQUEUE_HPP__
+
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Fixed capacity FIFO queue shared by producer and consumer threads, stored as a ring buffer.
+  Producers are blocked while the queue is full and consumers are blocked while it is empty.
+  Once closed, remaining items can still be popped, then pop() returns false
+*/
+template<typename T>
+class BoundedQueue
+{
+  private:
+
+    std::vector<T> m_Items;
+
+    std::size_t m_Head = 0;
+
+    std::size_t m_Count = 0;
+
+    bool m_Closed = false;
+
+    std::mutex m_Mutex;
+
+    std::condition_variable m_NotFull;
+
+    std::condition_variable m_NotEmpty;
+
+
+  public:
+
+    BoundedQueue(std::size_t Capacity) :
+      m_Items(Capacity > 0 ? Capacity : 1)
+    { }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Appends an item, waiting for a free place if the queue is full
+      @return false if the queue has been closed, the item is then not appended
+    */
+    bool push(T&& Item)
+    {
+      std::unique_lock<std::mutex> Lock(m_Mutex);
+
+      m_NotFull.wait(Lock,[this]() { return m_Count < m_Items.size() || m_Closed; });
+
+      if (m_Closed)
+        return false;
+
+      m_Items[(m_Head+m_Count) % m_Items.size()] = std::move(Item);
+      m_Count++;
+
+      Lock.unlock();
+      m_NotEmpty.notify_one();
+
+      return true;
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Takes the oldest item, waiting for an item if the queue is empty
+      @return false if the queue is closed and empty
+    */
+    bool pop(T& Item)
+    {
+      std::unique_lock<std::mutex> Lock(m_Mutex);
+
+      m_NotEmpty.wait(Lock,[this]() { return m_Count > 0 || m_Closed; });
+
+      if (m_Count == 0)
+        return false;
+
+      Item = std::move(m_Items[m_Head]);
+      m_Head = (m_Head+1) % m_Items.size();
+      m_Count--;
+
+      Lock.unlock();
+      m_NotFull.notify_one();
+
+      return true;
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Closes the queue and wakes up all waiting threads
+    */
+    void close()
+    {
+      {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_Closed = true;
+      }
+
+      m_NotFull.notify_all();
+      m_NotEmpty.notify_all();
+    }
+};
+
+
+#endif /* __BOUNDEDQUEUE_HPP__ */
@@ -0,0 +1,539 @@
+/**
+  @file SpatialGraphCache.cpp
+*/
+
+
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+// files are memory-mapped where POSIX mappings are available, read in a buffer otherwise
+#if defined(__unix__) || defined(__APPLE__)
+#define BVSERVICE_GRAPHCACHE_MMAP 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <openfluid/core/DoubleValue.hpp>
+#include <openfluid/core/IntegerValue.hpp>
+#include <openfluid/core/BooleanValue.hpp>
+#include <openfluid/core/StringValue.hpp>
+
+#include "SpatialGraphCache.hpp"
+
+
+namespace {
+
+
+const char CacheMagic[8] = {'B','V','S','G','R','A','P','H'};
+
+const std::uint32_t CacheEndianMark = 0x01020304;
+
+
+enum AttrType_t : std::uint32_t { ATTR_DOUBLE = 1, ATTR_INTEGER = 2, ATTR_BOOLEAN = 3, ATTR_STRING = 4 };
+
+
+struct CacheHeader
+{
+  char Magic[8];
+  std::uint32_t Version;
+  std::uint32_t EndianMark;
+  std::uint64_t InputsCount;
+  std::uint64_t UnitsCount;
+  std::uint64_t AttrsCount;
+  std::uint64_t PoolSize;
+};
+
+
+struct PoolRef
+{
+  std::uint64_t Offset;
+  std::uint64_t Length;
+};
+
+
+struct UnitRecord
+{
+  PoolRef OrigID;
+  PoolRef OrigToID;
+  PoolRef Class;
+  PoolRef ToClass;
+  PoolRef Geometry;
+  std::uint64_t AttrsBegin;
+  std::uint64_t AttrsCount;
+  std::uint32_t UnitID;
+  std::uint32_t ToUnitID;
+  std::int32_t ProcessOrder;
+  std::uint32_t ToIndex;
+};
+
+
+struct AttrRecord
+{
+  PoolRef Name;
+  PoolRef StringValue;
+  double NumValue;
+  std::uint32_t Type;
+  std::uint32_t Padding;
+};
+
+
+static_assert(sizeof(CacheHeader)%8 == 0 && sizeof(SpatialGraphCache::FileKey)%8 == 0 &&
+              sizeof(UnitRecord)%8 == 0 && sizeof(AttrRecord)%8 == 0,
+              "cache records must be 8 bytes aligned");
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Read-only memory mapping of a whole file, or copy of the file in memory where mappings are not available.
+  The modification time is only known with mappings, it is 0 otherwise so files are identified by their size and hash
+*/
+class MappedFile
+{
+  public:
+
+    const unsigned char* Data = nullptr;
+
+    std::uint64_t Size = 0;
+
+    std::int64_t MTime = 0;
+
+
+#ifdef BVSERVICE_GRAPHCACHE_MMAP
+
+    MappedFile(const std::string& FilePath)
+    {
+      int FD = open(FilePath.c_str(),O_RDONLY);
+
+      if (FD < 0)
+        return;
+
+      struct stat Stat;
+
+      if (fstat(FD,&Stat) == 0)
+      {
+        Size = Stat.st_size;
+        MTime = Stat.st_mtime;
+
+        if (Size > 0)
+        {
+          void* Addr = mmap(nullptr,Size,PROT_READ,MAP_PRIVATE,FD,0);
+
+          if (Addr != MAP_FAILED)
+            Data = static_cast<const unsigned char*>(Addr);
+        }
+      }
+
+      close(FD);
+    }
+
+
+    ~MappedFile()
+    {
+      if (Data)
+        munmap(const_cast<unsigned char*>(Data),Size);
+    }
+
+#else
+
+    MappedFile(const std::string& FilePath)
+    {
+      std::ifstream File(FilePath,std::ios::in | std::ios::binary);
+
+      if (!File.is_open())
+        return;
+
+      m_Buffer.assign(std::istreambuf_iterator<char>(File),std::istreambuf_iterator<char>());
+
+      if (!File.bad() && !m_Buffer.empty())
+      {
+        Data = reinterpret_cast<const unsigned char*>(m_Buffer.data());
+        Size = m_Buffer.size();
+      }
+    }
+
+#endif
+
+
+    bool isValid() const
+    {
+      return Data != nullptr;
+    }
+
+
+  private:
+
+#ifndef BVSERVICE_GRAPHCACHE_MMAP
+    std::vector<char> m_Buffer;
+#endif
+};
+
+
+// =====================================================================
+// =====================================================================
+
+
+std::uint64_t computeHash(const unsigned char* Data, std::uint64_t Size)
+{
+  // FNV-1a
+  std::uint64_t Hash = 14695981039346656037ULL;
+
+  for (std::uint64_t i = 0; i < Size; i++)
+  {
+    Hash ^= Data[i];
+    Hash *= 1099511628211ULL;
+  }
+
+  return Hash;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  @return a suffix of the temporary file written by this process, renamed to the cache file once complete
+*/
+std::string getTmpFileSuffix()
+{
+#ifdef BVSERVICE_GRAPHCACHE_MMAP
+  return ".tmp"+std::to_string(getpid());
+#else
+  return ".tmp"+std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+                               std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Replaces the file at the given path by the given temporary file
+  @return false if the replacement failed
+*/
+bool replaceFile(const std::string& TmpFilePath, const std::string& FilePath)
+{
+#ifndef BVSERVICE_GRAPHCACHE_MMAP
+  // renaming to an existing file fails on some platforms
+  std::remove(FilePath.c_str());
+#endif
+
+  return std::rename(TmpFilePath.c_str(),FilePath.c_str()) == 0;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+class PoolWriter
+{
+  public:
+
+    std::vector<char> Pool;
+
+
+    PoolRef add(const void* Data, std::uint64_t Length)
+    {
+      PoolRef Ref = {Pool.size(),Length};
+
+      Pool.insert(Pool.end(),static_cast<const char*>(Data),static_cast<const char*>(Data)+Length);
+
+      return Ref;
+    }
+
+
+    PoolRef add(const std::string& Str)
+    {
+      return add(Str.data(),Str.size());
+    }
+};
+
+
+}  // namespace
+
+
+// =====================================================================
+// =====================================================================
+
+
+SpatialGraphCache::InputsKey_t SpatialGraphCache::computeInputsKey(const std::vector<std::string>& Shapefiles)
+{
+  InputsKey_t Key;
+
+  for (auto& Shapefile : Shapefiles)
+  {
+    std::string BasePath = Shapefile;
+    std::string::size_type DotPos = BasePath.find_last_of('.');
+    if (DotPos != std::string::npos && BasePath.find_first_of('/',DotPos) == std::string::npos)
+      BasePath.erase(DotPos);
+
+    for (auto Ext : {".shp",".shx",".dbf"})
+    {
+      FileKey FKey;
+      MappedFile File(BasePath+Ext);
+
+      if (File.isValid())
+      {
+        FKey.Size = File.Size;
+        FKey.MTime = File.MTime;
+        FKey.Hash = computeHash(File.Data,File.Size);
+      }
+
+      Key.push_back(FKey);
+    }
+  }
+
+  return Key;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool SpatialGraphCache::save(const std::string& FilePath, const InputsKey_t& Key, const SpatialUnitsStore& SpatialUnits)
+{
+  PoolWriter Writer;
+  std::vector<UnitRecord> Units;
+  std::vector<AttrRecord> Attrs;
+  std::vector<unsigned char> WkbBuffer;
+
+  Units.reserve(SpatialUnits.size());
+
+  for (auto& Data : SpatialUnits)
+  {
+    UnitRecord URec;
+    std::memset(&URec,0,sizeof(URec));
+
+    URec.OrigID = Writer.add(Data.OrigID);
+    URec.OrigToID = Writer.add(Data.OrigToID);
+    URec.Class = Writer.add(Data.ClassID.first);
+    URec.ToClass = Writer.add(Data.ToClassID.first);
+    URec.UnitID = Data.ClassID.second;
+    URec.ToUnitID = Data.ToClassID.second;
+    URec.ProcessOrder = Data.ProcessOrder;
+    URec.ToIndex = Data.ToSpatialUnit;
+
+    if (Data.Geometry)
+    {
+      WkbBuffer.resize(Data.Geometry->WkbSize());
+
+      if (Data.Geometry->exportToWkb(wkbNDR,WkbBuffer.data()) != OGRERR_NONE)
+        return false;
+
+      URec.Geometry = Writer.add(WkbBuffer.data(),WkbBuffer.size());
+    }
+
+    URec.AttrsBegin = Attrs.size();
+
+    for (auto& Name : Data.Attributes.getAttributesNames())
+    {
+      const openfluid::core::Value* Val = Data.Attributes.value(Name);
+      AttrRecord ARec;
+      std::memset(&ARec,0,sizeof(ARec));
+
+      ARec.Name = Writer.add(Name);
+
+      if (Val->getType() == openfluid::core::Value::Type::DOUBLE)
+      {
+        ARec.Type = ATTR_DOUBLE;
+        ARec.NumValue = Val->asDoubleValue().get();
+      }
+      else if (Val->getType() == openfluid::core::Value::Type::INTEGER)
+      {
+        ARec.Type = ATTR_INTEGER;
+        ARec.NumValue = Val->asIntegerValue().get();
+      }
+      else if (Val->getType() == openfluid::core::Value::Type::BOOLEAN)
+      {
+        ARec.Type = ATTR_BOOLEAN;
+        ARec.NumValue = Val->asBooleanValue().get();
+      }
+      else if (Val->getType() == openfluid::core::Value::Type::STRING)
+      {
+        ARec.Type = ATTR_STRING;
+        ARec.StringValue = Writer.add(Val->asStringValue().get());
+      }
+      else
+        return false;
+
+      Attrs.push_back(ARec);
+    }
+
+    URec.AttrsCount = Attrs.size()-URec.AttrsBegin;
+
+    Units.push_back(URec);
+  }
+
+  // pool size is padded to keep the file size 8 bytes aligned
+  Writer.Pool.resize((Writer.Pool.size()+7) & ~std::uint64_t(7),0);
+
+  CacheHeader Header;
+  std::memset(&Header,0,sizeof(Header));
+  std::memcpy(Header.Magic,CacheMagic,sizeof(CacheMagic));
+  Header.Version = Version;
+  Header.EndianMark = CacheEndianMark;
+  Header.InputsCount = Key.size();
+  Header.UnitsCount = Units.size();
+  Header.AttrsCount = Attrs.size();
+  Header.PoolSize = Writer.Pool.size();
+
+
+  std::string TmpFilePath = FilePath+getTmpFileSuffix();
+
+  std::ofstream CacheFile(TmpFilePath,std::ios::out | std::ios::binary | std::ios::trunc);
+
+  if (!CacheFile.is_open())
+    return false;
+
+  CacheFile.write(reinterpret_cast<const char*>(&Header),sizeof(Header));
+  CacheFile.write(reinterpret_cast<const char*>(Key.data()),Key.size()*sizeof(FileKey));
+  CacheFile.write(reinterpret_cast<const char*>(Units.data()),Units.size()*sizeof(UnitRecord));
+  CacheFile.write(reinterpret_cast<const char*>(Attrs.data()),Attrs.size()*sizeof(AttrRecord));
+  CacheFile.write(Writer.Pool.data(),Writer.Pool.size());
+  CacheFile.close();
+
+  if (!CacheFile || !replaceFile(TmpFilePath,FilePath))
+  {
+    std::remove(TmpFilePath.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool SpatialGraphCache::load(const std::string& FilePath, const InputsKey_t& Key, SpatialUnitsStore& SpatialUnits)
+{
+  SpatialUnits.clear();
+
+  MappedFile File(FilePath);
+
+  if (!File.isValid() || File.Size < sizeof(CacheHeader))
+    return false;
+
+  const CacheHeader* Header = reinterpret_cast<const CacheHeader*>(File.Data);
+
+  if (std::memcmp(Header->Magic,CacheMagic,sizeof(CacheMagic)) != 0 ||
+      Header->Version != Version || Header->EndianMark != CacheEndianMark ||
+      Header->InputsCount != Key.size())
+    return false;
+
+  const std::uint64_t KeysOffset = sizeof(CacheHeader);
+  const std::uint64_t UnitsOffset = KeysOffset + Header->InputsCount*sizeof(FileKey);
+  const std::uint64_t AttrsOffset = UnitsOffset + Header->UnitsCount*sizeof(UnitRecord);
+  const std::uint64_t PoolOffset = AttrsOffset + Header->AttrsCount*sizeof(AttrRecord);
+
+  if (Header->UnitsCount > File.Size || Header->AttrsCount > File.Size || PoolOffset+Header->PoolSize != File.Size)
+    return false;
+
+  const FileKey* Keys = reinterpret_cast<const FileKey*>(File.Data+KeysOffset);
+
+  for (unsigned int i = 0; i < Key.size(); i++)
+  {
+    if (!(Keys[i] == Key[i]))
+      return false;
+  }
+
+  const UnitRecord* Units = reinterpret_cast<const UnitRecord*>(File.Data+UnitsOffset);
+  const AttrRecord* Attrs = reinterpret_cast<const AttrRecord*>(File.Data+AttrsOffset);
+  const char* Pool = reinterpret_cast<const char*>(File.Data+PoolOffset);
+
+  auto isInPool = [Header](const PoolRef& Ref)
+  {
+    return Ref.Offset <= Header->PoolSize && Ref.Length <= Header->PoolSize-Ref.Offset;
+  };
+
+  auto getString = [Pool](const PoolRef& Ref)
+  {
+    return std::string(Pool+Ref.Offset,Ref.Length);
+  };
+
+
+  SpatialUnits.reserve(Header->UnitsCount);
+
+  for (std::uint64_t u = 0; u < Header->UnitsCount; u++)
+  {
+    const UnitRecord& URec = Units[u];
+
+    if (!isInPool(URec.OrigID) || !isInPool(URec.OrigToID) || !isInPool(URec.Class) ||
+        !isInPool(URec.ToClass) || !isInPool(URec.Geometry) ||
+        URec.AttrsBegin > Header->AttrsCount || URec.AttrsCount > Header->AttrsCount-URec.AttrsBegin ||
+        (URec.ToIndex != NoSpatialUnitIndex && URec.ToIndex >= Header->UnitsCount))
+    {
+      SpatialUnits.clear();
+      return false;
+    }
+
+    SpatialUnitData Data;
+
+    Data.OrigID = getString(URec.OrigID);
+    Data.OrigToID = getString(URec.OrigToID);
+    Data.ClassID = {getString(URec.Class),URec.UnitID};
+    Data.ToClassID = {getString(URec.ToClass),URec.ToUnitID};
+    Data.ProcessOrder = URec.ProcessOrder;
+    Data.ToSpatialUnit = URec.ToIndex;
+
+    if (URec.Geometry.Length)
+    {
+      OGRGeometry* Geom = nullptr;
+
+      // WKB is only read by GDAL, the const_cast is required by the GDAL 1.x API
+      if (OGRGeometryFactory::createFromWkb(reinterpret_cast<unsigned char*>(const_cast<char*>(Pool+URec.Geometry.Offset)),
+                                            nullptr,&Geom,URec.Geometry.Length) != OGRERR_NONE)
+      {
+        SpatialUnits.clear();
+        return false;
+      }
+
+      Data.Geometry.reset(Geom);
+    }
+
+    for (std::uint64_t a = URec.AttrsBegin; a < URec.AttrsBegin+URec.AttrsCount; a++)
+    {
+      const AttrRecord& ARec = Attrs[a];
+
+      if (!isInPool(ARec.Name) || !isInPool(ARec.StringValue))
+      {
+        SpatialUnits.clear();
+        return false;
+      }
+
+      std::string Name = getString(ARec.Name);
+
+      if (ARec.Type == ATTR_DOUBLE)
+        Data.Attributes.setValue(Name,openfluid::core::DoubleValue(ARec.NumValue));
+      else if (ARec.Type == ATTR_INTEGER)
+        Data.Attributes.setValue(Name,openfluid::core::IntegerValue((long)ARec.NumValue));
+      else if (ARec.Type == ATTR_BOOLEAN)
+        Data.Attributes.setValue(Name,openfluid::core::BooleanValue(ARec.NumValue != 0.0));
+      else
+        Data.Attributes.setValue(Name,openfluid::core::StringValue(getString(ARec.StringValue)));
+    }
+
+    if (SpatialUnits.insert(std::move(Data)) == NoSpatialUnitIndex)
+    {
+      SpatialUnits.clear();
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,79 @@
+/**
+  @file SpatialGraphCache.hpp
+*/
+
+
+#ifndef __SPATIALGRAPHCACHE_HPP__
+#define __SPATIALGRAPHCACHE_HPP__
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SpatialUnitsStore.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Binary snapshot of the finished spatial graph, as staged before the creation of the spatial units
+  (IDs, classes, attributes, WKB geometries, connections and process orders).
+
+  The snapshot is made of a header, the keys of the input files, fixed size records for units and attributes,
+  and a pool for strings and geometries. All sections are 8 bytes aligned so the file can be used
+  directly from a memory mapping. It is only valid for the input files it has been built from,
+  identified by their size, modification time and content hash.
+*/
+class SpatialGraphCache
+{
+  public:
+
+    // changed when the stored data or the numerical IDs of units change
+    static const std::uint32_t Version = 3;
+
+    class FileKey
+    {
+      public:
+
+        std::uint64_t Size = 0;
+
+        std::int64_t MTime = 0;
+
+        std::uint64_t Hash = 0;
+
+
+        bool operator==(const FileKey& Other) const
+        {
+          return Size == Other.Size && MTime == Other.MTime && Hash == Other.Hash;
+        }
+    };
+
+    typedef std::vector<FileKey> InputsKey_t;
+
+
+    /**
+      Computes the key of the given shapefiles, including their .shx and .dbf companion files.
+      Missing files get an empty key, so optional shapefiles are handled
+    */
+    static InputsKey_t computeInputsKey(const std::vector<std::string>& Shapefiles);
+
+    /**
+      Writes the snapshot of the given spatial units. The file is written under a temporary name
+      then renamed, so concurrent runs never read a partial snapshot
+      @return false if the snapshot could not be written
+    */
+    static bool save(const std::string& FilePath, const InputsKey_t& Key, const SpatialUnitsStore& SpatialUnits);
+
+    /**
+      Loads a snapshot into the given spatial units store
+      @return false if the snapshot does not exist, is not valid, or was built from other input files.
+      In this case the store is left empty
+    */
+    static bool load(const std::string& FilePath, const InputsKey_t& Key, SpatialUnitsStore& SpatialUnits);
+};
+
+
+#endif /* __SPATIALGRAPHCACHE_HPP__ */
@@ -0,0 +1,79 @@
+/**
+  @file SpatialUnitData.hpp
+*/
+
+
+#ifndef __SPATIALUNITDATA_HPP__
+#define __SPATIALUNITDATA_HPP__
+
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ogrsf_frmts.h>
+
+#include <openfluid/core/Attributes.hpp>
+#include <openfluid/core/TypeDefs.hpp>
+
+
+// =====================================================================
+// =====================================================================
+
+
+class GeometryDeleter
+{
+  public:
+
+    void operator()(OGRGeometry* Geom) const
+    {
+      OGRGeometryFactory::destroyGeometry(Geom);
+    }
+};
+
+
+typedef std::unique_ptr<OGRGeometry,GeometryDeleter> GeometryPtr_t;
+
+
+// index of a spatial unit in the staging store, or no unit
+const unsigned int NoSpatialUnitIndex = std::numeric_limits<unsigned int>::max();
+
+
+// =====================================================================
+// =====================================================================
+
+
+class SpatialUnitData
+{
+  public:
+
+    std::string OrigID;
+
+    std::string OrigToID;
+
+    // geometry taken from the source feature, handed to the spatial unit at creation
+    GeometryPtr_t Geometry;
+
+    // index of the (last connected) upstream unit
+    unsigned int FromSpatialUnit = NoSpatialUnitIndex;
+
+    // index of the downstream unit
+    unsigned int ToSpatialUnit = NoSpatialUnitIndex;
+
+    int ProcessOrder = 1;
+
+    unsigned int PendingFromCount = 0;
+
+    openfluid::core::UnitClassID_t ClassID;
+
+    openfluid::core::UnitClassID_t ToClassID;
+
+    std::vector<openfluid::core::UnitClassID_t> FromClassID;
+
+    openfluid::core::Attributes Attributes;
+
+};
+
+
+#endif /* __SPATIALUNITDATA_HPP__ */
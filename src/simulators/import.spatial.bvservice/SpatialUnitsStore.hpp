@@ -0,0 +1,291 @@
+/**
+  @file SpatialUnitsStore.hpp
+*/
+
+
+#ifndef __SPATIALUNITSSTORE_HPP__
+#define __SPATIALUNITSSTORE_HPP__
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SpatialUnitData.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Staging store of spatial units, made of a contiguous vector of units and of an open-addressing
+  (linear probing) hash table from original IDs to indexes in the vector.
+  Units are kept in insertion order and are designated by their index, which is stable until removeIf() is called
+*/
+class SpatialUnitsStore
+{
+  private:
+
+    std::vector<SpatialUnitData> m_Units;
+
+    // hashes of the original IDs, in units order, kept to rebuild the table without rehashing strings
+    std::vector<std::uint64_t> m_Hashes;
+
+    // slots of the hash table, containing units indexes
+    std::vector<unsigned int> m_Slots;
+
+    std::uint64_t m_SlotsMask = 0;
+
+
+    static std::uint64_t computeHash(const std::string& Str)
+    {
+      // FNV-1a
+      std::uint64_t Hash = 14695981039346656037ULL;
+
+      for (unsigned char C : Str)
+      {
+        Hash ^= C;
+        Hash *= 1099511628211ULL;
+      }
+
+      return Hash;
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    void insertSlot(unsigned int Index)
+    {
+      std::uint64_t Slot = m_Hashes[Index] & m_SlotsMask;
+
+      while (m_Slots[Slot] != NoSpatialUnitIndex)
+        Slot = (Slot+1) & m_SlotsMask;
+
+      m_Slots[Slot] = Index;
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Resizes the table to keep its load factor under 0.5 for the given count of units
+    */
+    void rehash(std::size_t Count)
+    {
+      std::size_t SlotsCount = 16;
+      while (SlotsCount < Count*2)
+        SlotsCount *= 2;
+
+      m_Slots.assign(SlotsCount,NoSpatialUnitIndex);
+      m_SlotsMask = SlotsCount-1;
+
+      for (unsigned int i = 0; i < m_Units.size(); i++)
+        insertSlot(i);
+    }
+
+
+  public:
+
+    typedef std::vector<SpatialUnitData>::iterator iterator;
+
+    typedef std::vector<SpatialUnitData>::const_iterator const_iterator;
+
+
+    SpatialUnitsStore()
+    {
+      rehash(0);
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Pre-sizes the vector and the table for the given count of units
+    */
+    void reserve(std::size_t Count)
+    {
+      m_Units.reserve(Count);
+      m_Hashes.reserve(Count);
+
+      if (m_Slots.size() < Count*2)
+        rehash(Count);
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Inserts a unit, unless a unit with the same original ID already exists
+      @return the index of the inserted unit, or NoSpatialUnitIndex if the original ID already exists
+    */
+    unsigned int insert(SpatialUnitData&& Data)
+    {
+      std::uint64_t Hash = computeHash(Data.OrigID);
+      std::uint64_t Slot = Hash & m_SlotsMask;
+
+      while (m_Slots[Slot] != NoSpatialUnitIndex)
+      {
+        unsigned int Index = m_Slots[Slot];
+
+        if (m_Hashes[Index] == Hash && m_Units[Index].OrigID == Data.OrigID)
+          return NoSpatialUnitIndex;
+
+        Slot = (Slot+1) & m_SlotsMask;
+      }
+
+      unsigned int Index = m_Units.size();
+      m_Units.push_back(std::move(Data));
+      m_Hashes.push_back(Hash);
+
+      if (m_Units.size()*2 > m_Slots.size())
+        rehash(m_Units.size());
+      else
+        m_Slots[Slot] = Index;
+
+      return Index;
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      @return the index of the unit with the given original ID, or NoSpatialUnitIndex if it does not exist
+    */
+    unsigned int find(const std::string& OrigID) const
+    {
+      std::uint64_t Hash = computeHash(OrigID);
+      std::uint64_t Slot = Hash & m_SlotsMask;
+
+      while (m_Slots[Slot] != NoSpatialUnitIndex)
+      {
+        unsigned int Index = m_Slots[Slot];
+
+        if (m_Hashes[Index] == Hash && m_Units[Index].OrigID == OrigID)
+          return Index;
+
+        Slot = (Slot+1) & m_SlotsMask;
+      }
+
+      return NoSpatialUnitIndex;
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Removes the units matching the given predicate. Remaining units are compacted and their connections
+      are remapped, connections to removed units are cleared
+    */
+    template<typename Predicate>
+    void removeIf(Predicate Pred)
+    {
+      std::vector<unsigned int> NewIndexes(m_Units.size(),NoSpatialUnitIndex);
+      unsigned int NewCount = 0;
+
+      for (unsigned int i = 0; i < m_Units.size(); i++)
+      {
+        if (!Pred(m_Units[i]))
+        {
+          NewIndexes[i] = NewCount;
+
+          if (i != NewCount)
+          {
+            m_Units[NewCount] = std::move(m_Units[i]);
+            m_Hashes[NewCount] = m_Hashes[i];
+          }
+
+          NewCount++;
+        }
+      }
+
+      if (NewCount == m_Units.size())
+        return;
+
+      m_Units.erase(m_Units.begin()+NewCount,m_Units.end());
+      m_Hashes.resize(NewCount);
+
+      for (auto& Data : m_Units)
+      {
+        if (Data.FromSpatialUnit != NoSpatialUnitIndex)
+          Data.FromSpatialUnit = NewIndexes[Data.FromSpatialUnit];
+        if (Data.ToSpatialUnit != NoSpatialUnitIndex)
+          Data.ToSpatialUnit = NewIndexes[Data.ToSpatialUnit];
+      }
+
+      rehash(m_Units.size());
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    void clear()
+    {
+      m_Units.clear();
+      m_Hashes.clear();
+      rehash(0);
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    std::size_t size() const
+    {
+      return m_Units.size();
+    }
+
+
+    SpatialUnitData& operator[](unsigned int Index)
+    {
+      return m_Units[Index];
+    }
+
+
+    const SpatialUnitData& operator[](unsigned int Index) const
+    {
+      return m_Units[Index];
+    }
+
+
+    iterator begin()
+    {
+      return m_Units.begin();
+    }
+
+
+    iterator end()
+    {
+      return m_Units.end();
+    }
+
+
+    const_iterator begin() const
+    {
+      return m_Units.begin();
+    }
+
+
+    const_iterator end() const
+    {
+      return m_Units.end();
+    }
+};
+
+
+#endif /* __SPATIALUNITSSTORE_HPP__ */
@@ -0,0 +1,332 @@
+/**
+  @file BVServiceBuffersSim.cpp
+*/
+
+
+/*
+<sim2doc>
+
+</sim2doc>
+*/
+
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <algorithm>
+
+#include <openfluid/ware/PluggableSimulator.hpp>
+
+#include "WorkersPool.hpp"
+#include "HydroModel.hpp"
+#include "BufferPlacement.hpp"
+#include "BVServiceSimulator.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+BEGIN_SIMULATOR_SIGNATURE("land.buffers-placement.bvservice")
+
+  // Informations
+  DECLARE_NAME("")
+  DECLARE_DESCRIPTION("Greedy placement of buffers on LI reducing the runoff volume reaching RS, "
+                      "for a budget of buffers length")
+  DECLARE_VERSION("")
+  DECLARE_STATUS(openfluid::ware::EXPERIMENTAL)
+
+  DECLARE_REQUIRED_EXTRAFILE("landuse2CN.fr.txt")
+
+  DECLARE_USED_PARAMETER("budget","total length of the buffers to place","m")
+  DECLARE_USED_PARAMETER("buffertype","type of the placed buffers: grassbs (default), hedges or benches","")
+  DECLARE_USED_PARAMETER("bufferratio","ratio of the LI length covered by a placed buffer, default is 1","")
+  DECLARE_USED_PARAMETER("totalrain","total rainfall, or total rainfalls of scenarios separated by ';'. "
+                         "The reduction of the runoff volume is summed over scenarios","m")
+  DECLARE_USED_PARAMETER("threads","number of threads scoring the candidate placements, default is 1","")
+
+  DECLARE_REQUIRED_ATTRIBUTE("landuse","SU","","")
+  DECLARE_REQUIRED_ATTRIBUTE("area","SU","","")
+  DECLARE_USED_ATTRIBUTE("landuseidx","SU","index of the land use code, from the import","")
+
+  DECLARE_REQUIRED_ATTRIBUTE("length","LI","length of the linear interface","m")
+  DECLARE_REQUIRED_ATTRIBUTE("grassbsratio","LI","ratio of the length which is grass strips","m")
+  DECLARE_REQUIRED_ATTRIBUTE("hedgesratio","LI","ratio of the length which is hedges","m")
+
+  DECLARE_PRODUCED_ATTRIBUTE("bufferrank","LI","rank of the placed buffer in the selection order, "
+                             "0 if no buffer is placed","")
+  DECLARE_PRODUCED_ATTRIBUTE("bufferlength","LI","length of the placed buffer","m")
+  DECLARE_PRODUCED_ATTRIBUTE("buffergain","LI","reduction of the runoff volume reaching RS "
+                             "when the buffer was selected","m3")
+
+  DECLARE_PRODUCED_VARIABLE("bufferuprunoffvolume","RS","incoming runoff volume with the placed buffers, "
+                            "for the first scenario","m3")
+
+END_SIMULATOR_SIGNATURE
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+
+*/
+class BVServiceBuffersSimulator : public BVServiceSimulator
+{
+  private:
+
+    // total rainfalls of scenarios in meters
+    std::vector<double> m_TotalRains = {0.5};
+
+    double m_Budget = 0.0;
+
+    std::string m_BufferType = "grassbs";
+
+    double m_BufferRatio = 1.0;
+
+    unsigned int m_ThreadsCount = 1;
+
+    // index of the placed buffer type in the LI subparts
+    unsigned int m_BufferSubpart = 0;
+
+    // in-memory graph and runoff model, indexing units by their rank in the process order
+    BVServiceGraph m_Graph;
+
+    HydroModel m_Model;
+
+    std::unique_ptr<BufferPlacement> m_Placement;
+
+
+  public:
+
+
+    BVServiceBuffersSimulator(): BVServiceSimulator()
+    {
+
+
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    ~BVServiceBuffersSimulator()
+    {
+
+
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    void initParams(const openfluid::ware::WareParams_t& Params)
+    {
+      std::vector<double> TotalRains;
+      if (OPENFLUID_GetSimulatorParameter(Params,"totalrain",TotalRains) && !TotalRains.empty())
+        m_TotalRains = TotalRains;
+
+      OPENFLUID_GetSimulatorParameter(Params,"budget",m_Budget);
+      OPENFLUID_GetSimulatorParameter(Params,"buffertype",m_BufferType);
+      OPENFLUID_GetSimulatorParameter(Params,"bufferratio",m_BufferRatio);
+
+      m_BufferSubpart = std::find(BVServiceGraph::LISubparts,BVServiceGraph::LISubparts+BVServiceGraph::LISubpartsCount,
+                                  m_BufferType)-BVServiceGraph::LISubparts;
+
+      if (m_BufferSubpart == BVServiceGraph::LISubpartsCount)
+        OPENFLUID_RaiseError("Wrong buffer type: " + m_BufferType);
+
+      if (m_BufferRatio <= 0.0 || m_BufferRatio > 1.0)
+        OPENFLUID_RaiseError("Buffer ratio must be in (0,1]");
+
+      long Threads = 1;
+      OPENFLUID_GetSimulatorParameter(Params,"threads",Threads);
+      m_ThreadsCount = std::max(Threads,1L);
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Builds the in-memory graph from the spatial graph in process order,
+      then the runoff model of this graph which is computed without added buffers
+    */
+    void buildModel(const std::map<std::string,int>& LandUse2CN)
+    {
+      std::vector<double> LandUsesCN;
+
+      buildGraph(m_Graph,GRAPH_BASE);
+      encodeLandUses(LandUse2CN,m_Graph,LandUsesCN);
+
+      const unsigned int UnitsCount = m_Units.size();
+      const unsigned int ScenariosCount = m_TotalRains.size();
+
+      std::string Error;
+
+      if (!m_Model.build(m_Graph,LandUsesCN,ScenariosCount,Error))
+        OPENFLUID_RaiseError(Error);
+
+      RunoffNetwork& Network = m_Model.network();
+
+      for (unsigned int i = 0; i < UnitsCount; i++)
+      {
+        if (m_Graph.Classes[i] == SU_CLASS)
+          std::copy(m_TotalRains.begin(),m_TotalRains.end(),Network.rains().begin()+i*ScenariosCount);
+      }
+
+      Network.computeAll(nullptr);
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Adds a candidate for each LI whose buffer ratio of the placed type is below the placed ratio
+    */
+    void addCandidates()
+    {
+      for (unsigned int i = 0; i < m_Units.size(); i++)
+      {
+        if (m_Graph.Classes[i] != LI_CLASS)
+          continue;
+
+        double Ratios[BVServiceGraph::LISubpartsCount];
+        std::copy(&m_Graph.Ratios[i*BVServiceGraph::LISubpartsCount],
+                  &m_Graph.Ratios[(i+1)*BVServiceGraph::LISubpartsCount],Ratios);
+
+        const double Cost = m_Graph.Lengths[i]*(m_BufferRatio-Ratios[m_BufferSubpart]);
+
+        if (Cost <= 0.0)
+          continue;
+
+        Ratios[m_BufferSubpart] = m_BufferRatio;
+
+        UnitHydroParams Params;
+        m_Model.setLIParams(Params,m_Graph.Lengths[i],Ratios);
+
+        m_Placement->addCandidate(i,Cost,Params);
+      }
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    void prepareData()
+    {
+      std::map<std::string,int> LandUse2CN;
+
+      loadLandUse2CN(LandUse2CN);
+
+      buildModel(LandUse2CN);
+
+      m_Placement.reset(new BufferPlacement(m_Model.getNetwork()));
+      addCandidates();
+
+      const double InitialVolume = m_Placement->getOutletsVolume();
+
+      std::unique_ptr<WorkersPool> Pool;
+      if (m_ThreadsCount > 1)
+        Pool.reset(new WorkersPool(m_ThreadsCount));
+
+      m_Placement->run(m_Budget,Pool.get());
+
+      openfluid::core::SpatialUnit* U;
+
+      OPENFLUID_UNITS_ORDERED_LOOP("LI",U)
+      {
+        OPENFLUID_SetAttribute(U,"bufferrank",0L);
+        OPENFLUID_SetAttribute(U,"bufferlength",0.0);
+        OPENFLUID_SetAttribute(U,"buffergain",0.0);
+      }
+
+      const std::vector<BufferPlacement::Selection>& Selections = m_Placement->getSelections();
+      double Spent = 0.0;
+
+      for (unsigned int s = 0; s < Selections.size(); s++)
+      {
+        U = m_Units[Selections[s].Rank];
+
+        OPENFLUID_SetAttribute(U,"bufferrank",long(s+1));
+        OPENFLUID_SetAttribute(U,"bufferlength",Selections[s].Cost);
+        OPENFLUID_SetAttribute(U,"buffergain",Selections[s].Gain);
+
+        Spent += Selections[s].Cost;
+      }
+
+      OPENFLUID_LogInfo("Buffers placement : " << Selections.size() << " buffers, " << Spent << " m placed, "
+                        << "runoff volume reaching RS from " << InitialVolume << " to "
+                        << m_Placement->getOutletsVolume() << " m3, "
+                        << m_Placement->getEvaluationsCount() << " candidates evaluations");
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    void checkConsistency()
+    {
+
+
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    openfluid::base::SchedulingRequest initializeRun()
+    {
+      const RunoffNetwork& Network = m_Placement->getNetwork();
+      const unsigned int ScenariosCount = Network.getScenariosCount();
+
+      for (unsigned int i = 0; i < m_Units.size(); i++)
+      {
+        if (Network.getParams(i).Class == RS_CLASS)
+          OPENFLUID_InitializeVariable(m_Units[i],"bufferuprunoffvolume",
+                                       Network.getUpRunoffVolumes()[i*ScenariosCount]);
+      }
+
+      return Never();
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    openfluid::base::SchedulingRequest runStep()
+    {
+      return Never();
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    void finalizeRun()
+    {
+      m_Placement.reset();
+    }
+
+};
+
+
+// =====================================================================
+// =====================================================================
+
+
+DEFINE_SIMULATOR_CLASS(BVServiceBuffersSimulator);
+
+
+DEFINE_WARE_LINKUID(WARE_LINKUID)
@@ -0,0 +1,232 @@
+/**
+  @file BufferPlacement.cpp
+*/
+
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+
+#include "BufferPlacement.hpp"
+#include "WorkersPool.hpp"
+
+
+// =====================================================================
+// =====================================================================
+
+
+BufferPlacement::BufferPlacement(const RunoffNetwork& Network) :
+  m_Network(Network)
+{
+
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void BufferPlacement::addCandidate(unsigned int Rank, double Cost, const UnitHydroParams& Params)
+{
+  Candidate Cand;
+  Cand.Rank = Rank;
+  Cand.Cost = Cost;
+  Cand.Params = Params;
+
+  m_Candidates.push_back(Cand);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+double BufferPlacement::evaluateCandidate(RunoffNetwork& Network, const Candidate& Cand,
+                                          std::vector<unsigned int>& ComputedRanks) const
+{
+  const unsigned int ScenariosCount = Network.getScenariosCount();
+  const std::vector<double>& UpRunoffVolumes = Network.getUpRunoffVolumes();
+  const std::vector<double>& RefUpRunoffVolumes = m_Network.getUpRunoffVolumes();
+  double Gain = 0.0;
+
+  ComputedRanks.clear();
+
+  Network.setParams(Cand.Rank,Cand.Params);
+  Network.computeDownstream({Cand.Rank},&ComputedRanks);
+
+  for (auto Rank : ComputedRanks)
+  {
+    if (Network.getParams(Rank).Class == RS_CLASS)
+    {
+      for (unsigned int k = 0; k < ScenariosCount; k++)
+        Gain += RefUpRunoffVolumes[Rank*ScenariosCount+k]-UpRunoffVolumes[Rank*ScenariosCount+k];
+    }
+  }
+
+  // the copy is restored as the reference network
+  Network.copyUnits(m_Network,ComputedRanks);
+
+  return Gain;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void BufferPlacement::run(double Budget, WorkersPool* Pool)
+{
+  const unsigned int UnitsCount = m_Network.getUnitsCount();
+  const unsigned int WorkersCount = Pool ? Pool->getThreadsCount() : 1;
+  const std::vector<unsigned int>& UpBegins = m_Network.getUpBegins();
+  const std::vector<unsigned int>& UpUnits = m_Network.getUpUnits();
+
+  // one copy of the network per worker, always equal to the reference network between two evaluations
+  std::vector<RunoffNetwork> WorkersNetworks(WorkersCount,m_Network);
+
+  std::vector<unsigned int> Remaining;
+  std::vector<unsigned int> ToScore;
+  std::vector<int> CandidateOfUnit(UnitsCount,-1);
+
+  for (unsigned int c = 0; c < m_Candidates.size(); c++)
+  {
+    Remaining.push_back(c);
+    ToScore.push_back(c);
+    CandidateOfUnit[m_Candidates[c].Rank] = c;
+  }
+
+  std::vector<unsigned char> Visited(UnitsCount,0);
+  std::vector<unsigned int> ComputedRanks;
+  std::vector<unsigned int> UpStack;
+  double Spent = 0.0;
+
+  m_Selections.clear();
+  m_EvaluationsCount = 0;
+
+  while (true)
+  {
+    // candidates over the remaining budget are never selected
+    Remaining.erase(std::remove_if(Remaining.begin(),Remaining.end(),
+                                   [&](unsigned int c) { return m_Candidates[c].Cost > Budget-Spent; }),
+                    Remaining.end());
+
+    if (Remaining.empty())
+      break;
+
+    ToScore.erase(std::remove_if(ToScore.begin(),ToScore.end(),
+                                 [&](unsigned int c) { return m_Candidates[c].Cost > Budget-Spent; }),
+                  ToScore.end());
+
+    std::atomic<unsigned int> Next(0);
+
+    // each worker scores candidates taken from the shared counter on its own copy of the network
+    const std::function<void(unsigned int)> ScoreCandidates = [&](unsigned int w)
+    {
+      std::vector<unsigned int> WorkerComputedRanks;
+      unsigned int i;
+
+      while ((i = Next.fetch_add(1)) < ToScore.size())
+      {
+        Candidate& Cand = m_Candidates[ToScore[i]];
+        Cand.Gain = evaluateCandidate(WorkersNetworks[w],Cand,WorkerComputedRanks);
+      }
+    };
+
+    if (Pool)
+      Pool->parallelFor(0,WorkersCount,1,ScoreCandidates);
+    else
+      ScoreCandidates(0);
+
+    m_EvaluationsCount += ToScore.size();
+
+    // best gain per length, the first candidate being kept on ties so results do not depend on threads
+    int Best = -1;
+
+    for (auto c : Remaining)
+    {
+      if (m_Candidates[c].Gain > 0.0 &&
+          (Best < 0 || m_Candidates[c].Gain*m_Candidates[Best].Cost > m_Candidates[Best].Gain*m_Candidates[c].Cost))
+        Best = c;
+    }
+
+    if (Best < 0)
+      break;
+
+    const Candidate& Selected = m_Candidates[Best];
+
+    Selection Sel;
+    Sel.Rank = Selected.Rank;
+    Sel.Cost = Selected.Cost;
+    Sel.Gain = Selected.Gain;
+    m_Selections.push_back(Sel);
+
+    Spent += Selected.Cost;
+    CandidateOfUnit[Selected.Rank] = -1;
+
+    ComputedRanks.clear();
+    m_Network.setParams(Selected.Rank,Selected.Params);
+    m_Network.computeDownstream({Selected.Rank},&ComputedRanks);
+
+    for (auto& Network : WorkersNetworks)
+      Network.copyUnits(m_Network,ComputedRanks);
+
+    // buffers only reduce runoff volumes, so a candidate without gain never gets one
+    Remaining.erase(std::remove_if(Remaining.begin(),Remaining.end(),
+                                   [&](unsigned int c) { return int(c) == Best || m_Candidates[c].Gain <= 0.0; }),
+                    Remaining.end());
+
+    // the gain of a candidate only depends on the units downstream of it,
+    // so only candidates upstream of the recomputed units are scored again
+    ToScore.clear();
+    UpStack = ComputedRanks;
+    std::fill(Visited.begin(),Visited.end(),0);
+
+    for (auto Rank : UpStack)
+      Visited[Rank] = 1;
+
+    while (!UpStack.empty())
+    {
+      const unsigned int Rank = UpStack.back();
+      UpStack.pop_back();
+
+      if (CandidateOfUnit[Rank] >= 0)
+        ToScore.push_back(CandidateOfUnit[Rank]);
+
+      for (unsigned int u = UpBegins[Rank]; u < UpBegins[Rank+1]; u++)
+      {
+        if (!Visited[UpUnits[u]])
+        {
+          Visited[UpUnits[u]] = 1;
+          UpStack.push_back(UpUnits[u]);
+        }
+      }
+    }
+
+    ToScore.erase(std::remove_if(ToScore.begin(),ToScore.end(),
+                                 [&](unsigned int c) { return m_Candidates[c].Gain <= 0.0; }),
+                  ToScore.end());
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+double BufferPlacement::getOutletsVolume() const
+{
+  const unsigned int ScenariosCount = m_Network.getScenariosCount();
+  const std::vector<double>& UpRunoffVolumes = m_Network.getUpRunoffVolumes();
+  double Volume = 0.0;
+
+  for (unsigned int i = 0; i < m_Network.getUnitsCount(); i++)
+  {
+    if (m_Network.getParams(i).Class == RS_CLASS)
+    {
+      for (unsigned int k = 0; k < ScenariosCount; k++)
+        Volume += UpRunoffVolumes[i*ScenariosCount+k];
+    }
+  }
+
+  return Volume;
+}
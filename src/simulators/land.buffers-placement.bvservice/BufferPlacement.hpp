@@ -0,0 +1,122 @@
+/**
+  @file BufferPlacement.hpp
+*/
+
+
+#ifndef __BUFFERPLACEMENT_HPP__
+#define __BUFFERPLACEMENT_HPP__
+
+
+#include <vector>
+
+#include "RunoffNetwork.hpp"
+
+
+class WorkersPool;
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Greedy placement of buffers (grass strips, hedges) on LI under a budget of buffers length.
+  At each iteration, the candidate with the best reduction of the runoff volume reaching RS per length
+  is selected, until no remaining candidate fits the budget or reduces this volume.
+
+  A candidate is scored by computing only the units downstream of it on a copy of the network,
+  which is restored afterwards, so candidates are scored concurrently on one copy per thread.
+  After a selection, only the candidates upstream of the recomputed units are scored again,
+  the score of the other ones being unchanged
+*/
+class BufferPlacement
+{
+  public:
+
+    class Candidate
+    {
+      public:
+
+        unsigned int Rank = 0;
+
+        // added buffers length
+        double Cost = 0.0;
+
+        // parameters of the LI with the buffer
+        UnitHydroParams Params;
+
+        double Gain = 0.0;
+    };
+
+    class Selection
+    {
+      public:
+
+        unsigned int Rank = 0;
+
+        double Cost = 0.0;
+
+        // reduction of the runoff volume reaching RS, summed over scenarios
+        double Gain = 0.0;
+    };
+
+
+  private:
+
+    // network with the selected buffers, computed
+    RunoffNetwork m_Network;
+
+    std::vector<Candidate> m_Candidates;
+
+    std::vector<Selection> m_Selections;
+
+    unsigned long m_EvaluationsCount = 0;
+
+
+    double evaluateCandidate(RunoffNetwork& Network, const Candidate& Cand,
+                             std::vector<unsigned int>& ComputedRanks) const;
+
+
+  public:
+
+    /**
+      @param[in] Network the network without buffers added, with all units computed
+    */
+    BufferPlacement(const RunoffNetwork& Network);
+
+    /**
+      Adds a candidate placement, only one candidate per LI should be added
+      @param[in] Rank the rank of the LI
+      @param[in] Cost the buffers length added by the placement, must be positive
+      @param[in] Params the parameters of the LI with the buffers added
+    */
+    void addCandidate(unsigned int Rank, double Cost, const UnitHydroParams& Params);
+
+    /**
+      Selects candidates within the given budget, scoring candidates on the given pool if any
+    */
+    void run(double Budget, WorkersPool* Pool);
+
+    const std::vector<Selection>& getSelections() const
+    {
+      return m_Selections;
+    }
+
+    const RunoffNetwork& getNetwork() const
+    {
+      return m_Network;
+    }
+
+    unsigned long getEvaluationsCount() const
+    {
+      return m_EvaluationsCount;
+    }
+
+    /**
+      @return the runoff volume reaching RS, summed over scenarios
+    */
+    double getOutletsVolume() const;
+};
+
+
+#endif /* __BUFFERPLACEMENT_HPP__ */
@@ -10,11 +10,14 @@
 */
 
 
-#include <limits>
+#include <vector>
+#include <map>
 
 #include <openfluid/ware/PluggableSimulator.hpp>
 #include <openfluid/tools/DataHelpers.hpp>
-#include <openfluid/scientific/FloatingPoint.hpp>
+
+#include "IndicatorsModel.hpp"
+#include "BVServiceSimulator.hpp"
 
 
 // =====================================================================
@@ -73,17 +76,22 @@ END_SIMULATOR_SIGNATURE
 /**
 
 */
-class BVServiceIndicatorsSimulator : public openfluid::ware::PluggableSimulator
+class BVServiceIndicatorsSimulator : public BVServiceSimulator
 {
   private:
 
-    typedef std::map<std::string,double> UpperAreaMap_t;
+    IndicatorsModel m_Model;
+
+    // hydrologic results of the current step, by rank
+    std::vector<double> m_UpRunoffVolumes;
+    std::vector<double> m_RunoffVolumes;
+    std::vector<double> m_InfiltVolumes;
 
 
   public:
 
 
-    BVServiceIndicatorsSimulator(): PluggableSimulator()
+    BVServiceIndicatorsSimulator(): BVServiceSimulator()
     {
 
 
@@ -105,293 +113,6 @@ class BVServiceIndicatorsSimulator : public openfluid::ware::PluggableSimulator
     // =====================================================================
 
 
-    void normalizeVariable(const openfluid::core::UnitsClass_t& ClassName,
-                           const openfluid::core::VariableName_t& VarName)
-    {
-      openfluid::core::SpatialUnit* U;
-      double Max = std::numeric_limits<double>::min();
-      double Min = std::numeric_limits<double>::max();
-
-      OPENFLUID_UNITS_ORDERED_LOOP(ClassName,U)
-      {
-        double Val = OPENFLUID_GetLatestVariable(U,VarName).value()->asDoubleValue().get();
-
-        if (!std::isnan(Val))
-        {
-          Min = std::min(Min,Val);
-          Max = std::max(Max,Val);
-        }
-      }
-
-      // OPENFLUID_DisplayInfo("Variable " << VarName << " on " << ClassName << " : " << Min << " -> " << Max);
-
-      OPENFLUID_UNITS_ORDERED_LOOP(ClassName,U)
-      {
-        double Val = OPENFLUID_GetLatestVariable(U,VarName).value()->asDoubleValue().get();
-
-        if (!std::isnan(Val))
-        {
-          double NormVal = (Val - Min) / (Max - Min);
-          OPENFLUID_SetVariable(U,VarName,NormVal);
-        }
-      }
-    }
-
-
-    // =====================================================================
-    // =====================================================================
-
-    std::string getXClassID(const openfluid::core::SpatialUnit* U)
-    {
-      return U->getClass()+"#"+openfluid::tools::convertValue(U->getID());
-    }
-
-
-    // =====================================================================
-    // =====================================================================
-
-
-    void computeUpperUpperAreaRecursively(openfluid::core::SpatialUnit* U,
-                                          UpperAreaMap_t& MapArea)
-    {
-
-      // postfixed depth-first search to process leafs first and go back to root
-
-
-      std::vector<openfluid::core::SpatialUnit*> UpperUnits;
-
-
-      // --- go to leafs recursively
-      openfluid::core::UnitsPtrList_t* UpperLI = U->fromSpatialUnits("LI");
-      openfluid::core::UnitsPtrList_t* UpperSU = U->fromSpatialUnits("SU");
-
-
-
-      if (UpperLI)
-      {
-        openfluid::core::SpatialUnit* UpU;
-
-        OPENFLUID_UNITSLIST_LOOP(UpperLI,UpU)
-        {
-          UpperUnits.push_back(UpU);
-        }
-      }
-
-
-      if (UpperSU)
-      {
-        openfluid::core::SpatialUnit* UpU;
-
-        OPENFLUID_UNITSLIST_LOOP(UpperSU,UpU)
-        {
-          UpperUnits.push_back(UpU);
-        }
-      }
-
-
-
-      for (auto UpU : UpperUnits)
-      {
-        computeUpperUpperAreaRecursively(UpU,MapArea);
-      }
-
-
-
-      double UpperAreaSum = 0.0;
-      double Area = 0;
-
-      for (auto UpU : UpperUnits)
-      {
-        UpperAreaSum = UpperAreaSum + MapArea[getXClassID(UpU)];
-      }
-
-      if (U->getClass() == "SU")
-        OPENFLUID_GetAttribute(U,"area",Area);
-
-      UpperAreaSum = UpperAreaSum + Area;
-      MapArea[getXClassID(U)] = UpperAreaSum;
-
-    }
-
-
-    // =====================================================================
-    // =====================================================================
-
-
-    void computeBuffersCountToNetworkRecursively(openfluid::core::SpatialUnit* U, int Counter)
-    {
-
-      // prefixed depth-first search to process from root to leafs
-
-//      OPENFLUID_DisplayInfo("BuffersCount : entering unit " << U->getClass() << "#" << U->getID());
-
-      if (U->getClass() == "SU")
-        OPENFLUID_AppendVariable(U,"bufferscount",(long)Counter);
-
-      int NewCounter = Counter;
-
-      if (U->getClass() == "LI")
-      {
-        double HedgeRatio, GrassRatio, BenchRatio;
-        OPENFLUID_GetAttribute(U,"hedgesratio",HedgeRatio);
-        OPENFLUID_GetAttribute(U,"grassbsratio",GrassRatio);
-        OPENFLUID_GetAttribute(U,"benchesratio",BenchRatio);
-
-        if (GrassRatio+HedgeRatio+BenchRatio > 0)
-          NewCounter++;
-      }
-      else if (U->getClass() == "SU")
-      {
-        std::string LandUse;
-        OPENFLUID_GetAttribute(U,"landuse",LandUse);
-        if (LandUse == "buffer") // TODO uncorrect to fix
-          NewCounter++;
-      }
-
-
-      std::set<openfluid::core::SpatialUnit*> UpperUnits;
-
-      openfluid::core::UnitsPtrList_t* TmpUpperList;
-      TmpUpperList = U->fromSpatialUnits("SU");
-      if (TmpUpperList != nullptr)
-      {
-        for (auto TmpU : *TmpUpperList)
-          UpperUnits.insert(TmpU);
-      }
-
-
-      TmpUpperList = U->fromSpatialUnits("LI");
-      if (TmpUpperList != nullptr)
-      {
-        for (auto TmpU : *TmpUpperList)
-          UpperUnits.insert(TmpU);
-      }
-
-
-      if (!UpperUnits.empty()) //if UpperUnits not empty, upstream Units are present
-      {
-        for(auto UpU : UpperUnits) // loop for each upstream unit
-        {
-          computeBuffersCountToNetworkRecursively(UpU,NewCounter);
-        }
-      }
-
-    }
-
-
-    // =====================================================================
-    // =====================================================================
-
-
-    void computeCumulatedInfiltrationFromNetworkRecursively(openfluid::core::SpatialUnit* U, double InfiltSum)
-    {
-
-      // prefixed depth-first search to process from root to leafs
-
-      // OPENFLUID_DisplayInfo("Infilt sum : entering unit " << U->getClass() << "#" << U->getID());
-
-      double  NewInfiltSum = InfiltSum;
-
-      if (U->getClass() == "SU")
-      {
-        NewInfiltSum = NewInfiltSum + OPENFLUID_GetVariable(U,"infiltvolume")->asDoubleValue();
-        OPENFLUID_AppendVariable(U,"infiltvolsum",NewInfiltSum);
-      }
-
-
-
-      std::set<openfluid::core::SpatialUnit*> UpperUnits;
-
-      openfluid::core::UnitsPtrList_t* TmpUpperList;
-      TmpUpperList = U->fromSpatialUnits("SU");
-      if (TmpUpperList != nullptr)
-
-      {
-        for (auto TmpU : *TmpUpperList)
-          UpperUnits.insert(TmpU);
-      }
-
-
-      TmpUpperList = U->fromSpatialUnits("LI");
-      if (TmpUpperList != nullptr)
-      {
-        for (auto TmpU : *TmpUpperList)
-          UpperUnits.insert(TmpU);
-      }
-
-
-
-      if (!UpperUnits.empty()) //if UpperUnits not empty, upstream Units are present
-      {
-        for(auto UpU : UpperUnits) // loop for each upstream unit
-        {
-          computeCumulatedInfiltrationFromNetworkRecursively(UpU,NewInfiltSum);
-        }
-      }
-
-    }
-
-
-    // =====================================================================
-    // =====================================================================
-
-
-    void computeCumulatedInfilRatioFromNetworkRecursively(openfluid::core::SpatialUnit* U, double InfiltSum)
-    {
-
-      // prefixed depth-first search to process from root to leafs
-
-      // OPENFLUID_DisplayInfo("Infilt ratio sum : entering unit " << U->getClass() << "#" << U->getID());
-      //
-      // OPENFLUID_LogInfo(U->getClass() << "#" << U->getID());
-
-
-      double  NewInfiltSum = InfiltSum;
-
-      if (U->getClass() == "SU")
-        OPENFLUID_AppendVariable(U,"infiltvolratiosum",NewInfiltSum);
-
-      if (U->getClass() == "SU" || U->getClass() == "LI")
-      {
-        NewInfiltSum = NewInfiltSum + OPENFLUID_GetVariable(U,"infiltvolratio")->asDoubleValue();
-      }
-
-      std::set<openfluid::core::SpatialUnit*> UpperUnits;
-
-      openfluid::core::UnitsPtrList_t* TmpUpperList;
-      TmpUpperList = U->fromSpatialUnits("SU");
-      if (TmpUpperList != nullptr)
-
-      {
-        for (auto TmpU : *TmpUpperList)
-          UpperUnits.insert(TmpU);
-      }
-
-
-      TmpUpperList = U->fromSpatialUnits("LI");
-      if (TmpUpperList != nullptr)
-      {
-        for (auto TmpU : *TmpUpperList)
-          UpperUnits.insert(TmpU);
-      }
-
-
-      if (!UpperUnits.empty()) //if UpperUnits not empty, upstream Units are present
-      {
-        for(auto UpU : UpperUnits) // loop for each upstream unit
-        {
-
-          computeCumulatedInfilRatioFromNetworkRecursively(UpU,NewInfiltSum);
-        }
-      }
-
-    }
-
-
-    // =====================================================================
-    // =====================================================================
-
-
     void initParams(const openfluid::ware::WareParams_t& /*Params*/)
     {
 
@@ -405,8 +126,17 @@ class BVServiceIndicatorsSimulator : public openfluid::ware::PluggableSimulator
 
     void prepareData()
     {
+      BVServiceGraph Graph;
+      std::string Error;
+
+      buildGraph(Graph,GRAPH_INDICATORS);
 
+      if (!m_Model.build(Graph,Error))
+        OPENFLUID_RaiseError(Error);
 
+      m_UpRunoffVolumes.assign(m_Units.size(),0.0);
+      m_RunoffVolumes.assign(m_Units.size(),0.0);
+      m_InfiltVolumes.assign(m_Units.size(),0.0);
     }
 
 
@@ -458,6 +188,8 @@ class BVServiceIndicatorsSimulator : public openfluid::ware::PluggableSimulator
         OPENFLUID_InitializeVariable(U,"infiltvolratio",0.0);
       }
 
+      m_Model.reset();
+
       return DefaultDeltaT();
     }
 
@@ -470,318 +202,70 @@ class BVServiceIndicatorsSimulator : public openfluid::ware::PluggableSimulator
     {
       openfluid::core::SpatialUnit* U;
 
+      const UnitsClassIndex& Classes = m_Model.getClasses();
+      const std::vector<unsigned int>& SURanks = Classes.getRanks(SU_CLASS);
+      const std::vector<unsigned int>& LIRanks = Classes.getRanks(LI_CLASS);
 
-      // ============= Upper area
-
-
-      UpperAreaMap_t UpperAreaMap;
-
-      OPENFLUID_ALLUNITS_ORDERED_LOOP(U)
-      {
-        UpperAreaMap[getXClassID(U)] = 0.0;
-      }
-
-      OPENFLUID_ALLUNITS_ORDERED_LOOP(U)
-      {
-        if (U->toSpatialUnits("SU") == nullptr &&
-            U->toSpatialUnits("RS") == nullptr &&
-            U->toSpatialUnits("LI") == nullptr)
-        {
-          computeUpperUpperAreaRecursively(U,UpperAreaMap);
-        }
-      }
-
-
-      OPENFLUID_ALLUNITS_ORDERED_LOOP(U)
-      {
-        OPENFLUID_AppendVariable(U,"upperarea",UpperAreaMap[getXClassID(U)]);
-      }
-
+      // the hydro simulator may skip time steps (e.g. dry periods of a rainfall series),
+      // indicators are only computed at the steps where its results are produced
+      const std::vector<unsigned int>& ProducingRanks = SURanks.empty() ? LIRanks : SURanks;
 
-      // ============= Buffers
+      if (!ProducingRanks.empty() &&
+          !OPENFLUID_IsVariableExist(m_Units[ProducingRanks.front()],"runoffvolume",OPENFLUID_GetCurrentTimeIndex()))
+        return DefaultDeltaT();
 
-      OPENFLUID_UNITS_ORDERED_LOOP("RS",U)
+      for (auto Ranks : {&SURanks,&LIRanks})
       {
-        std::set<openfluid::core::SpatialUnit*> UpperUnits;
-
-        openfluid::core::UnitsPtrList_t* TmpUpperList;
-        TmpUpperList = U->fromSpatialUnits("SU");
-        if (TmpUpperList != nullptr)
+        for (auto Rank : *Ranks)
         {
-          for (auto TmpU : *TmpUpperList)
-            UpperUnits.insert(TmpU);
-        }
+          U = m_Units[Rank];
 
-
-        TmpUpperList = U->fromSpatialUnits("LI");
-        if (TmpUpperList != nullptr)
-        {
-          for (auto TmpU : *TmpUpperList)
-            UpperUnits.insert(TmpU);
+          m_UpRunoffVolumes[Rank] = OPENFLUID_GetVariable(U,"uprunoffvolume")->asDoubleValue().get();
+          m_RunoffVolumes[Rank] = OPENFLUID_GetVariable(U,"runoffvolume")->asDoubleValue().get();
+          m_InfiltVolumes[Rank] = OPENFLUID_GetVariable(U,"infiltvolume")->asDoubleValue().get();
         }
-
-
-        if (!UpperUnits.empty()) //if UpperUnits not empty, upstream Units are present
-        {
-          for(auto UpU : UpperUnits) // loop for each upstream unit
-          {
-            computeBuffersCountToNetworkRecursively(UpU,0);
-          }
-        }
-
       }
 
+      m_Model.compute(m_UpRunoffVolumes.data(),m_RunoffVolumes.data(),m_InfiltVolumes.data());
 
-      // ============= Cumulated infiltration to network
 
+      for (unsigned int i = 0; i < m_Units.size(); i++)
+        OPENFLUID_AppendVariable(m_Units[i],"upperarea",m_Model.getUpperAreas()[i]);
 
-      OPENFLUID_UNITS_ORDERED_LOOP("RS",U)
+      for (unsigned int s = 0; s < SURanks.size(); s++)
       {
-        std::set<openfluid::core::SpatialUnit*> UpperUnits;
+        U = m_Units[SURanks[s]];
 
-        openfluid::core::UnitsPtrList_t* TmpUpperList;
-        TmpUpperList = U->fromSpatialUnits("SU");
-        if (TmpUpperList != nullptr)
+        if (m_Model.isFromRS(SURanks[s]))
         {
-          for (auto TmpU : *TmpUpperList)
-            UpperUnits.insert(TmpU);
+          OPENFLUID_AppendVariable(U,"bufferscount",m_Model.getSUBuffersCounts()[s]);
+          OPENFLUID_AppendVariable(U,"infiltvolsum",m_Model.getSUInfiltVolSums()[s]);
         }
 
+        OPENFLUID_AppendVariable(U,"runoffvoldelta",m_Model.getSURunoffVolDeltas()[s]);
+        OPENFLUID_AppendVariable(U,"runoffvolratio",m_Model.getSURunoffVolRatios()[s]);
+        OPENFLUID_AppendVariable(U,"infiltvolratio",m_Model.getSUInfiltVolRatios()[s]);
 
-        TmpUpperList = U->fromSpatialUnits("LI");
-        if (TmpUpperList != nullptr)
-        {
-          for (auto TmpU : *TmpUpperList)
-            UpperUnits.insert(TmpU);
-        }
+        if (m_Model.isFromRSOrOutletLI(SURanks[s]))
+          OPENFLUID_AppendVariable(U,"infiltvolratiosum",m_Model.getSUInfiltVolRatioSums()[s]);
 
-
-        if (!UpperUnits.empty()) //if UpperUnits not empty, upstream Units are present
-        {
-          for(auto UpU : UpperUnits) // loop for each upstream unit
-          {
-            computeCumulatedInfiltrationFromNetworkRecursively(UpU,0.0);
-          }
-        }
-
-      }
-
-
-      // ============= SU delta volume and ratio volume
-
-
-      OPENFLUID_UNITS_ORDERED_LOOP("SU",U)
-      {
-        double UpRunoffVol = OPENFLUID_GetVariable(U,"uprunoffvolume")->asDoubleValue().get();
-        double RunoffVol = OPENFLUID_GetVariable(U,"runoffvolume")->asDoubleValue().get();
-        double Slope = OPENFLUID_GetAttribute(U,"slopemean")->asDoubleValue().get();
-
-        double DeltaVolume = RunoffVol - UpRunoffVol;
-
-        double RatioVolume = 0.0;
-        if (openfluid::scientific::isVeryClose(UpRunoffVol,0.0))
-          RatioVolume = std::numeric_limits<double>::quiet_NaN();
-        else if (openfluid::scientific::isVeryClose(DeltaVolume,0.0))
-          RatioVolume = 0.0;
-        else
-          RatioVolume = DeltaVolume / UpRunoffVol;
-
-        OPENFLUID_AppendVariable(U,"runoffvoldelta",DeltaVolume);
-        OPENFLUID_AppendVariable(U,"runoffcontrib",DeltaVolume);
-        OPENFLUID_AppendVariable(U,"runoffvolratio",RatioVolume);
-        OPENFLUID_AppendVariable(U,"erosionrisk",RunoffVol*Slope);
+        OPENFLUID_AppendVariable(U,"conndegree",m_Model.getSUConnDegrees()[s]);
+        OPENFLUID_AppendVariable(U,"erosionrisk",m_Model.getSUErosionRisks()[s]);
+        OPENFLUID_AppendVariable(U,"runoffcontrib",m_Model.getSURunoffContribs()[s]);
       }
 
-
-      // ============= LI delta volume, ratio volume and concentration degree
-
-
-      OPENFLUID_UNITS_ORDERED_LOOP("LI",U)
+      for (unsigned int l = 0; l < LIRanks.size(); l++)
       {
-        double UpRunoffVol = OPENFLUID_GetVariable(U,"uprunoffvolume")->asDoubleValue().get();
-        double RunoffVol = OPENFLUID_GetVariable(U,"runoffvolume")->asDoubleValue().get();
-
-        double DeltaVolume = RunoffVol - UpRunoffVol;
-
-        double RatioVolume = 0.0;
-        if (openfluid::scientific::isVeryClose(UpRunoffVol,0.0))
-          RatioVolume = std::numeric_limits<double>::quiet_NaN();
-        else if (openfluid::scientific::isVeryClose(DeltaVolume,0.0))
-          RatioVolume = 0.0;
-        else
-          RatioVolume = DeltaVolume / UpRunoffVol;
-
-        OPENFLUID_AppendVariable(U,"runoffvoldelta",DeltaVolume);
-        OPENFLUID_AppendVariable(U,"runoffvolratio",RatioVolume);
+        U = m_Units[LIRanks[l]];
 
-        double Length = OPENFLUID_GetAttribute(U,"length")->asDoubleValue().get();
-        OPENFLUID_AppendVariable(U,"concdegree",UpRunoffVol/Length);
+        OPENFLUID_AppendVariable(U,"runoffvoldelta",m_Model.getLIRunoffVolDeltas()[l]);
+        OPENFLUID_AppendVariable(U,"runoffvolratio",m_Model.getLIRunoffVolRatios()[l]);
+        OPENFLUID_AppendVariable(U,"infiltvolratio",m_Model.getLIInfiltVolRatios()[l]);
+        OPENFLUID_AppendVariable(U,"concdegree",m_Model.getLIConcDegrees()[l]);
+        OPENFLUID_AppendVariable(U,"importancedegree",m_Model.getLIImportanceDegrees()[l]);
+        OPENFLUID_AppendVariable(U,"interestdegree",m_Model.getLIInterestDegrees()[l]);
       }
 
-
-      // ============= LI downstream infiltrated volume and importance degree
-
-      static const std::list<std::string> Subparts = {"benches","grassbs","hedges"};
-
-      OPENFLUID_UNITS_ORDERED_LOOP("LI",U)
-      {
-        // Former method
-        /*openfluid::core::UnitsPtrList_t* TmpDownList;
-
-        TmpDownList = U->toSpatialUnits("SU");
-
-
-        double SUNegRatioSum = 0.0;
-        double LIRatioSum  = 0.0;
-
-        if (TmpDownList)
-        {
-          for (auto TmpU : *TmpDownList)
-          {
-            double RunoffVol = OPENFLUID_GetVariable(TmpU,"runoffvolratio")->asDoubleValue().get();
-            if (RunoffVol < 0.0)
-              SUNegRatioSum += RunoffVol;
-          }
-        }
-
-        TmpDownList = U->toSpatialUnits("LI");
-        if (TmpDownList)
-        {
-          for (auto TmpU : *TmpDownList)
-          {
-            double RunoffVol = OPENFLUID_GetVariable(TmpU,"runoffvolratio")->asDoubleValue().get();
-            LIRatioSum += RunoffVol;
-          }
-        }
-
-        double InfiltVolRatioDown = SUNegRatioSum+LIRatioSum;
-        OPENFLUID_AppendVariable(U,"infiltvolratio",SUNegRatioSum+LIRatioSum);
-
-        double UpRunoffVol = OPENFLUID_GetVariable(U,"uprunoffvolume")->asDoubleValue().get();
-        double RunoffVol = OPENFLUID_GetVariable(U,"runoffvolume")->asDoubleValue().get();
-        OPENFLUID_AppendVariable(U,"importancedegree",UpRunoffVol-(RunoffVol*InfiltVolRatioDown));
-        */
-
-        double InfiltVol = OPENFLUID_GetVariable(U,"infiltvolume")->asDoubleValue().get();
-        double UpRunoffVol = OPENFLUID_GetVariable(U,"uprunoffvolume")->asDoubleValue().get();
-
-        if (openfluid::scientific::isVeryClose(UpRunoffVol,0.0))
-          OPENFLUID_AppendVariable(U,"infiltvolratio",0.0);
-        else
-          OPENFLUID_AppendVariable(U,"infiltvolratio",InfiltVol/UpRunoffVol);
-
-
-
-        bool Occupied = false;
-
-        for (auto LinearPart : Subparts)
-        {
-          double Ratio = 0.0;
-          OPENFLUID_GetAttribute(U,LinearPart+"ratio",Ratio);
-
-          if (Ratio > 0.0)
-            Occupied = true;
-        }
-
-        if (Occupied)
-        {
-          OPENFLUID_AppendVariable(U,"importancedegree",InfiltVol);
-          OPENFLUID_AppendVariable(U,"interestdegree",std::numeric_limits<double>::quiet_NaN());
-        }
-        else
-        {
-          OPENFLUID_AppendVariable(U,"importancedegree",std::numeric_limits<double>::quiet_NaN());
-          OPENFLUID_AppendVariable(U,"interestdegree",UpRunoffVol);
-        }
-      }
-
-
-      // ============= SU infiltration ratio
-
-      OPENFLUID_UNITS_ORDERED_LOOP("SU",U)
-      {
-        openfluid::core::UnitsPtrList_t* TmpUpList;
-
-        TmpUpList = U->fromSpatialUnits("SU");
-
-
-        double UpRunoffVol = 0.0;
-
-        if (TmpUpList)
-        {
-          for (auto TmpU : *TmpUpList)
-          {
-            double RunoffVol = OPENFLUID_GetVariable(TmpU,"runoffvolume")->asDoubleValue().get();
-            UpRunoffVol += RunoffVol;
-          }
-        }
-
-
-        TmpUpList = U->fromSpatialUnits("LI");
-        if (TmpUpList)
-        {
-          for (auto TmpU : *TmpUpList)
-          {
-            double RunoffVol = OPENFLUID_GetVariable(TmpU,"runoffvolume")->asDoubleValue().get();
-            UpRunoffVol += RunoffVol;
-          }
-        }
-
-
-
-        double InfiltVol = OPENFLUID_GetVariable(U,"infiltvolume")->asDoubleValue().get();
-
-        if (openfluid::scientific::isVeryClose(UpRunoffVol,0.0))
-          OPENFLUID_AppendVariable(U,"infiltvolratio",0.0);
-        else
-          OPENFLUID_AppendVariable(U,"infiltvolratio",InfiltVol/UpRunoffVol);
-
-      }
-
-
-      // ============= SU downstream infiltrated volume and connectivity degree
-
-      OPENFLUID_UNITS_ORDERED_LOOP("RS",U)
-      {
-        computeCumulatedInfilRatioFromNetworkRecursively(U,0);
-      }
-
-      // for units not connected to network - review method
-      OPENFLUID_UNITS_ORDERED_LOOP("LI",U)
-      {
-        bool IsLeaf = OPENFLUID_GetAttribute(U,"isoutlet")->asBooleanValue().get();
-        if (IsLeaf)
-          computeCumulatedInfilRatioFromNetworkRecursively(U,0);
-      }
-
-      OPENFLUID_UNITS_ORDERED_LOOP("SU",U)
-      {
-        double InfiltVolRatioSum = 0.0;
-        InfiltVolRatioSum = OPENFLUID_GetLatestVariable(U,"infiltvolratiosum").value()->asDoubleValue().get();
-
-        /*openfluid::core::UnitsPtrList_t* TmpToList = nullptr;
-        TmpToList = U->toSpatialUnits("LI");
-        if (TmpToList)
-        {
-          for (auto TmpU : *TmpToList)
-          {
-            InfiltVolRatioSum += OPENFLUID_GetLatestVariable(TmpU,"infiltvolratiosum").value()->asDoubleValue().get();
-
-          }
-        }*/
-
-        OPENFLUID_AppendVariable(U,"conndegree",InfiltVolRatioSum);
-      }
-
-
-      normalizeVariable("SU","conndegree");
-      normalizeVariable("SU","erosionrisk");
-      normalizeVariable("SU","runoffcontrib");
-
-      normalizeVariable("LI","importancedegree");
-      normalizeVariable("LI","interestdegree");
-      normalizeVariable("LI","concdegree");
-
       return DefaultDeltaT();
     }
 
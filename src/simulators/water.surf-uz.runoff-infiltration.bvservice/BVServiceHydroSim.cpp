@@ -12,12 +12,25 @@
 
 #include <iostream>
 #include <cassert>
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <gdal_priv.h>
 
 #include <openfluid/ware/PluggableSimulator.hpp>
 #include <openfluid/scientific/FloatingPoint.hpp>
-#include <openfluid/tools/ColumnTextParser.hpp>
 #include <openfluid/tools/DataHelpers.hpp>
 
+#include "WorkersPool.hpp"
+#include "RainfallSeries.hpp"
+#include "ZonalWeights.hpp"
+#include "HydroModel.hpp"
+#include "TravelTimeRouting.hpp"
+#include "BVServiceSimulator.hpp"
+
 
 // =====================================================================
 // =====================================================================
@@ -34,19 +47,63 @@ BEGIN_SIMULATOR_SIGNATURE("water.surf-uz.runoff-infiltration.bvservice")
 
   DECLARE_REQUIRED_EXTRAFILE("landuse2CN.fr.txt")
 
-  DECLARE_USED_PARAMETER("totalrain","total rainfall","m")
+  DECLARE_USED_PARAMETER("totalrain","total rainfall, or total rainfalls of scenarios separated by ';'. "
+                                     "Scalar variables are the results of the first scenario","m")
   DECLARE_USED_PARAMETER("SUinfiltcoeff","coefficient to apply to all potential infiltrations on SU","")
   DECLARE_USED_PARAMETER("LIinfiltcoeff","coefficient to apply to all potential infiltrations on LI","")
+  DECLARE_USED_PARAMETER("rainfile","rainfall series file in the input directory, replacing totalrain. "
+                                    "Time steps are scheduled at the first default DeltaT multiple ending rainy records, "
+                                    "dry records are skipped","")
+  DECLARE_USED_PARAMETER("eventgap","dry duration starting a new rainfall event when using a rainfall series, "
+                                    "default is 86400","s")
+  DECLARE_USED_PARAMETER("rainrasters","rainfall rasters in the input directory, separated by ';', "
+                                       "replacing totalrain. Each raster is a scenario, "
+                                       "the rainfall on a SU being the mean of the pixels covering it","")
+  DECLARE_USED_PARAMETER("rainrasterscale","coefficient converting rainfall rasters values to meters, "
+                                           "default is 1","")
+  DECLARE_USED_PARAMETER("rainweightscache","file for caching the pixels weights of the SU, "
+                                            "rebuilt when the rasters grid or the SU geometries change","")
+  DECLARE_USED_PARAMETER("ensemblemembers","count of members of the Monte Carlo ensemble, "
+                                           "producing the ensemble variables (0 for no ensemble, default is 0). "
+                                           "Not available with a rainfall series","")
+  DECLARE_USED_PARAMETER("ensembleseed","seed of the random streams of the ensemble members, default is 0","")
+  DECLARE_USED_PARAMETER("ensemblecn","distribution of the perturbation added to the CN of each land use, "
+                                      "as normal:<stddev>, uniform:<halfwidth>, triangular:<halfwidth> "
+                                      "or lognormal:<sigma>","")
+  DECLARE_USED_PARAMETER("ensemblerain","distribution of the relative perturbation of the rainfall, "
+                                        "same syntax as ensemblecn","")
+  DECLARE_USED_PARAMETER("ensembleindicators","computes the indicators of each ensemble member, "
+                                              "producing the ensemble variables of indicators "
+                                              "(0 or 1, default is 0)","")
+  DECLARE_USED_PARAMETER("sensitivities","computes the runoff sensitivities to CN and LI ratios "
+                                         "(0 or 1, default is 0)","")
+  DECLARE_USED_PARAMETER("routingvelocity","flow velocity converting the flow distances to travel times, "
+                                           "enabling the travel-time routing to RS (0 for no routing, default is 0)",
+                                           "m/s")
+  DECLARE_USED_PARAMETER("routinginterval","duration of the intervals of the RS hydrographs, default is 60","s")
+  DECLARE_USED_PARAMETER("routingkernel","base duration of the triangular unit hydrograph spreading the runoff "
+                                         "reaching RS (0 for no spreading, default is 0)","s")
+  DECLARE_USED_PARAMETER("threads","number of threads for runoff routing, units of a same process order "
+                                   "being computed in parallel (1 for serial routing, default is 1)","")
 
   DECLARE_PRODUCED_ATTRIBUTE("CN","SU","","")
 
   DECLARE_REQUIRED_ATTRIBUTE("landuse","SU","","")
+  DECLARE_USED_ATTRIBUTE("landuseidx","SU","index of the land use code, from the import","")
   DECLARE_REQUIRED_ATTRIBUTE("area","SU","","")
 
   DECLARE_REQUIRED_ATTRIBUTE("length","LI","length of the linear interface","m")
   DECLARE_REQUIRED_ATTRIBUTE("grassbsratio","LI","ratio of the length which is grass strips","m")
   DECLARE_REQUIRED_ATTRIBUTE("hedgesratio","LI","ratio of the length which is hedges","m")
 
+  DECLARE_USED_ATTRIBUTE("origid","SU","original ID, naming the rainfall columns of a rainfall series","")
+  DECLARE_USED_ATTRIBUTE("slopemean","SU","mean slope, for the ensemble indicators","m")
+  DECLARE_USED_ATTRIBUTE("isoutlet","LI","outlet flag, for the ensemble indicators","")
+
+  DECLARE_USED_ATTRIBUTE("flowdist","SU","flow distance to the downstream unit, for the travel-time routing","m")
+  DECLARE_USED_ATTRIBUTE("flowdist","LI","flow distance to the downstream unit, for the travel-time routing","m")
+  DECLARE_USED_ATTRIBUTE("flowdist","RS","flow distance to the outlet of the RS, for the travel-time routing","m")
+
 
   DECLARE_PRODUCED_VARIABLE("rain","SU","","m")
   DECLARE_PRODUCED_VARIABLE("infiltration","SU","","m")
@@ -60,6 +117,70 @@ BEGIN_SIMULATOR_SIGNATURE("water.surf-uz.runoff-infiltration.bvservice")
 
   DECLARE_PRODUCED_VARIABLE("uprunoffvolume","RS","incoming runoff volume","m3")
 
+  DECLARE_PRODUCED_VARIABLE("uprunoffvolumes[vector]","SU","incoming runoff volume of each rainfall scenario","m3")
+  DECLARE_PRODUCED_VARIABLE("runoffvolumes[vector]","SU","outgoing runoff volume of each rainfall scenario","m3")
+  DECLARE_PRODUCED_VARIABLE("infiltvolumes[vector]","SU","infiltration volume of each rainfall scenario","m3")
+
+  DECLARE_PRODUCED_VARIABLE("uprunoffvolumes[vector]","LI","incoming runoff volume of each rainfall scenario","m3")
+  DECLARE_PRODUCED_VARIABLE("runoffvolumes[vector]","LI","outgoing runoff volume of each rainfall scenario","m3")
+  DECLARE_PRODUCED_VARIABLE("infiltvolumes[vector]","LI","infiltration volume of each rainfall scenario","m3")
+
+  DECLARE_PRODUCED_VARIABLE("uprunoffvolumes[vector]","RS","incoming runoff volume of each rainfall scenario","m3")
+
+  DECLARE_PRODUCED_VARIABLE("runoffvolumemean","SU","mean of the outgoing runoff volume over the ensemble","m3")
+  DECLARE_PRODUCED_VARIABLE("runoffvolumestddev","SU","standard deviation of the outgoing runoff volume "
+                                                      "over the ensemble","m3")
+  DECLARE_PRODUCED_VARIABLE("runoffvolumequantiles[vector]","SU","5%, 50% and 95% quantiles of the outgoing "
+                                                                 "runoff volume over the ensemble","m3")
+
+  DECLARE_PRODUCED_VARIABLE("runoffvolumemean","LI","mean of the outgoing runoff volume over the ensemble","m3")
+  DECLARE_PRODUCED_VARIABLE("runoffvolumestddev","LI","standard deviation of the outgoing runoff volume "
+                                                      "over the ensemble","m3")
+  DECLARE_PRODUCED_VARIABLE("runoffvolumequantiles[vector]","LI","5%, 50% and 95% quantiles of the outgoing "
+                                                                 "runoff volume over the ensemble","m3")
+
+  DECLARE_PRODUCED_VARIABLE("uprunoffvolumemean","RS","mean of the incoming runoff volume over the ensemble","m3")
+  DECLARE_PRODUCED_VARIABLE("uprunoffvolumestddev","RS","standard deviation of the incoming runoff volume "
+                                                        "over the ensemble","m3")
+  DECLARE_PRODUCED_VARIABLE("uprunoffvolumequantiles[vector]","RS","5%, 50% and 95% quantiles of the incoming "
+                                                                   "runoff volume over the ensemble","m3")
+
+  DECLARE_PRODUCED_VARIABLE("runoffvoldeltaensemble[vector]","SU","ensemble mean, standard deviation and "
+                                                                  "5%, 50%, 95% quantiles of runoffvoldelta","")
+  DECLARE_PRODUCED_VARIABLE("runoffvolratioensemble[vector]","SU","ensemble mean, standard deviation and "
+                                                                  "5%, 50%, 95% quantiles of runoffvolratio","")
+  DECLARE_PRODUCED_VARIABLE("infiltvolratioensemble[vector]","SU","ensemble mean, standard deviation and "
+                                                                  "5%, 50%, 95% quantiles of infiltvolratio","")
+  DECLARE_PRODUCED_VARIABLE("conndegreeensemble[vector]","SU","ensemble mean, standard deviation and "
+                                                              "5%, 50%, 95% quantiles of conndegree","")
+  DECLARE_PRODUCED_VARIABLE("erosionriskensemble[vector]","SU","ensemble mean, standard deviation and "
+                                                               "5%, 50%, 95% quantiles of erosionrisk","")
+  DECLARE_PRODUCED_VARIABLE("runoffcontribensemble[vector]","SU","ensemble mean, standard deviation and "
+                                                                 "5%, 50%, 95% quantiles of runoffcontrib","")
+
+  DECLARE_PRODUCED_VARIABLE("runoffvoldeltaensemble[vector]","LI","ensemble mean, standard deviation and "
+                                                                  "5%, 50%, 95% quantiles of runoffvoldelta","")
+  DECLARE_PRODUCED_VARIABLE("runoffvolratioensemble[vector]","LI","ensemble mean, standard deviation and "
+                                                                  "5%, 50%, 95% quantiles of runoffvolratio","")
+  DECLARE_PRODUCED_VARIABLE("infiltvolratioensemble[vector]","LI","ensemble mean, standard deviation and "
+                                                                  "5%, 50%, 95% quantiles of infiltvolratio","")
+  DECLARE_PRODUCED_VARIABLE("concdegreeensemble[vector]","LI","ensemble mean, standard deviation and "
+                                                              "5%, 50%, 95% quantiles of concdegree","")
+  DECLARE_PRODUCED_VARIABLE("importancedegreeensemble[vector]","LI","ensemble mean, standard deviation and "
+                                                                    "5%, 50%, 95% quantiles of importancedegree","")
+  DECLARE_PRODUCED_VARIABLE("interestdegreeensemble[vector]","LI","ensemble mean, standard deviation and "
+                                                                  "5%, 50%, 95% quantiles of interestdegree","")
+
+  DECLARE_PRODUCED_VARIABLE("routedvolume","RS","runoff volume reaching the RS by routing from the current "
+                                                "time step until the next one (until the end of the hydrograph "
+                                                "at the last time step), for the first scenario","m3")
+
+  DECLARE_PRODUCED_VARIABLE("runoffsensitivitycn","SU","derivative of the runoff volume reaching RS "
+                                                       "with respect to the CN of the SU","m3")
+  DECLARE_PRODUCED_VARIABLE("runoffsensitivityratios[vector]","LI","derivatives of the runoff volume reaching RS "
+                                                                   "with respect to the ratios of benches, "
+                                                                   "grass strips and hedges of the LI","m3")
+
 
 END_SIMULATOR_SIGNATURE
 
@@ -71,31 +192,99 @@ END_SIMULATOR_SIGNATURE
 /**
 
 */
-class BVServiceHydroSimulator : public openfluid::ware::PluggableSimulator
+class BVServiceHydroSimulator : public BVServiceSimulator
 {
   private:
 
     double m_TotalRainM = 0.5; // total rainfall in meters
 
+    // total rainfalls of scenarios in meters, the first one is m_TotalRainM
+    std::vector<double> m_TotalRains;
+
+    // rainfall series replacing total rainfalls, if any
+    std::string m_RainFileName;
+
+    RainfallSeries m_RainSeries;
+
+    // minimum dry duration between two rainfall events, in seconds
+    long m_EventGap = 86400;
+
+    // rainfall rasters replacing total rainfalls, if any
+    std::vector<std::string> m_RainRastersNames;
+
+    double m_RainRasterScale = 1.0;
+
+    std::string m_RainWeightsCacheFile;
+
+    // next record of the rainfall series to consume
+    unsigned int m_NextRainRecord = 0;
+
+    // end time of the last consumed rainy record, negative before the first one
+    long long m_LastRainEndTime = -1;
+
+    // rainfalls of the records consumed at the current time step, one per column of the series
+    std::vector<double> m_StepRains;
+
     double m_SUInfiltCoeff = 1.0;
     double m_LIInfiltCoeff = 1.0;
 
-    double m_LIWidth = 1.0;
+    // runoff model built once in prepareData, indexing units by their rank in the process order
+    HydroModel m_Model;
+
+    unsigned int m_ThreadsCount = 1;
+
+    std::unique_ptr<WorkersPool> m_Pool;
 
-    openfluid::core::IDIntMap m_CNofSU;
+    // SU whose rainfalls changed since the last computation, when not all units must be computed
+    std::vector<unsigned int> m_ChangedUnits;
 
-    const std::map<std::string,int> m_CNbyLIType = {
-                                                     {"benches",58},  // like MEADOW
-                                                     {"grassbs",69},  // like PASTURE
-                                                     {"hedges",58},  // like FOREST
-                                                   };
+    bool m_AllUnitsChanged = true;
+
+    // Monte Carlo ensemble on CN of land uses and rainfall, for the first scenario
+
+    unsigned int m_EnsembleMembers = 0;
+
+    unsigned long m_EnsembleSeed = 0;
+
+    PerturbationDistribution m_EnsembleCNDistri;
+
+    PerturbationDistribution m_EnsembleRainDistri;
+
+    // indicators model computing the indicators of each member, built when ensemble indicators are enabled
+    bool m_EnsembleIndicatorsEnabled = false;
+
+    IndicatorsModel m_EnsembleIndicators;
+
+    // travel-time routing to RS, enabled by a positive velocity
+
+    double m_RoutingVelocity = 0.0;
+
+    double m_RoutingInterval = 60.0;
+
+    double m_RoutingKernel = 0.0;
+
+    TravelTimeRouting m_Routing;
+
+    // first interval of the hydrographs not yet produced as routed volumes
+    unsigned int m_RoutedIntervals = 0;
+
+    // results cumulated until the previous time step of the event, when using a rainfall series
+    std::vector<double> m_CumulRunoffVolumes;
+    std::vector<double> m_CumulUpRunoffVolumes;
+    std::vector<double> m_CumulInfiltrations;
+    std::vector<double> m_CumulInfiltVolumes;
+
+    // results of the current time step, when using a rainfall series
+    std::vector<double> m_StepRunoffVolumes;
+    std::vector<double> m_StepUpRunoffVolumes;
+    std::vector<double> m_StepInfiltrations;
+    std::vector<double> m_StepInfiltVolumes;
 
-    const unsigned int m_DefaultCN = 93;
 
   public:
 
 
-    BVServiceHydroSimulator(): PluggableSimulator()
+    BVServiceHydroSimulator(): BVServiceSimulator()
     {
 
 
@@ -118,11 +307,98 @@ class BVServiceHydroSimulator : public openfluid::ware::PluggableSimulator
 
 
     /**
-      Computes S from CN value (using metric system, S in returned in meters)
+      Builds the in-memory graph from the spatial graph in process order, then the runoff model of this graph
     */
-    static double computeS(const unsigned int& CN)
+    void buildModel(const std::map<std::string,int>& LandUse2CN)
     {
-      return ((25.4/double(CN))-0.254);
+      BVServiceGraph Graph;
+
+      buildGraph(Graph,(isRoutingUsed() ? GRAPH_FLOWDISTS : GRAPH_BASE) |
+                       (m_EnsembleIndicatorsEnabled ? GRAPH_INDICATORS : GRAPH_BASE));
+
+      const unsigned int UnitsCount = m_Units.size();
+
+      std::vector<double> LandUsesCN;
+      encodeLandUses(LandUse2CN,Graph,LandUsesCN);
+
+      const unsigned int ScenariosCount = m_TotalRains.size();
+      std::string Error;
+
+      if (!m_Model.build(Graph,LandUsesCN,ScenariosCount,Error))
+        OPENFLUID_RaiseError(Error);
+
+      if (m_EnsembleIndicatorsEnabled && !m_EnsembleIndicators.build(Graph,Error))
+        OPENFLUID_RaiseError(Error);
+
+      RunoffNetwork& Network = m_Model.network();
+
+      // a single column of the rainfall series is a rainfall uniform over the area
+      const std::vector<std::string>& RainColumnsNames = m_RainSeries.getColumnsNames();
+
+      if (RainColumnsNames.size() > 1)
+      {
+        std::map<std::string,unsigned int> RainColumns;
+
+        for (unsigned int c = 0; c < RainColumnsNames.size(); c++)
+          RainColumns[RainColumnsNames[c]] = c;
+
+        for (unsigned int i = 0; i < UnitsCount; i++)
+        {
+          if (Graph.Classes[i] != SU_CLASS)
+            continue;
+
+          // columns are named by the original IDs of the shapefiles, which do not depend on the import
+          std::string OrigID;
+          OPENFLUID_GetAttribute(m_Units[i],"origid",OrigID);
+
+          auto itCol = RainColumns.find(OrigID);
+
+          if (itCol == RainColumns.end())
+            OPENFLUID_RaiseError("No rainfall column for " + OrigID + " in file " + m_RainFileName);
+
+          UnitHydroParams Params = Network.getParams(i);
+          Params.RainColumn = itCol->second;
+          Network.setParams(i,Params);
+        }
+      }
+
+      const unsigned int LanesCount = UnitsCount*ScenariosCount;
+
+      // rainfalls of a series are added at each time step, total rainfalls are the same for all time steps
+      if (!isRainSeriesUsed())
+      {
+        for (unsigned int i = 0; i < UnitsCount; i++)
+        {
+          if (Graph.Classes[i] == SU_CLASS)
+            std::copy(m_TotalRains.begin(),m_TotalRains.end(),Network.rains().begin()+i*ScenariosCount);
+        }
+      }
+      else
+      {
+        m_CumulRunoffVolumes.assign(LanesCount,0.0);
+        m_CumulUpRunoffVolumes.assign(LanesCount,0.0);
+        m_CumulInfiltrations.assign(LanesCount,0.0);
+        m_CumulInfiltVolumes.assign(LanesCount,0.0);
+
+        m_StepRunoffVolumes.assign(LanesCount,0.0);
+        m_StepUpRunoffVolumes.assign(LanesCount,0.0);
+        m_StepInfiltrations.assign(LanesCount,0.0);
+        m_StepInfiltVolumes.assign(LanesCount,0.0);
+      }
+
+      m_AllUnitsChanged = true;
+
+      // without rainfall series, the hydrographs are those of a single event at the beginning of the run
+      if (isRoutingUsed())
+      {
+        const double EventDuration =
+          isRainSeriesUsed() ? OPENFLUID_GetEndDate().diffInSeconds(OPENFLUID_GetBeginDate()) : 0.0;
+
+        if (!m_Routing.build(Network,Graph.FlowDists,m_RoutingVelocity,m_RoutingInterval,
+                             TravelTimeRouting::getTriangularKernel(m_RoutingKernel,m_RoutingInterval),
+                             EventDuration,Error))
+          OPENFLUID_RaiseError(Error);
+      }
     }
 
 
@@ -130,16 +406,19 @@ class BVServiceHydroSimulator : public openfluid::ware::PluggableSimulator
     // =====================================================================
 
 
-    static double computeRunoff(const double& WaterHeight, const double& S)
+    bool isRainSeriesUsed() const
     {
-      double Runoff = std::pow(WaterHeight-(0.2*S),2)/(WaterHeight+(0.8*S));
+      return !m_RainFileName.empty();
+    }
+
+
+    // =====================================================================
+    // =====================================================================
 
-      // Low incoming water levels may generate more runoff than incoming water
-      // In this case, all incoming water is put to runoff
-      if (Runoff > WaterHeight)
-        Runoff = WaterHeight;
 
-      return Runoff;
+    bool isRoutingUsed() const
+    {
+      return m_RoutingVelocity > 0.0;
     }
 
 
@@ -148,38 +427,74 @@ class BVServiceHydroSimulator : public openfluid::ware::PluggableSimulator
 
 
     /**
-      Computes incoming runoff volume from upstream SU and LI for the given spatial unit
+      Consumes the records of the rainfall series ending until the given time,
+      adding their rainfalls to the step rainfalls and starting a new event after a long enough dry period
     */
-    double computeUpstreamRunoffVolume(openfluid::core::SpatialUnit* U)
+    void consumeRainRecords(long long Time)
     {
-      double UpRunoffVol = 0.0;
-      openfluid::core::SpatialUnit* UpU;
-      openfluid::core::DoubleValue Q = 0.0;
+      std::fill(m_StepRains.begin(),m_StepRains.end(),0.0);
 
-      // incoming from LI
-      openfluid::core::UnitsPtrList_t* UpList = U->fromSpatialUnits("LI");
-      if (U)
+      for (; m_NextRainRecord < m_RainSeries.getRecordsCount() &&
+             m_RainSeries.getEndTime(m_NextRainRecord) <= Time; m_NextRainRecord++)
       {
-        OPENFLUID_UNITSLIST_LOOP(UpList,UpU)
+        if (!m_RainSeries.isRainy(m_NextRainRecord))
+          continue;
+
+        if (m_LastRainEndTime >= 0 && m_RainSeries.getBeginTime(m_NextRainRecord)-m_LastRainEndTime >= m_EventGap)
         {
-          OPENFLUID_GetVariable(UpU,"runoffvolume",Q);
-          UpRunoffVol += Q;
+          m_AllUnitsChanged = true;
+          std::fill(m_Model.network().rains().begin(),m_Model.network().rains().end(),0.0);
+          std::fill(m_CumulRunoffVolumes.begin(),m_CumulRunoffVolumes.end(),0.0);
+          std::fill(m_CumulUpRunoffVolumes.begin(),m_CumulUpRunoffVolumes.end(),0.0);
+          std::fill(m_CumulInfiltrations.begin(),m_CumulInfiltrations.end(),0.0);
+          std::fill(m_CumulInfiltVolumes.begin(),m_CumulInfiltVolumes.end(),0.0);
+          m_Routing.resetContributions();
         }
+
+        m_RainSeries.addValues(m_NextRainRecord,m_StepRains);
+        m_LastRainEndTime = m_RainSeries.getEndTime(m_NextRainRecord);
       }
 
-      // incoming from SU
-      UpList = U->fromSpatialUnits("SU");
-      if (U)
+      const unsigned int ScenariosCount = m_TotalRains.size();
+
+      RunoffNetwork& Network = m_Model.network();
+
+      // only SU receiving rainfall have to be computed with their downstream units
+      for (unsigned int i = 0; i < m_Units.size(); i++)
       {
-        OPENFLUID_UNITSLIST_LOOP(UpList,UpU)
+        const UnitHydroParams& Params = Network.getParams(i);
+
+        if (Params.Class == SU_CLASS && m_StepRains[Params.RainColumn] != 0.0)
         {
-          OPENFLUID_GetVariable(UpU,"runoffvolume",Q);
+          for (unsigned int k = 0; k < ScenariosCount; k++)
+            Network.rains()[i*ScenariosCount+k] += m_StepRains[Params.RainColumn];
 
-          UpRunoffVol += Q;
+          m_ChangedUnits.push_back(i);
         }
       }
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      @return the time of the end of the next rainy record, rounded up to a multiple of the default DeltaT
+      so the steps match those of the simulators using the produced variables at each default DeltaT,
+      or -1 if there is no more rainy record
+    */
+    long long getNextRainTime()
+    {
+      const long long DeltaT = OPENFLUID_GetDefaultDeltaT();
+
+      for (unsigned int r = m_NextRainRecord; r < m_RainSeries.getRecordsCount(); r++)
+      {
+        if (m_RainSeries.isRainy(r))
+          return (m_RainSeries.getEndTime(r)+DeltaT-1)/DeltaT*DeltaT;
+      }
 
-      return UpRunoffVol;
+      return -1;
     }
 
 
@@ -187,73 +502,203 @@ class BVServiceHydroSimulator : public openfluid::ware::PluggableSimulator
     // =====================================================================
 
 
-    double computeRunoffVolumeOnLI(openfluid::core::SpatialUnit* U, double& IncomingWaterVolume)
+    /**
+      @return the request scheduling the next time step at the time of the next rainy record
+    */
+    openfluid::base::SchedulingRequest scheduleNextRain(long long Time)
     {
-      // 1. Find max ratio
-      // 2. Efficient water volume = incoming water volume * max ratio
-      // 3. Efficient area = length * max ratio * m_LIWidth;
-      // 4. Initial water height = Efficient water volume / Efficient area
-      // 5. Compute successive infiltration volume through LI subparts where
+      const long long NextTime = getNextRainTime();
 
-      static const std::list<std::string> Subparts = {"benches","grassbs","hedges"};
+      if (NextTime < 0)
+        return Never();
 
-      double MaxRatio = 0.0;
+      return Duration(NextTime-Time);
+    }
 
-      for (auto LinearPart : Subparts)
-      {
-        double Ratio = 0.0;
-        OPENFLUID_GetAttribute(U,LinearPart+"ratio",Ratio);
 
-        MaxRatio = std::max(MaxRatio,Ratio);
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Computes the results of the current time step from the results cumulated since the beginning of the event
+      and those cumulated until the previous time step, which are then updated
+    */
+    static void computeStepResults(const std::vector<double>& Results, std::vector<double>& CumulResults,
+                                   std::vector<double>& StepResults)
+    {
+      for (unsigned int j = 0; j < Results.size(); j++)
+      {
+        StepResults[j] = Results[j]-CumulResults[j];
+        CumulResults[j] = Results[j];
       }
+    }
 
 
-      if (MaxRatio < 0.01)
-        return IncomingWaterVolume;
+    // =====================================================================
+    // =====================================================================
+
 
+    /**
+      @return a vector value holding the given count of results of a unit, such as the results of its scenarios
+    */
+    static openfluid::core::VectorValue getScenariosValue(const double* Results, unsigned int ScenariosCount)
+    {
+      openfluid::core::VectorValue Value(ScenariosCount,0.0);
+
+      for (unsigned int k = 0; k < ScenariosCount; k++)
+        Value.set(k,Results[k]);
+
+      return Value;
+    }
 
-      double Length = 0.0;
-      OPENFLUID_GetAttribute(U,"length",Length);
 
-      std::string OrigID;
-      OPENFLUID_GetAttribute(U,"origid",OrigID);
-      //std::cout << U->getID() << " : origid = " << OrigID << std::endl;
+    // =====================================================================
+    // =====================================================================
+
+
+    /**
+      Appends the ensemble statistics of the indicators of SU and LI, as vectors of the mean, the standard deviation
+      and the quantiles of each indicator
+    */
+    void appendEnsembleIndicators()
+    {
+      const UnitsClassIndex& Classes = m_EnsembleIndicators.getClasses();
+      const unsigned int IndicatorsCount = IndicatorsModel::IndicatorsValuesCount;
+      const unsigned int Quantiles = EnsembleAccumulator::QuantilesCount;
+
+      openfluid::core::VectorValue Stats(2+Quantiles,0.0);
+      unsigned int v = 0;
+
+      for (auto Class : {SU_CLASS,LI_CLASS})
+      {
+        const char** Names = (Class == SU_CLASS) ? IndicatorsModel::SUIndicatorsNames :
+                                                   IndicatorsModel::LIIndicatorsNames;
+
+        for (auto Rank : Classes.getRanks(Class))
+        {
+          for (unsigned int k = 0; k < IndicatorsCount; k++, v++)
+          {
+            Stats.set(0,m_Model.getEnsembleIndicatorsMeans()[v]);
+            Stats.set(1,m_Model.getEnsembleIndicatorsStdDevs()[v]);
+
+            for (unsigned int q = 0; q < Quantiles; q++)
+              Stats.set(2+q,m_Model.getEnsembleIndicatorsQuantiles()[v*Quantiles+q]);
+
+            OPENFLUID_AppendVariable(m_Units[Rank],std::string(Names[k])+"ensemble",Stats);
+          }
+        }
+      }
+    }
+
+
+    // =====================================================================
+    // =====================================================================
+
 
+    /**
+      Sets rainfalls on SU from the rainfall rasters, as the means of the pixels covering the SU.
+      Pixels weights are built once for a grid, or loaded from the cache file
+    */
+    void computeRasterRains(const std::string& InputDir)
+    {
+      const unsigned int ScenariosCount = m_TotalRains.size();
 
-      double RunoffVolumeToFilter = IncomingWaterVolume * MaxRatio;
-      double BypassedRunoffVolume = IncomingWaterVolume - RunoffVolumeToFilter;
+      std::vector<unsigned int> SURanks;
+      std::vector<const OGRGeometry*> SUGeometries;
 
-      double EfficientArea = Length * MaxRatio * m_LIWidth;
+      for (unsigned int i = 0; i < m_Units.size(); i++)
+      {
+        if (m_Model.getNetwork().getParams(i).Class == SU_CLASS)
+        {
+          if (!m_Units[i]->geometry())
+            OPENFLUID_RaiseError("No geometry for SU#" + std::to_string(m_Units[i]->getID()) +
+                                 ", required for rainfall rasters");
 
-      std::cout.precision(8);
+          SURanks.push_back(i);
+          SUGeometries.push_back(m_Units[i]->geometry());
+        }
+      }
 
-/*      std::cout << U->getID() << " : Area = " << (Length*m_LIWidth) << std::endl;
-      std::cout << U->getID() << " : MaxRatio = " << (MaxRatio) << std::endl;
-      std::cout << U->getID() << " : EfficientArea = " << EfficientArea << std::endl;*/
+      const std::uint64_t ZonesHash = ZonalWeights::computeZonesHash(SUGeometries);
 
-      double CurrentRunoff = RunoffVolumeToFilter / EfficientArea;
+      ZonalWeights Weights;
+      RasterGrid WeightsGrid;
+      std::vector<double> Pixels;
+      std::vector<double> Means(SURanks.size());
+      unsigned int NoDataCount = 0;
 
-      //std::cout << U->getID() << " : CurrentRunoff-in = " << CurrentRunoff << std::endl;
+      GDALAllRegister();
 
-      if (CurrentRunoff > 0)
+      for (unsigned int k = 0; k < ScenariosCount; k++)
       {
-        for (auto LinearPart : Subparts)
+        std::string RasterPath = InputDir+"/"+m_RainRastersNames[k];
+
+        GDALDataset* Dataset = static_cast<GDALDataset*>(GDALOpen(RasterPath.c_str(),GA_ReadOnly));
+
+        if (!Dataset)
+          OPENFLUID_RaiseError("Cannot open rainfall raster " + RasterPath);
+
+        RasterGrid Grid;
+        Grid.Width = Dataset->GetRasterXSize();
+        Grid.Height = Dataset->GetRasterYSize();
+
+        if (Dataset->GetRasterCount() < 1 || Dataset->GetGeoTransform(Grid.GeoTransform) != CE_None ||
+            Grid.GeoTransform[2] != 0.0 || Grid.GeoTransform[4] != 0.0)
         {
-          double Ratio = 0.0;
-          OPENFLUID_GetAttribute(U,LinearPart+"ratio",Ratio);
+          GDALClose(Dataset);
+          OPENFLUID_RaiseError("Rainfall raster " + RasterPath + " is not a georeferenced north-up raster");
+        }
+
+        GDALRasterBand* Band = Dataset->GetRasterBand(1);
+        int HasNoData = 0;
+        const double NoData = Band->GetNoDataValue(&HasNoData);
+
+        Pixels.resize(Grid.Width*Grid.Height);
+
+        CPLErr Err = Band->RasterIO(GF_Read,0,0,Grid.Width,Grid.Height,Pixels.data(),Grid.Width,Grid.Height,
+                                    GDT_Float64,0,0);
+        GDALClose(Dataset);
+
+        if (Err != CE_None)
+          OPENFLUID_RaiseError("Cannot read rainfall raster " + RasterPath);
+
+        if (HasNoData)
+          std::replace(Pixels.begin(),Pixels.end(),NoData,std::numeric_limits<double>::quiet_NaN());
 
-          if (Ratio > 0.01)
+        // rasters of a same series usually share their grid, so weights are built once
+        if (k == 0 || !(Grid == WeightsGrid))
+        {
+          if (!m_RainWeightsCacheFile.empty() && Weights.load(m_RainWeightsCacheFile,Grid,ZonesHash))
+            OPENFLUID_DisplayInfo("Rainfall pixels weights loaded from cache file " << m_RainWeightsCacheFile);
+          else
           {
-            CurrentRunoff = computeRunoff(CurrentRunoff,computeS(m_CNbyLIType.at(LinearPart)));
-            //std::cout << U->getID() << " : CurrentRunoff-" << LinearPart << " = " << CurrentRunoff << std::endl;
+            Weights.build(Grid,SUGeometries);
+
+            if (!m_RainWeightsCacheFile.empty() && !Weights.save(m_RainWeightsCacheFile))
+              OPENFLUID_LogAndDisplayWarning("Cannot write rainfall weights cache file " << m_RainWeightsCacheFile);
           }
+
+          WeightsGrid = Grid;
         }
-      }
 
-      double FilteredRunoffVolume = CurrentRunoff * EfficientArea;
+        Weights.computeMeans(Pixels.data(),Means.data());
 
-      return FilteredRunoffVolume+BypassedRunoffVolume;
+        for (unsigned int z = 0; z < SURanks.size(); z++)
+        {
+          if (std::isnan(Means[z]))
+          {
+            Means[z] = 0.0;
+            NoDataCount++;
+          }
 
+          m_Model.network().rains()[SURanks[z]*ScenariosCount+k] = Means[z]*m_RainRasterScale;
+        }
+      }
+
+      if (NoDataCount)
+        OPENFLUID_LogAndDisplayWarning("Rainfall set to 0 for " << NoDataCount <<
+                                       " SU without rainfall data in rasters");
     }
 
 
@@ -261,13 +706,76 @@ class BVServiceHydroSimulator : public openfluid::ware::PluggableSimulator
     // =====================================================================
 
 
-
     void initParams(const openfluid::ware::WareParams_t& Params)
     {
-      OPENFLUID_GetSimulatorParameter(Params,"totalrain",m_TotalRainM);
+      std::vector<double> TotalRains;
+      if (OPENFLUID_GetSimulatorParameter(Params,"totalrain",TotalRains) && !TotalRains.empty())
+        m_TotalRainM = TotalRains.front();
+      else
+        TotalRains = {m_TotalRainM};
+      m_TotalRains = TotalRains;
 
       OPENFLUID_GetSimulatorParameter(Params,"SUinfiltcoeff",m_SUInfiltCoeff);
       OPENFLUID_GetSimulatorParameter(Params,"LIinfiltcoeff",m_LIInfiltCoeff);
+
+      long Threads = 1;
+      OPENFLUID_GetSimulatorParameter(Params,"threads",Threads);
+      m_ThreadsCount = std::max(Threads,1L);
+
+      OPENFLUID_GetSimulatorParameter(Params,"rainfile",m_RainFileName);
+      OPENFLUID_GetSimulatorParameter(Params,"eventgap",m_EventGap);
+
+      if (isRainSeriesUsed() && m_TotalRains.size() > 1)
+        OPENFLUID_RaiseError("Rainfall scenarios cannot be used with a rainfall series");
+
+      long EnsembleMembers = 0;
+      OPENFLUID_GetSimulatorParameter(Params,"ensemblemembers",EnsembleMembers);
+      m_EnsembleMembers = std::max(EnsembleMembers,0L);
+
+      // members are computed from the rainfalls cumulated since the beginning of the event,
+      // they would not match the results of each time step of a rainfall series
+      if (isRainSeriesUsed() && m_EnsembleMembers)
+        OPENFLUID_RaiseError("Ensemble cannot be used with a rainfall series");
+
+      long EnsembleSeed = 0;
+      OPENFLUID_GetSimulatorParameter(Params,"ensembleseed",EnsembleSeed);
+      m_EnsembleSeed = EnsembleSeed;
+
+      std::string DistriStr;
+
+      if (OPENFLUID_GetSimulatorParameter(Params,"ensemblecn",DistriStr) && !m_EnsembleCNDistri.parse(DistriStr))
+        OPENFLUID_RaiseError("Wrong distribution for ensemblecn parameter: " + DistriStr);
+
+      if (OPENFLUID_GetSimulatorParameter(Params,"ensemblerain",DistriStr) && !m_EnsembleRainDistri.parse(DistriStr))
+        OPENFLUID_RaiseError("Wrong distribution for ensemblerain parameter: " + DistriStr);
+
+      long EnsembleIndicators = 0;
+      OPENFLUID_GetSimulatorParameter(Params,"ensembleindicators",EnsembleIndicators);
+      m_EnsembleIndicatorsEnabled = (EnsembleIndicators && m_EnsembleMembers);
+
+      long Sensitivities = 0;
+      OPENFLUID_GetSimulatorParameter(Params,"sensitivities",Sensitivities);
+      m_Model.setSensitivities(Sensitivities);
+
+      OPENFLUID_GetSimulatorParameter(Params,"routingvelocity",m_RoutingVelocity);
+      OPENFLUID_GetSimulatorParameter(Params,"routinginterval",m_RoutingInterval);
+      OPENFLUID_GetSimulatorParameter(Params,"routingkernel",m_RoutingKernel);
+
+      if (isRoutingUsed() && m_RoutingInterval <= 0.0)
+        OPENFLUID_RaiseError("Routing interval must be positive");
+
+      OPENFLUID_GetSimulatorParameter(Params,"rainrasters",m_RainRastersNames);
+      OPENFLUID_GetSimulatorParameter(Params,"rainrasterscale",m_RainRasterScale);
+      OPENFLUID_GetSimulatorParameter(Params,"rainweightscache",m_RainWeightsCacheFile);
+
+      if (!m_RainRastersNames.empty())
+      {
+        if (isRainSeriesUsed())
+          OPENFLUID_RaiseError("Rainfall rasters cannot be used with a rainfall series");
+
+        // one scenario per raster, rainfalls on SU are set from the rasters
+        m_TotalRains.assign(m_RainRastersNames.size(),0.0);
+      }
     }
 
 
@@ -279,49 +787,29 @@ class BVServiceHydroSimulator : public openfluid::ware::PluggableSimulator
     {
       std::map<std::string,int> LandUse2CN;
 
-      // Read landuse2CN codes
       std::string InputDir;
       OPENFLUID_GetRunEnvironment("dir.input",InputDir);
 
-      openfluid::tools::ColumnTextParser LandUse2CNFile("#",";");
-      LandUse2CNFile.loadFromFile(InputDir+"/landuse2CN.fr.txt");
-
-      std::string Code;
-      long int CN = 0;
+      loadLandUse2CN(LandUse2CN);
 
-      for (unsigned int i = 0;i<LandUse2CNFile.getLinesCount();i++ )
+      if (isRainSeriesUsed())
       {
-        if (LandUse2CNFile.getStringValue(i,0,&Code) &&
-            LandUse2CNFile.getLongValue(i,1,&CN))
-        {
-          LandUse2CN[Code] = CN;
-        }
-        else
-        {
-          OPENFLUID_RaiseError("Format error or wrong value in file landuse2CN.fr.txt");
-        }
-      }
+        std::string Error;
 
-      // Create CN attribute on SU with corresponding values
-      openfluid::core::SpatialUnit* U;
+        if (!m_RainSeries.open(InputDir+"/"+m_RainFileName,OPENFLUID_GetBeginDate(),
+                               OPENFLUID_GetDefaultDeltaT(),Error))
+          OPENFLUID_RaiseError("Rainfall series: " + Error);
 
-      OPENFLUID_UNITS_ORDERED_LOOP("SU",U)
-      {
-        std::string LandUseCode = OPENFLUID_GetAttribute(U,"landuse")->toString();
+        m_StepRains.assign(m_RainSeries.getColumnsNames().size(),0.0);
+      }
 
-        auto it = LandUse2CN.find(LandUseCode);
+      buildModel(LandUse2CN);
 
-        if (it != LandUse2CN.end())
-          m_CNofSU[U->getID()] = (*it).second;
-        else
-        {
-          m_CNofSU[U->getID()] = m_DefaultCN;
-          OPENFLUID_LogAndDisplayWarning("CN value for SU#" << U->getID() <<
-                                         " set to default value (" << m_DefaultCN << ")");
-          /*std::string IDStr = openfluid::tools::convertValue(U->getID());
-          OPENFLUID_RaiseError("Land use code \"" + LandUseCode + "\" on SU#" + IDStr + " is not valid");*/
-        }
-      }
+      if (!m_RainRastersNames.empty())
+        computeRasterRains(InputDir);
+
+      m_Model.setEnsemble(m_EnsembleMembers,m_EnsembleSeed,m_EnsembleCNDistri,m_EnsembleRainDistri,
+                          m_EnsembleIndicatorsEnabled ? &m_EnsembleIndicators : nullptr);
     }
 
 
@@ -352,6 +840,9 @@ class BVServiceHydroSimulator : public openfluid::ware::PluggableSimulator
         OPENFLUID_InitializeVariable(U,"infiltration",0.0);
         OPENFLUID_InitializeVariable(U,"runoffvolume",0.0);
         OPENFLUID_InitializeVariable(U,"infiltvolume",0.0);
+
+        if (m_Model.isSensitivitiesEnabled())
+          OPENFLUID_InitializeVariable(U,"runoffsensitivitycn",0.0);
       }
 
       OPENFLUID_UNITS_ORDERED_LOOP("LI",U)
@@ -359,6 +850,10 @@ class BVServiceHydroSimulator : public openfluid::ware::PluggableSimulator
         OPENFLUID_InitializeVariable(U,"runoffvolume",0.0);
         OPENFLUID_InitializeVariable(U,"uprunoffvolume",0.0);
         OPENFLUID_InitializeVariable(U,"infiltvolume",0.0);
+
+        if (m_Model.isSensitivitiesEnabled())
+          OPENFLUID_InitializeVariable(U,"runoffsensitivityratios",
+                                       openfluid::core::VectorValue(BVServiceGraph::LISubpartsCount,0.0));
       }
 
       OPENFLUID_UNITS_ORDERED_LOOP("RS",U)
@@ -366,6 +861,66 @@ class BVServiceHydroSimulator : public openfluid::ware::PluggableSimulator
         OPENFLUID_InitializeVariable(U,"uprunoffvolume",0.0);
       }
 
+      const openfluid::core::VectorValue ZeroVolumes(m_TotalRains.size(),0.0);
+
+      for (auto UnitsClass : {"SU","LI","RS"})
+      {
+        OPENFLUID_UNITS_ORDERED_LOOP(UnitsClass,U)
+        {
+          OPENFLUID_InitializeVariable(U,"uprunoffvolumes",ZeroVolumes);
+
+          const bool IsRS = (getUnitClass(U->getClass()) == RS_CLASS);
+          const std::string Prefix = IsRS ? "uprunoffvolume" : "runoffvolume";
+
+          if (m_EnsembleMembers)
+          {
+            OPENFLUID_InitializeVariable(U,Prefix+"mean",0.0);
+            OPENFLUID_InitializeVariable(U,Prefix+"stddev",0.0);
+            OPENFLUID_InitializeVariable(U,Prefix+"quantiles",
+                                         openfluid::core::VectorValue(EnsembleAccumulator::QuantilesCount,0.0));
+          }
+
+          if (!IsRS)
+          {
+            OPENFLUID_InitializeVariable(U,"runoffvolumes",ZeroVolumes);
+            OPENFLUID_InitializeVariable(U,"infiltvolumes",ZeroVolumes);
+          }
+        }
+      }
+
+      if (m_EnsembleIndicatorsEnabled)
+      {
+        const openfluid::core::VectorValue ZeroStats(2+EnsembleAccumulator::QuantilesCount,0.0);
+
+        OPENFLUID_UNITS_ORDERED_LOOP("SU",U)
+        {
+          for (auto Name : IndicatorsModel::SUIndicatorsNames)
+            OPENFLUID_InitializeVariable(U,std::string(Name)+"ensemble",ZeroStats);
+        }
+
+        OPENFLUID_UNITS_ORDERED_LOOP("LI",U)
+        {
+          for (auto Name : IndicatorsModel::LIIndicatorsNames)
+            OPENFLUID_InitializeVariable(U,std::string(Name)+"ensemble",ZeroStats);
+        }
+      }
+
+      if (isRoutingUsed())
+      {
+        OPENFLUID_UNITS_ORDERED_LOOP("RS",U)
+        {
+          OPENFLUID_InitializeVariable(U,"routedvolume",0.0);
+        }
+
+        m_RoutedIntervals = 0;
+      }
+
+      if (m_ThreadsCount > 1)
+        m_Pool.reset(new WorkersPool(m_ThreadsCount));
+
+      if (isRainSeriesUsed())
+        return scheduleNextRain(0);
+
       return DefaultDeltaT();
     }
 
@@ -378,56 +933,169 @@ class BVServiceHydroSimulator : public openfluid::ware::PluggableSimulator
     {
 
       openfluid::core::SpatialUnit* U;
+      const long long CurrentTime = OPENFLUID_GetCurrentTimeIndex();
 
-      OPENFLUID_UNITS_ORDERED_LOOP("SU",U)
+      const RunoffNetwork& Network = m_Model.getNetwork();
+
+      if (isRainSeriesUsed())
       {
-        OPENFLUID_AppendVariable(U,"rain",m_TotalRainM);
-      }
+        consumeRainRecords(CurrentTime);
 
+        for (unsigned int i = 0; i < m_Units.size(); i++)
+        {
+          const UnitHydroParams& Params = Network.getParams(i);
 
-      OPENFLUID_ALLUNITS_ORDERED_LOOP(U)
+          if (Params.Class == SU_CLASS)
+            OPENFLUID_AppendVariable(m_Units[i],"rain",m_StepRains[Params.RainColumn]);
+        }
+      }
+      else
       {
-        if (U->getClass() == "SU")
+        // rainfall of the first scenario
+        for (unsigned int i = 0; i < m_Units.size(); i++)
         {
-          // Total incoming water = m_TotalRainM + (UpstreamRunoffVolume / Area)
-          double Area;
-          OPENFLUID_GetAttribute(U,"area",Area);
+          if (Network.getParams(i).Class == SU_CLASS)
+            OPENFLUID_AppendVariable(m_Units[i],"rain",Network.getRains()[i*m_TotalRains.size()]);
+        }
+      }
+
 
-          double UpstreamRunoffVolume = computeUpstreamRunoffVolume(U);
+      // units are all computed at first step or when many units changed,
+      // otherwise results of units not downstream of changed units are kept.
+      // Sensitivities of a rainfall series are those of the runoff cumulated since the beginning of the event
+      bool ResultsChanged = true;
 
-          double IncomingWaterHeight = m_TotalRainM + (UpstreamRunoffVolume / Area);
+      if (m_AllUnitsChanged)
+        m_Model.computeAll(m_Pool.get());
+      else
+        ResultsChanged = m_Model.computeChanged(m_ChangedUnits,m_Pool.get());
 
-          double Runoff = computeRunoff(IncomingWaterHeight,computeS(m_CNofSU[U->getID()]));
+      m_AllUnitsChanged = false;
+      m_ChangedUnits.clear();
 
-          double Infiltration = IncomingWaterHeight - Runoff;
 
-          OPENFLUID_AppendVariable(U,"runoffvolume",Runoff*Area);
-          OPENFLUID_AppendVariable(U,"infiltration",Infiltration);
-          OPENFLUID_AppendVariable(U,"infiltvolume",Infiltration*Area);
-          OPENFLUID_AppendVariable(U,"uprunoffvolume",UpstreamRunoffVolume);
+      // runoff of a rainfall series starts reaching RS at the current time, added to the previous runoff,
+      // otherwise hydrographs are those of the single event starting at the beginning of the run
+      if (isRoutingUsed() && ResultsChanged)
+      {
+        if (!isRainSeriesUsed())
+          m_Routing.reset();
+
+        m_Routing.addContributions(Network,isRainSeriesUsed() ? CurrentTime : 0.0,m_Pool.get());
+      }
+
+
+      // runoffs of a rainfall series are computed from rainfalls cumulated since the beginning of the event
+      const std::vector<double>* RunoffVolumes = &Network.getRunoffVolumes();
+      const std::vector<double>* UpRunoffVolumes = &Network.getUpRunoffVolumes();
+      const std::vector<double>* Infiltrations = &Network.getInfiltrations();
+      const std::vector<double>* InfiltVolumes = &Network.getInfiltVolumes();
+
+      if (isRainSeriesUsed())
+      {
+        computeStepResults(*RunoffVolumes,m_CumulRunoffVolumes,m_StepRunoffVolumes);
+        computeStepResults(*UpRunoffVolumes,m_CumulUpRunoffVolumes,m_StepUpRunoffVolumes);
+        computeStepResults(*Infiltrations,m_CumulInfiltrations,m_StepInfiltrations);
+        computeStepResults(*InfiltVolumes,m_CumulInfiltVolumes,m_StepInfiltVolumes);
+
+        RunoffVolumes = &m_StepRunoffVolumes;
+        UpRunoffVolumes = &m_StepUpRunoffVolumes;
+        Infiltrations = &m_StepInfiltrations;
+        InfiltVolumes = &m_StepInfiltVolumes;
+      }
+
+
+      // results are written to the variables once all units are computed,
+      // scalar variables are the results of the first scenario
+      const unsigned int ScenariosCount = m_TotalRains.size();
+
+      for (unsigned int i = 0; i < m_Units.size(); i++)
+      {
+        U = m_Units[i];
+        const unsigned int Lanes = i*ScenariosCount;
+        const UnitClass_t Class = Network.getParams(i).Class;
+
+        if (Class == SU_CLASS)
+        {
+          OPENFLUID_AppendVariable(U,"runoffvolume",(*RunoffVolumes)[Lanes]);
+          OPENFLUID_AppendVariable(U,"infiltration",(*Infiltrations)[Lanes]);
+          OPENFLUID_AppendVariable(U,"infiltvolume",(*InfiltVolumes)[Lanes]);
+          OPENFLUID_AppendVariable(U,"uprunoffvolume",(*UpRunoffVolumes)[Lanes]);
+
+          if (m_Model.isSensitivitiesEnabled())
+            OPENFLUID_AppendVariable(U,"runoffsensitivitycn",m_Model.getCNSensitivities()[i]);
+        }
+        else if (Class == LI_CLASS)
+        {
+          OPENFLUID_AppendVariable(U,"runoffvolume",(*RunoffVolumes)[Lanes]);
+          OPENFLUID_AppendVariable(U,"infiltvolume",(*InfiltVolumes)[Lanes]);
+          OPENFLUID_AppendVariable(U,"uprunoffvolume",(*UpRunoffVolumes)[Lanes]);
+
+          if (m_Model.isSensitivitiesEnabled())
+            OPENFLUID_AppendVariable(U,"runoffsensitivityratios",
+                                     getScenariosValue(&m_Model.getRatiosSensitivities()[i*BVServiceGraph::LISubpartsCount],
+                                                       BVServiceGraph::LISubpartsCount));
         }
-        else if (U->getClass() == "LI")
+        else if (Class == RS_CLASS)
         {
-          // Area = length * m_LIWidth
-          // Total incoming water = UpstreamRunoffVolume / Area
+          OPENFLUID_AppendVariable(U,"uprunoffvolume",(*UpRunoffVolumes)[Lanes]);
+        }
 
-          double UpstreamRunoffVolume = computeUpstreamRunoffVolume(U);
-          double RunoffVolume = computeRunoffVolumeOnLI(U,UpstreamRunoffVolume);
-          double InfiltVolume = UpstreamRunoffVolume - RunoffVolume;
+        if (Class != OTHER_CLASS)
+        {
+          OPENFLUID_AppendVariable(U,"uprunoffvolumes",
+                                   getScenariosValue(&(*UpRunoffVolumes)[Lanes],ScenariosCount));
+        }
 
-          //std::cout << U->getID() << " : " << UpstreamRunoffVolume << "(invol) = " << RunoffVolume << "(runoffvol) + " << InfiltVolume << "(infiltvol)" << std::endl;
+        if (Class != OTHER_CLASS && m_EnsembleMembers)
+        {
+          const std::string Prefix = (Class == RS_CLASS) ? "uprunoffvolume" : "runoffvolume";
+          const unsigned int Quantiles = EnsembleAccumulator::QuantilesCount;
 
-          OPENFLUID_AppendVariable(U,"runoffvolume",RunoffVolume);
-          OPENFLUID_AppendVariable(U,"infiltvolume",InfiltVolume);
-          OPENFLUID_AppendVariable(U,"uprunoffvolume",UpstreamRunoffVolume);
+          OPENFLUID_AppendVariable(U,Prefix+"mean",m_Model.getEnsembleMeans()[i]);
+          OPENFLUID_AppendVariable(U,Prefix+"stddev",m_Model.getEnsembleStdDevs()[i]);
+          OPENFLUID_AppendVariable(U,Prefix+"quantiles",
+                                   getScenariosValue(&m_Model.getEnsembleQuantiles()[i*Quantiles],Quantiles));
         }
-        else if (U->getClass() == "RS")
+
+        if (Class == SU_CLASS || Class == LI_CLASS)
         {
-          double UpstreamRunoffVolume = computeUpstreamRunoffVolume(U);
-          OPENFLUID_AppendVariable(U,"uprunoffvolume",UpstreamRunoffVolume);
+          OPENFLUID_AppendVariable(U,"runoffvolumes",
+                                   getScenariosValue(&(*RunoffVolumes)[Lanes],ScenariosCount));
+          OPENFLUID_AppendVariable(U,"infiltvolumes",
+                                   getScenariosValue(&(*InfiltVolumes)[Lanes],ScenariosCount));
         }
       }
 
+      if (m_EnsembleIndicatorsEnabled)
+        appendEnsembleIndicators();
+
+      // the hydrographs stay in the routing, only the volumes of their intervals until the next time step
+      // are produced. The last time step produces the remaining intervals, so routed volumes sum to the hydrographs
+      if (isRoutingUsed())
+      {
+        const long long NextTime = isRainSeriesUsed() ? getNextRainTime() : CurrentTime+OPENFLUID_GetDefaultDeltaT();
+        const long long RunDuration = OPENFLUID_GetEndDate().diffInSeconds(OPENFLUID_GetBeginDate());
+
+        unsigned int EndInterval = m_Routing.getIntervalsCount();
+
+        if (NextTime >= 0 && NextTime < RunDuration)
+          EndInterval = std::min<unsigned int>(std::floor(NextTime/m_RoutingInterval),EndInterval);
+
+        EndInterval = std::max(EndInterval,m_RoutedIntervals);
+
+        const std::vector<unsigned int>& RSRanks = m_Routing.getRSRanks();
+
+        for (unsigned int r = 0; r < RSRanks.size(); r++)
+          OPENFLUID_AppendVariable(m_Units[RSRanks[r]],"routedvolume",
+                                   m_Routing.getVolume(r,m_RoutedIntervals,EndInterval));
+
+        m_RoutedIntervals = EndInterval;
+      }
+
+
+      if (isRainSeriesUsed())
+        return scheduleNextRain(CurrentTime);
 
       return DefaultDeltaT();
     }
@@ -439,6 +1107,7 @@ class BVServiceHydroSimulator : public openfluid::ware::PluggableSimulator
 
     void finalizeRun()
     {
+      m_Pool.reset();
 
     }
 
@@ -0,0 +1,211 @@
+/**
+  @file RainfallSeries.cpp
+*/
+
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+#include "RainfallSeries.hpp"
+
+
+namespace {
+
+
+/**
+  Splits the line starting at the given offset into its fields separated by ';'
+  @return the offset of the next line
+*/
+std::uint64_t splitLine(const char* Data, std::uint64_t Size, std::uint64_t Offset, std::vector<std::string>& Fields)
+{
+  Fields.clear();
+  Fields.emplace_back();
+
+  while (Offset < Size && Data[Offset] != '\n')
+  {
+    if (Data[Offset] == ';')
+      Fields.emplace_back();
+    else if (Data[Offset] != '\r')
+      Fields.back() += Data[Offset];
+
+    Offset++;
+  }
+
+  return Offset+1;
+}
+
+
+}  // namespace
+
+
+// =====================================================================
+// =====================================================================
+
+
+void RainfallSeries::clear()
+{
+  m_ColumnsNames.clear();
+  m_Times.clear();
+  m_RecordsBegins.assign(1,0);
+  m_RainsColumns.clear();
+  m_Rains.clear();
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool RainfallSeries::parse(const char* Data, std::uint64_t Size, const openfluid::core::DateTime& BeginDate,
+                           const std::string& FilePath, std::string& Error)
+{
+  std::vector<std::string> Fields;
+  std::uint64_t Offset = 0;
+  unsigned int LineNumber = 0;
+  bool HeaderFound = false;
+
+  while (Offset < Size)
+  {
+    Offset = splitLine(Data,Size,Offset,Fields);
+    LineNumber++;
+
+    if (Fields.size() == 1 && Fields[0].empty())
+      continue;
+
+    if (Fields[0][0] == '#')
+      continue;
+
+    if (!HeaderFound)
+    {
+      if (Fields.size() < 2 || Fields[0] != "date")
+      {
+        Error = "wrong header in file "+FilePath;
+        return false;
+      }
+
+      m_ColumnsNames.assign(Fields.begin()+1,Fields.end());
+      HeaderFound = true;
+      continue;
+    }
+
+    openfluid::core::DateTime Date;
+    bool Valid = Date.setFromISOString(Fields[0]) && Fields.size() == m_ColumnsNames.size()+1;
+
+    const long long Time = Valid ? Date.diffInSeconds(BeginDate) : 0;
+
+    // non-zero values are kept as they are checked, only for records after the begin date
+    const unsigned int RecordBegin = m_Rains.size();
+
+    for (unsigned int c = 0; Valid && c < m_ColumnsNames.size(); c++)
+    {
+      char* End = nullptr;
+      const double Value = std::strtod(Fields[c+1].c_str(),&End);
+
+      Valid = (End != Fields[c+1].c_str() && *End == '\0' && Value >= 0.0);
+
+      if (Valid && Value > 0.0 && Time >= 0)
+      {
+        m_RainsColumns.push_back(c);
+        m_Rains.push_back(Value);
+      }
+    }
+
+    if (!Valid)
+    {
+      Error = "wrong record at line "+std::to_string(LineNumber)+" in file "+FilePath;
+      return false;
+    }
+
+    if (!m_Times.empty() && Time <= m_Times.back())
+    {
+      Error = "records are not sorted by date at line "+std::to_string(LineNumber)+" in file "+FilePath;
+      return false;
+    }
+
+    if (Time >= 0)
+    {
+      m_Times.push_back(Time);
+      m_RecordsBegins.push_back(m_Rains.size());
+    }
+    else
+    {
+      m_RainsColumns.resize(RecordBegin);
+      m_Rains.resize(RecordBegin);
+    }
+  }
+
+  if (!HeaderFound)
+  {
+    Error = "no header in file "+FilePath;
+    return false;
+  }
+
+  return true;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool RainfallSeries::open(const std::string& FilePath, const openfluid::core::DateTime& BeginDate,
+                          long long DefaultDuration, std::string& Error)
+{
+  clear();
+
+  m_DefaultDuration = DefaultDuration;
+
+  std::ifstream File(FilePath,std::ios::in | std::ios::binary);
+
+  if (!File.is_open())
+  {
+    Error = "cannot open file "+FilePath;
+    return false;
+  }
+
+  // the whole file is parsed at once, so it is read in a single buffer
+  const std::string Data((std::istreambuf_iterator<char>(File)),std::istreambuf_iterator<char>());
+
+  if (File.bad())
+  {
+    Error = "cannot read file "+FilePath;
+    return false;
+  }
+
+  const bool Parsed = parse(Data.data(),Data.size(),BeginDate,FilePath,Error);
+
+  if (!Parsed)
+    clear();
+
+  return Parsed;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+long long RainfallSeries::getEndTime(unsigned int Record) const
+{
+  if (Record+1 < m_Times.size())
+    return m_Times[Record+1];
+
+  if (Record > 0)
+    return 2*m_Times[Record]-m_Times[Record-1];
+
+  return m_Times[Record]+m_DefaultDuration;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void RainfallSeries::addValues(unsigned int Record, std::vector<double>& Values) const
+{
+  Values.resize(m_ColumnsNames.size(),0.0);
+
+  for (unsigned int v = m_RecordsBegins[Record]; v < m_RecordsBegins[Record+1]; v++)
+    Values[m_RainsColumns[v]] += m_Rains[v];
+}
@@ -0,0 +1,97 @@
+/**
+  @file RainfallSeries.hpp
+*/
+
+
+#ifndef __RAINFALLSERIES_HPP__
+#define __RAINFALLSERIES_HPP__
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <openfluid/core/DateTime.hpp>
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Rainfall time series read from a text file.
+
+  The first line which is not a comment (starting with #) is the header, made of "date" followed by the names
+  of the rainfall columns: a single column for a rainfall uniform over the area,
+  or one column per SU named by the original ID of the SU (origid attribute, e.g. SU#12N3). Each following line is a record made of an ISO date
+  (YYYY-MM-DD hh:mm:ss) and of the rainfall depths in meters fallen from this date to the date of the next record.
+  The last record lasts as long as the previous one, or the given default duration if it is the only one.
+
+  The file is read and parsed once when opened, only the non-zero rainfalls of the records being kept.
+  Times are in seconds from the given begin date, records starting before it are ignored
+*/
+class RainfallSeries
+{
+  private:
+
+    long long m_DefaultDuration = 0;
+
+    std::vector<std::string> m_ColumnsNames;
+
+    std::vector<long long> m_Times;
+
+    // non-zero rainfalls of each record with their columns, in compressed rows
+    std::vector<unsigned int> m_RecordsBegins = {0};
+    std::vector<unsigned int> m_RainsColumns;
+    std::vector<double> m_Rains;
+
+
+    void clear();
+
+    bool parse(const char* Data, std::uint64_t Size, const openfluid::core::DateTime& BeginDate,
+               const std::string& FilePath, std::string& Error);
+
+
+  public:
+
+    RainfallSeries()
+    { }
+
+    /**
+      Opens and reads the given file
+      @param[out] Error the error message in case of failure
+      @return false if the file cannot be read or is not valid
+    */
+    bool open(const std::string& FilePath, const openfluid::core::DateTime& BeginDate, long long DefaultDuration,
+              std::string& Error);
+
+    const std::vector<std::string>& getColumnsNames() const
+    {
+      return m_ColumnsNames;
+    }
+
+    unsigned int getRecordsCount() const
+    {
+      return m_Times.size();
+    }
+
+    long long getBeginTime(unsigned int Record) const
+    {
+      return m_Times[Record];
+    }
+
+    long long getEndTime(unsigned int Record) const;
+
+    bool isRainy(unsigned int Record) const
+    {
+      return m_RecordsBegins[Record] < m_RecordsBegins[Record+1];
+    }
+
+    /**
+      Adds the rainfalls of the given record to the given values, one per column
+    */
+    void addValues(unsigned int Record, std::vector<double>& Values) const;
+};
+
+
+#endif /* __RAINFALLSERIES_HPP__ */
@@ -0,0 +1,380 @@
+/**
+  @file ZonalWeights.cpp
+*/
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+
+#include <unistd.h>
+
+#include "ZonalWeights.hpp"
+
+
+namespace {
+
+
+const char WeightsMagic[8] = {'B','V','S','Z','O','N','A','L'};
+
+const std::uint32_t WeightsEndianMark = 0x01020304;
+
+
+struct WeightsHeader
+{
+  char Magic[8];
+  std::uint32_t Version;
+  std::uint32_t EndianMark;
+  std::uint64_t Width;
+  std::uint64_t Height;
+  double GeoTransform[6];
+  std::uint64_t ZonesHash;
+  std::uint64_t ZonesCount;
+  std::uint64_t WeightsCount;
+};
+
+
+/**
+  Edge of a zone ring
+*/
+struct Edge
+{
+  double X1, Y1, X2, Y2;
+};
+
+
+// =====================================================================
+// =====================================================================
+
+
+void addHash(std::uint64_t& Hash, const unsigned char* Data, std::uint64_t Size)
+{
+  // FNV-1a
+  for (std::uint64_t i = 0; i < Size; i++)
+  {
+    Hash ^= Data[i];
+    Hash *= 1099511628211ULL;
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void addRingEdges(const OGRLinearRing* Ring, std::vector<Edge>& Edges)
+{
+  if (!Ring)
+    return;
+
+  const int PointsCount = Ring->getNumPoints();
+
+  for (int p = 0; p+1 < PointsCount; p++)
+    Edges.push_back({Ring->getX(p),Ring->getY(p),Ring->getX(p+1),Ring->getY(p+1)});
+
+  // rings are closed in valid geometries, closed here anyway
+  if (PointsCount > 2)
+    Edges.push_back({Ring->getX(PointsCount-1),Ring->getY(PointsCount-1),Ring->getX(0),Ring->getY(0)});
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Collects the edges of all rings (exterior and interior) of the polygons of the given geometry
+*/
+void collectEdges(const OGRGeometry* Geom, std::vector<Edge>& Edges)
+{
+  if (!Geom)
+    return;
+
+  OGRwkbGeometryType GeomType = wkbFlatten(Geom->getGeometryType());
+
+  if (GeomType == wkbPolygon)
+  {
+    const OGRPolygon* Poly = static_cast<const OGRPolygon*>(Geom);
+
+    addRingEdges(Poly->getExteriorRing(),Edges);
+    for (int r = 0; r < Poly->getNumInteriorRings(); r++)
+      addRingEdges(Poly->getInteriorRing(r),Edges);
+  }
+  else if (GeomType == wkbMultiPolygon || GeomType == wkbGeometryCollection)
+  {
+    const OGRGeometryCollection* Coll = static_cast<const OGRGeometryCollection*>(Geom);
+
+    for (int g = 0; g < Coll->getNumGeometries(); g++)
+      collectEdges(Coll->getGeometryRef(g),Edges);
+  }
+}
+
+
+}  // namespace
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool RasterGrid::operator==(const RasterGrid& Other) const
+{
+  return Width == Other.Width && Height == Other.Height &&
+         std::equal(GeoTransform,GeoTransform+6,Other.GeoTransform);
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+std::uint64_t ZonalWeights::computeZonesHash(const std::vector<const OGRGeometry*>& Zones)
+{
+  std::uint64_t Hash = 14695981039346656037ULL;
+  std::vector<unsigned char> WkbBuffer;
+
+  for (auto Zone : Zones)
+  {
+    std::uint64_t WkbSize = 0;
+
+    if (Zone)
+    {
+      WkbBuffer.resize(Zone->WkbSize());
+      if (Zone->exportToWkb(wkbNDR,WkbBuffer.data()) == OGRERR_NONE)
+        WkbSize = WkbBuffer.size();
+    }
+
+    // size is hashed first so zones boundaries are part of the hash
+    addHash(Hash,reinterpret_cast<const unsigned char*>(&WkbSize),sizeof(WkbSize));
+    addHash(Hash,WkbBuffer.data(),WkbSize);
+  }
+
+  return Hash;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void ZonalWeights::build(const RasterGrid& Grid, const std::vector<const OGRGeometry*>& Zones)
+{
+  m_Grid = Grid;
+  m_ZonesHash = computeZonesHash(Zones);
+  m_RowsBegins.assign(1,0);
+  m_Pixels.clear();
+  m_Weights.clear();
+
+  const double OriginX = Grid.GeoTransform[0];
+  const double PixelWidth = Grid.GeoTransform[1];
+  const double OriginY = Grid.GeoTransform[3];
+  const double PixelHeight = Grid.GeoTransform[5];
+
+  std::vector<Edge> Edges;
+  std::vector<double> Crossings;
+
+  for (auto Zone : Zones)
+  {
+    const std::uint64_t RowBegin = m_Pixels.size();
+
+    Edges.clear();
+    collectEdges(Zone,Edges);
+
+    if (!Edges.empty())
+    {
+      OGREnvelope Env;
+      Zone->getEnvelope(&Env);
+
+      // range of pixels rows and columns whose centers may be inside the envelope
+      auto toRange = [](double A, double B, std::uint64_t Size, std::int64_t& First, std::int64_t& Last)
+      {
+        First = std::max<std::int64_t>(0,std::int64_t(std::floor(std::min(A,B)-0.5)));
+        Last = std::min<std::int64_t>(std::int64_t(Size)-1,std::int64_t(std::ceil(std::max(A,B)-0.5)));
+      };
+
+      std::int64_t FirstCol, LastCol, FirstRow, LastRow;
+      toRange((Env.MinX-OriginX)/PixelWidth,(Env.MaxX-OriginX)/PixelWidth,Grid.Width,FirstCol,LastCol);
+      toRange((Env.MinY-OriginY)/PixelHeight,(Env.MaxY-OriginY)/PixelHeight,Grid.Height,FirstRow,LastRow);
+
+      // scanline ray casting: on each row of pixel centers, crossings of the ray with the edges
+      // delimit inside intervals by pairs
+      for (std::int64_t Row = FirstRow; Row <= LastRow; Row++)
+      {
+        const double Y = OriginY + (Row+0.5)*PixelHeight;
+
+        Crossings.clear();
+
+        for (auto& E : Edges)
+        {
+          // half-open test so vertices on the ray are counted once
+          if ((E.Y1 > Y) != (E.Y2 > Y))
+            Crossings.push_back(E.X1 + (Y-E.Y1)*(E.X2-E.X1)/(E.Y2-E.Y1));
+        }
+
+        std::sort(Crossings.begin(),Crossings.end());
+
+        for (unsigned int c = 0; c+1 < Crossings.size(); c += 2)
+        {
+          // columns whose center X is in [Crossings[c],Crossings[c+1])
+          double A = (Crossings[c]-OriginX)/PixelWidth-0.5;
+          double B = (Crossings[c+1]-OriginX)/PixelWidth-0.5;
+
+          std::int64_t ColBegin = std::max<std::int64_t>(FirstCol,std::int64_t(std::ceil(std::min(A,B))));
+          std::int64_t ColEnd = std::min<std::int64_t>(LastCol+1,std::int64_t(std::ceil(std::max(A,B))));
+
+          for (std::int64_t Col = ColBegin; Col < ColEnd; Col++)
+            m_Pixels.push_back(Row*Grid.Width+Col);
+        }
+      }
+
+      if (m_Pixels.size() == RowBegin)
+      {
+        double Col = std::floor(((Env.MinX+Env.MaxX)/2-OriginX)/PixelWidth);
+        double Row = std::floor(((Env.MinY+Env.MaxY)/2-OriginY)/PixelHeight);
+
+        if (Col >= 0 && Col < Grid.Width && Row >= 0 && Row < Grid.Height)
+          m_Pixels.push_back(std::uint64_t(Row)*Grid.Width+std::uint64_t(Col));
+      }
+    }
+
+    const std::uint64_t PixelsCount = m_Pixels.size()-RowBegin;
+
+    m_Weights.resize(m_Pixels.size(),PixelsCount ? 1.0/PixelsCount : 0.0);
+    m_RowsBegins.push_back(m_Pixels.size());
+  }
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool ZonalWeights::save(const std::string& FilePath) const
+{
+  WeightsHeader Header;
+  std::memset(&Header,0,sizeof(Header));
+  std::memcpy(Header.Magic,WeightsMagic,sizeof(WeightsMagic));
+  Header.Version = Version;
+  Header.EndianMark = WeightsEndianMark;
+  Header.Width = m_Grid.Width;
+  Header.Height = m_Grid.Height;
+  std::copy(m_Grid.GeoTransform,m_Grid.GeoTransform+6,Header.GeoTransform);
+  Header.ZonesHash = m_ZonesHash;
+  Header.ZonesCount = getZonesCount();
+  Header.WeightsCount = m_Weights.size();
+
+
+  std::string TmpFilePath = FilePath+".tmp"+std::to_string(getpid());
+
+  std::ofstream WeightsFile(TmpFilePath,std::ios::out | std::ios::binary | std::ios::trunc);
+
+  if (!WeightsFile.is_open())
+    return false;
+
+  WeightsFile.write(reinterpret_cast<const char*>(&Header),sizeof(Header));
+  WeightsFile.write(reinterpret_cast<const char*>(m_RowsBegins.data()),m_RowsBegins.size()*sizeof(std::uint64_t));
+  WeightsFile.write(reinterpret_cast<const char*>(m_Pixels.data()),m_Pixels.size()*sizeof(std::uint64_t));
+  WeightsFile.write(reinterpret_cast<const char*>(m_Weights.data()),m_Weights.size()*sizeof(double));
+  WeightsFile.close();
+
+  if (!WeightsFile || std::rename(TmpFilePath.c_str(),FilePath.c_str()) != 0)
+  {
+    std::remove(TmpFilePath.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+bool ZonalWeights::load(const std::string& FilePath, const RasterGrid& Grid, std::uint64_t ZonesHash)
+{
+  std::ifstream WeightsFile(FilePath,std::ios::in | std::ios::binary);
+
+  if (!WeightsFile.is_open())
+    return false;
+
+  WeightsHeader Header;
+
+  if (!WeightsFile.read(reinterpret_cast<char*>(&Header),sizeof(Header)))
+    return false;
+
+  RasterGrid FileGrid;
+  FileGrid.Width = Header.Width;
+  FileGrid.Height = Header.Height;
+  std::copy(Header.GeoTransform,Header.GeoTransform+6,FileGrid.GeoTransform);
+
+  if (std::memcmp(Header.Magic,WeightsMagic,sizeof(WeightsMagic)) != 0 ||
+      Header.Version != Version || Header.EndianMark != WeightsEndianMark ||
+      !(FileGrid == Grid) || Header.ZonesHash != ZonesHash)
+    return false;
+
+  // counts are checked against the file size before allocation
+  WeightsFile.seekg(0,std::ios::end);
+  const std::uint64_t FileSize = WeightsFile.tellg();
+  WeightsFile.seekg(sizeof(Header),std::ios::beg);
+
+  if (Header.ZonesCount >= FileSize || Header.WeightsCount >= FileSize ||
+      sizeof(Header)+(Header.ZonesCount+1+2*Header.WeightsCount)*8 != FileSize)
+    return false;
+
+  std::vector<std::uint64_t> RowsBegins(Header.ZonesCount+1);
+  std::vector<std::uint64_t> Pixels(Header.WeightsCount);
+  std::vector<double> Weights(Header.WeightsCount);
+
+  WeightsFile.read(reinterpret_cast<char*>(RowsBegins.data()),RowsBegins.size()*sizeof(std::uint64_t));
+  WeightsFile.read(reinterpret_cast<char*>(Pixels.data()),Pixels.size()*sizeof(std::uint64_t));
+  WeightsFile.read(reinterpret_cast<char*>(Weights.data()),Weights.size()*sizeof(double));
+
+  if (!WeightsFile || RowsBegins.front() != 0 || RowsBegins.back() != Header.WeightsCount ||
+      !std::is_sorted(RowsBegins.begin(),RowsBegins.end()))
+    return false;
+
+  for (auto Pixel : Pixels)
+  {
+    if (Pixel >= Grid.Width*Grid.Height)
+      return false;
+  }
+
+  m_Grid = Grid;
+  m_ZonesHash = ZonesHash;
+  m_RowsBegins.swap(RowsBegins);
+  m_Pixels.swap(Pixels);
+  m_Weights.swap(Weights);
+
+  return true;
+}
+
+
+// =====================================================================
+// =====================================================================
+
+
+void ZonalWeights::computeMeans(const double* Pixels, double* Means) const
+{
+  for (unsigned int z = 0; z < getZonesCount(); z++)
+  {
+    double Sum = 0.0;
+    double WeightsSum = 0.0;
+
+    for (std::uint64_t w = m_RowsBegins[z]; w < m_RowsBegins[z+1]; w++)
+    {
+      const double Value = Pixels[m_Pixels[w]];
+
+      if (!std::isnan(Value))
+      {
+        Sum += m_Weights[w]*Value;
+        WeightsSum += m_Weights[w];
+      }
+    }
+
+    Means[z] = (WeightsSum > 0.0) ? Sum/WeightsSum : std::numeric_limits<double>::quiet_NaN();
+  }
+}
@@ -0,0 +1,108 @@
+/**
+  @file ZonalWeights.hpp
+*/
+
+
+#ifndef __ZONALWEIGHTS_HPP__
+#define __ZONALWEIGHTS_HPP__
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <ogrsf_frmts.h>
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  North-up grid of a raster: size in pixels and GDAL geotransform
+*/
+class RasterGrid
+{
+  public:
+
+    std::uint64_t Width = 0;
+
+    std::uint64_t Height = 0;
+
+    double GeoTransform[6] = {};
+
+
+    bool operator==(const RasterGrid& Other) const;
+};
+
+
+// =====================================================================
+// =====================================================================
+
+
+/**
+  Coverage weights of raster pixels for a list of zones (SU geometries), as a sparse matrix in compressed rows
+  with one row per zone.
+
+  A pixel covers a zone when its center is inside the zone polygons (even-odd rule, so holes are excluded),
+  all covering pixels having the same weight. A zone too small to contain any pixel center is covered
+  by the pixel containing the center of its envelope.
+  Zonal means of a raster are then a sparse matrix-vector product, without rasterization of the polygons.
+*/
+class ZonalWeights
+{
+  private:
+
+    static const std::uint32_t Version = 1;
+
+    RasterGrid m_Grid;
+
+    std::uint64_t m_ZonesHash = 0;
+
+    std::vector<std::uint64_t> m_RowsBegins;
+
+    std::vector<std::uint64_t> m_Pixels;
+
+    std::vector<double> m_Weights;
+
+
+  public:
+
+    /**
+      Computes the hash of the zones geometries, identifying the zones for cached weights
+    */
+    static std::uint64_t computeZonesHash(const std::vector<const OGRGeometry*>& Zones);
+
+    /**
+      Builds the weights of the given zones on the given grid
+    */
+    void build(const RasterGrid& Grid, const std::vector<const OGRGeometry*>& Zones);
+
+    /**
+      Writes the weights, under a temporary name then renamed
+      @return false if the file could not be written
+    */
+    bool save(const std::string& FilePath) const;
+
+    /**
+      Loads weights previously saved for the given grid and zones
+      @return false if the file does not exist, is not valid, or was built for another grid or other zones
+    */
+    bool load(const std::string& FilePath, const RasterGrid& Grid, std::uint64_t ZonesHash);
+
+    unsigned int getZonesCount() const
+    {
+      return m_RowsBegins.empty() ? 0 : m_RowsBegins.size()-1;
+    }
+
+    /**
+      Computes the mean value of each zone. NaN pixels (no data) are ignored,
+      zones without any valid pixel get a NaN mean
+      @param[in] Pixels the raster values, in rows of the grid
+      @param[out] Means the means, one per zone
+    */
+    void computeMeans(const double* Pixels, double* Means) const;
+};
+
+
+#endif /* __ZONALWEIGHTS_HPP__ */